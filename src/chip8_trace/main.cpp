@@ -0,0 +1,133 @@
+#include <chissembler/source_map.hpp>
+#include <common/mapped_file.hpp>
+#include <common/utils.hpp>
+#include <cstdlib>
+#include <format>
+#include <instruction_trace/trace_reader.hpp>
+#include <iostream>
+#include <span>
+#include <string_view>
+
+namespace {
+    using chissembler::SourceMapView;
+    using instruction_trace::Record;
+    using instruction_trace::TraceReader;
+
+    void print_usage() {
+        std::cerr << "usage:\n"
+                     "  chip8_trace info <trace>\n"
+                     "  chip8_trace show <trace> <cycle> [count] [--source-map <map>]\n"
+                     "  chip8_trace diff <trace> <other trace>\n";
+    }
+
+    void print_record(u64 const cycle, Record const& record, SourceMapView const* const source_map = nullptr) {
+        auto line = std::format("{:>10}  {:03X}  {:04X}", cycle, record.instruction_pointer, record.opcode);
+        if (source_map != nullptr) {
+            auto const location = source_map->find(record.instruction_pointer);
+            if (location.has_value()) {
+                line += std::format("  {}:{}:{}", location->file, location->line, location->column);
+            }
+        }
+        for (auto const& delta : record.changed_registers()) {
+            if (delta.register_index == emulator::RegisterDelta::address_register) {
+                line += std::format("  I={:03X}", delta.value);
+            } else {
+                line += std::format("  V{:X}={:02X}", delta.register_index, delta.value);
+            }
+        }
+        for (auto const& delta : record.changed_memory()) {
+            line += std::format("  [{:03X}]={:02X}", delta.address, delta.value);
+        }
+        std::cout << line << '\n';
+    }
+
+    [[nodiscard]] int info(std::span<char const* const> const arguments) {
+        if (arguments.size() != 1) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        auto const reader = TraceReader{ arguments[0] };
+        std::cout << std::format("{} instructions\n", reader.num_records());
+        return EXIT_SUCCESS;
+    }
+
+    [[nodiscard]] int show(std::span<char const* const> arguments) {
+        auto source_map_file = Optional<MappedFile>{};
+        if (arguments.size() >= 2 and std::string_view{ arguments[arguments.size() - 2] } == "--source-map") {
+            source_map_file.emplace(arguments.back());
+            arguments = arguments.first(arguments.size() - 2);
+        }
+        if (arguments.size() < 2 or arguments.size() > 3) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        auto const cycle = to_int<u64>(arguments[1]);
+        auto const count = arguments.size() == 3 ? to_int<u64>(arguments[2]) : Optional<u64>{ 1 };
+        if (not cycle or not count) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        auto source_map = Optional<SourceMapView>{};
+        if (source_map_file.has_value()) {
+            source_map.emplace(source_map_file->bytes());
+        }
+        auto const reader = TraceReader{ arguments[0] };
+        auto current_cycle = cycle.value();
+        for (auto const& record : reader.read(cycle.value(), count.value())) {
+            print_record(current_cycle, record, source_map.has_value() ? &source_map.value() : nullptr);
+            ++current_cycle;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    [[nodiscard]] int diff(std::span<char const* const> const arguments) {
+        if (arguments.size() != 2) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        auto const lhs = TraceReader{ arguments[0] };
+        auto const rhs = TraceReader{ arguments[1] };
+        auto const divergence = find_first_divergence(lhs, rhs);
+        if (not divergence) {
+            std::cout << std::format("traces are identical ({} instructions)\n", lhs.num_records());
+            return EXIT_SUCCESS;
+        }
+        auto const cycle = divergence.value();
+        std::cout << std::format("traces diverge at cycle {}\n", cycle);
+        for (auto const& [name, reader] : { std::pair{ arguments[0], &lhs }, std::pair{ arguments[1], &rhs } }) {
+            std::cout << name << ":\n";
+            if (cycle < reader->num_records()) {
+                print_record(cycle, reader->read(cycle));
+            } else {
+                std::cout << "  (end of trace)\n";
+            }
+        }
+        return EXIT_FAILURE;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    auto const arguments = std::span<char const* const>{ argv, static_cast<usize>(argc) };
+    if (arguments.size() < 2) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    auto const command = std::string_view{ arguments[1] };
+    auto const command_arguments = arguments.subspan(2);
+    try {
+        if (command == "info") {
+            return info(command_arguments);
+        }
+        if (command == "show") {
+            return show(command_arguments);
+        }
+        if (command == "diff") {
+            return diff(command_arguments);
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    print_usage();
+    return EXIT_FAILURE;
+}
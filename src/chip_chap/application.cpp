@@ -3,8 +3,11 @@
 #include <backends/imgui_impl_opengl3.h>
 #include <backends/imgui_impl_sdl2.h>
 #include <chrono>
+#include <common/trace.hpp>
 #include <common/visitor.hpp>
 
+static constexpr auto trace_filename = "chip_chap_trace.json";
+
 Application::Application() : m_window{ 1280, 720, "Chip-Chap" } { }
 
 void Application::run() {
@@ -13,8 +16,16 @@ void Application::run() {
     auto last = start;
 
     while (m_running) {
+        TRACE_SCOPE("Application::run");
         using std::chrono::duration_cast, std::chrono::microseconds;
 
+        auto phase_start = Clock::now();
+        auto const end_phase = [&](FrameProfiler::Phase const phase) {
+            auto const phase_end = Clock::now();
+            m_frame_profiler.record(phase, std::chrono::duration<double>(phase_end - phase_start).count());
+            phase_start = phase_end;
+        };
+
         m_window.update();
         while (auto const event = m_window.next_event()) {
             visit(
@@ -24,27 +35,40 @@ void Application::run() {
                         if (key_down_event.which == KeyCode::Escape) {
                             m_running = false;
                         }
+                        if (key_down_event.which == KeyCode::F12) {
+                            TRACE_DUMP(trace_filename);
+                        }
                     },
                     [&](event::KeyUp const&) {}
             );
             handle_event(event.value());
         }
+        end_phase(FrameProfiler::Phase::EventPolling);
+
         auto const current = Clock::now();
         auto const elapsed = current - last;
         m_delta_seconds = static_cast<double>(duration_cast<microseconds>(elapsed).count()) / 1000000.0;
         m_elapsed_seconds = static_cast<double>(duration_cast<microseconds>(current - start).count()) / 1000000.0;
         update();
+        end_phase(FrameProfiler::Phase::Update);
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
         imgui_render();
         ImGui::Render();
+        end_phase(FrameProfiler::Phase::ImGuiBuild);
+
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        end_phase(FrameProfiler::Phase::Render);
+
         SDL_GL_SwapWindow(m_window.sdl_window());
+        end_phase(FrameProfiler::Phase::Swap);
+        m_frame_profiler.end_frame();
 
         last = current;
     }
+    TRACE_DUMP(trace_filename);
 }
 
 [[nodiscard]] double Application::elapsed_seconds() const {
@@ -55,6 +79,10 @@ void Application::run() {
     return m_delta_seconds;
 }
 
+[[nodiscard]] FrameProfiler const& Application::frame_profiler() const {
+    return m_frame_profiler;
+}
+
 void Application::quit() {
     m_running = false;
 }
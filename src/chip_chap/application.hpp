@@ -1,5 +1,6 @@
 #pragma once
 
+#include "frame_profiler.hpp"
 #include "window.hpp"
 
 class Application {
@@ -8,6 +9,7 @@ private:
     bool m_running = true;
     double m_elapsed_seconds = 0.0;
     double m_delta_seconds = 0.0;
+    FrameProfiler m_frame_profiler;
 
 public:
     Application();
@@ -25,5 +27,6 @@ protected:
     virtual void handle_event(event::Event const& event) = 0;
     [[nodiscard]] double elapsed_seconds() const;
     [[nodiscard]] double delta_seconds() const;
+    [[nodiscard]] FrameProfiler const& frame_profiler() const;
     void quit();
 };
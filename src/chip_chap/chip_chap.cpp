@@ -1,12 +1,21 @@
 #include "chip_chap.hpp"
+#include <algorithm>
 #include <array>
+#include <chissembler/chissembler.hpp>
+#include <cmath>
+#include <common/trace.hpp>
+#include <format>
+#include <fstream>
 #include <gsl/gsl>
 #include <imgui.h>
 #include <imgui_internal.h>
-#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 static constexpr auto dimmed = IM_COL32(128, 128, 128, 255);
 static constexpr auto white = IM_COL32(255, 255, 255, 255);
+static constexpr auto trace_filename = "chip_chap.trace";
 
 static constexpr auto default_key_bindings = std::array{
     // clang-format off
@@ -39,10 +48,63 @@ void render_text(unsigned const color, bool const same_line, char const* const f
     ImGui::PopStyleColor();
 };
 
-ChipChap::ChipChap()
+#ifdef ENABLE_EMULATOR_PROFILING
+static void render_call_graph_node(
+        emulator::CallGraph const& call_graph,
+        std::vector<u64> const& inclusive_counts,
+        emulator::CallGraph::NodeIndex const index,
+        double const instructions_per_second
+) {
+    auto const& node = call_graph.nodes().at(index);
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    auto const flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_DefaultOpen
+                       | (node.children.empty() ? ImGuiTreeNodeFlags_Leaf : 0);
+    auto const id = reinterpret_cast<void*>(static_cast<intptr_t>(index));
+    auto const is_open = (index == emulator::CallGraph::root ? ImGui::TreeNodeEx(id, flags, "root")
+                                                             : ImGui::TreeNodeEx(id, flags, "0x%03X", node.address));
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", static_cast<unsigned long long>(node.num_calls));
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", static_cast<unsigned long long>(inclusive_counts.at(index)));
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", static_cast<unsigned long long>(node.exclusive_count));
+    ImGui::TableNextColumn();
+    ImGui::Text("%.3f", static_cast<double>(inclusive_counts.at(index)) / instructions_per_second);
+    if (is_open) {
+        for (auto const child : node.children) {
+            render_call_graph_node(call_graph, inclusive_counts, child, instructions_per_second);
+        }
+        ImGui::TreePop();
+    }
+}
+#endif
+
+ChipChap::ChipChap(Optional<std::filesystem::path> const& rom_path)
     : m_input_source{ default_key_bindings },
       m_emulator{ m_screen, m_input_source, m_time_source },
       m_time_of_last_instruction{ elapsed_seconds() } {
+    // loading may throw, so this happens before any GL resources are created (the destructor wouldn't free them)
+    if (rom_path.has_value()) {
+        load_rom(rom_path.value());
+        load_source_map(rom_path.value());
+    } else {
+        auto write_instruction = [this, address = chissembler::program_start_address](u16 const instruction) mutable {
+            m_emulator.write(address, gsl::narrow<u8>(instruction >> 8));
+            m_emulator.write(address + 1, gsl::narrow<u8>(instruction & 0xFF));
+            address += 2;
+        };
+
+        write_instruction(0x6000); // 6XNN: Store number NN in register VX
+        write_instruction(0xF029); // set address to glyph sprite
+        write_instruction(0xD115); // draw glyph
+        write_instruction(0x7001); // ++VX
+        write_instruction(0xD115); // undraw glyph
+        write_instruction(0x4010); // skip next instruction if VX != 0x10
+        write_instruction(0x1200); // jump back to the start
+        write_instruction(0x1202); // jump to 0x202
+    }
+
     glGenTextures(1, &m_texture_name);
     glBindTexture(GL_TEXTURE_2D, m_texture_name);
 
@@ -51,35 +113,63 @@ ChipChap::ChipChap()
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    auto write_instruction = [this, address = emulator::Chip8::Address{ 0x200 }](u16 const instruction) mutable {
-        m_emulator.write(address, gsl::narrow<u8>(instruction >> 8));
-        m_emulator.write(address + 1, gsl::narrow<u8>(instruction & 0xFF));
-        address += 2;
-    };
-
-    write_instruction(0x6000); // 6XNN: Store number NN in register VX
-    write_instruction(0xF029); // set address to glyph sprite
-    write_instruction(0xD115); // draw glyph
-    write_instruction(0x7001); // ++VX
-    write_instruction(0xD115); // undraw glyph
-    write_instruction(0x4010); // skip next instruction if VX != 0x10
-    write_instruction(0x1200); // jump back to the start
-    write_instruction(0x1202); // jump to 0x202
 }
 
 ChipChap::~ChipChap() {
+    stop_trace_recording();
     glDeleteTextures(1, &m_texture_name);
 }
 
-void ChipChap::update() {
-    m_deltas.push_back(delta_seconds());
-    auto const sum = std::accumulate(m_deltas.cbegin(), m_deltas.cend(), 0.0);
-    if (sum >= 1.0) {
-        m_delta_display_value = sum / static_cast<double>(m_deltas.size());
-        m_deltas.clear();
+void ChipChap::load_rom(std::filesystem::path const& rom_path) {
+    using Address = emulator::Chip8::Address;
+    using chissembler::program_start_address;
+    auto const rom = MappedFile{ rom_path };
+    if (rom.size() > m_emulator.memory().size() - program_start_address) {
+        throw std::runtime_error{ std::format("ROM '{}' doesn't fit into memory", rom_path.string()) };
+    }
+    for (usize i = 0; i < rom.size(); ++i) {
+        m_emulator.write(gsl::narrow<Address>(program_start_address + i), static_cast<u8>(rom.bytes()[i]));
+    }
+}
+
+// the source map is optional, so failing to load it is no error
+void ChipChap::load_source_map(std::filesystem::path const& rom_path) {
+    auto path = rom_path;
+    path += ".map";
+    if (not std::filesystem::exists(path)) {
+        m_source_map_status = "no source map";
+        return;
+    }
+    try {
+        m_source_map_file.emplace(path);
+        m_source_map.emplace(m_source_map_file->bytes());
+        m_source_map_status = std::format("source map: {}", path.string());
+    } catch (std::exception const& e) {
+        m_source_map_file = none;
+        m_source_map_status = std::format("unable to use source map: {}", e.what());
+    }
+}
+
+// "0x204" or, if a source map has been loaded, "0x204 (loop + 4)"
+[[nodiscard]] std::string ChipChap::describe_address(u16 const address) const {
+    auto result = std::format("0x{:03X}", address);
+    if (not m_source_map.has_value()) {
+        return result;
     }
+    auto const label = m_source_map->find_label(address);
+    if (not label.has_value()) {
+        return result;
+    }
+    if (label->address == address) {
+        return std::format("{} ({})", result, label->name);
+    }
+    return std::format("{} ({} + {})", result, label->name, address - label->address);
+}
+
+void ChipChap::update() {
+    TRACE_SCOPE("ChipChap::update");
     if (m_state == State::Playing) {
+        TRACE_SCOPE("execute instructions");
         auto const delta = 1.0 / m_instructions_per_second;
         while (m_time_of_last_instruction < elapsed_seconds()) {
             make_step();
@@ -89,6 +179,14 @@ void ChipChap::update() {
     } else if (not m_stop_time_when_paused) {
         m_time_source.advance(delta_seconds());
     }
+
+    auto const time_since_last_measurement = elapsed_seconds() - m_time_of_last_measurement;
+    if (time_since_last_measurement >= 1.0) {
+        auto const steps = static_cast<double>(m_steps_executed - m_steps_at_last_measurement);
+        m_measured_instructions_per_second = steps / time_since_last_measurement;
+        m_steps_at_last_measurement = m_steps_executed;
+        m_time_of_last_measurement = elapsed_seconds();
+    }
 }
 
 void ChipChap::handle_event(event::Event const& event) {
@@ -122,7 +220,18 @@ void ChipChap::render_keypad_window() const {
 void ChipChap::render_execution_window() const {
     ImGui::Begin("Execution");
     using Address = emulator::Chip8::Address;
-    render_text(white, false, "Instruction Pointer: 0x%03X", m_emulator.instruction_pointer());
+    render_text(white, false, "Instruction Pointer: %s", describe_address(m_emulator.instruction_pointer()).c_str());
+    if (m_source_map.has_value()) {
+        auto const location = m_source_map->find(m_emulator.instruction_pointer());
+        if (location.has_value()) {
+            auto const text = std::format("{}:{}:{}", location->file, location->line, location->column);
+            render_text(white, false, "Source: %s", text.c_str());
+        } else {
+            render_text(dimmed, false, "Source: -");
+        }
+    } else if (not m_source_map_status.empty()) {
+        render_text(dimmed, false, "%s", m_source_map_status.c_str());
+    }
     for (int line = 0; line < 3; ++line) {
         if ((line == 0 and m_emulator.instruction_pointer() < 8)
             or (line == 2 and m_emulator.instruction_pointer() >= m_emulator.memory().size() - 8)) {
@@ -167,11 +276,13 @@ void ChipChap::render_registers_window() const {
 
 void ChipChap::render_general_window() const {
     ImGui::Begin("General");
-    ImGui::Text("       delta: %.03f ms", m_delta_display_value * 1000.0);
-    if (m_delta_display_value == 0.0) {
+    auto const& profiler = frame_profiler();
+    auto const frame_statistics = profiler.frame_statistics();
+    ImGui::Text("       delta: %.03f ms", frame_statistics.mean * 1000.0);
+    if (frame_statistics.mean == 0.0) {
         ImGui::Text("         fps: -");
     } else {
-        ImGui::Text("         fps: %.01f", 1.0 / m_delta_display_value);
+        ImGui::Text("         fps: %.01f", 1.0 / frame_statistics.mean);
     }
     ImGui::Text("elapsed time: %.03f s", elapsed_seconds());
     ImGui::Text(" time source: %.03f s", m_time_source.elapsed_seconds());
@@ -187,24 +298,63 @@ void ChipChap::render_general_window() const {
     } else {
         ImGui::Text("      halted: false");
     }
+
+    ImGui::Separator();
+    ImGui::Text("frame times of the last %zu frames (ms):", profiler.num_frames());
+    ImGui::Text(
+            "       p50: %7.03f  p95: %7.03f  p99: %7.03f  max: %7.03f",
+            frame_statistics.p50 * 1000.0,
+            frame_statistics.p95 * 1000.0,
+            frame_statistics.p99 * 1000.0,
+            frame_statistics.max * 1000.0
+    );
+    for (usize i = 0; i < FrameProfiler::num_phases; ++i) {
+        auto const phase = static_cast<FrameProfiler::Phase>(i);
+        auto const phase_statistics = profiler.phase_statistics(phase);
+        ImGui::Text(
+                "%10s: %7.03f       %7.03f       %7.03f       %7.03f",
+                FrameProfiler::phase_name(phase).data(),
+                phase_statistics.p50 * 1000.0,
+                phase_statistics.p95 * 1000.0,
+                phase_statistics.p99 * 1000.0,
+                phase_statistics.max * 1000.0
+        );
+    }
+    ImGui::PlotLines(
+            "##frame_times",
+            profiler.graph_values(),
+            gsl::narrow<int>(profiler.num_frames()),
+            gsl::narrow<int>(profiler.graph_offset()),
+            nullptr,
+            0.0f,
+            static_cast<float>(frame_statistics.max * 1000.0),
+            ImVec2{ 0.0f, 80.0f }
+    );
+    if (ImGui::Button("Export CSV")) {
+        auto file = std::ofstream{ "frame_times.csv" };
+        profiler.write_csv(file);
+    }
     ImGui::End();
 }
 
 void ChipChap::render_screen_window() const {
     glClearColor(30.0f / 255.0f, 30.0f / 255.0f, 46.0f / 255.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
-    glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RGBA,
-            gsl::narrow<GLint>(m_screen.width()),
-            gsl::narrow<GLint>(m_screen.height()),
-            0,
-            GL_RGBA,
-            GL_UNSIGNED_BYTE,
-            m_screen.raw_data().data()
-    );
-    glBindTexture(GL_TEXTURE_2D, m_texture_name);
+    {
+        TRACE_SCOPE("texture upload");
+        glTexImage2D(
+                GL_TEXTURE_2D,
+                0,
+                GL_RGBA,
+                gsl::narrow<GLint>(m_screen.width()),
+                gsl::narrow<GLint>(m_screen.height()),
+                0,
+                GL_RGBA,
+                GL_UNSIGNED_BYTE,
+                m_screen.raw_data().data()
+        );
+        glBindTexture(GL_TEXTURE_2D, m_texture_name);
+    }
 
     static constexpr auto min_size = ImVec2{ 400.0f, 200.0f };
     static constexpr auto max_size = ImVec2{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
@@ -224,12 +374,137 @@ void ChipChap::render_screen_window() const {
     ImGui::End();
 }
 
+void ChipChap::render_profile_window() {
+    ImGui::Begin("Profile");
+    ImGui::Text("instructions/s: %.0f", m_measured_instructions_per_second);
+#ifdef ENABLE_EMULATOR_PROFILING
+    auto const& profile = m_emulator.profile();
+    ImGui::Text("      executed: %llu", static_cast<unsigned long long>(profile.num_instructions()));
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        m_emulator.reset_profile();
+    }
+
+    ImGui::Separator();
+    static constexpr auto num_top_opcodes = usize{ 10 };
+    auto opcode_classes = std::array<emulator::OpcodeClass, emulator::num_opcode_classes>{};
+    for (usize i = 0; i < opcode_classes.size(); ++i) {
+        opcode_classes.at(i) = static_cast<emulator::OpcodeClass>(i);
+    }
+    std::partial_sort(
+            opcode_classes.begin(),
+            opcode_classes.begin() + num_top_opcodes,
+            opcode_classes.end(),
+            [&](emulator::OpcodeClass const lhs, emulator::OpcodeClass const rhs) {
+                return profile.opcode_count(lhs) > profile.opcode_count(rhs);
+            }
+    );
+    for (usize i = 0; i < num_top_opcodes; ++i) {
+        auto const count = profile.opcode_count(opcode_classes.at(i));
+        if (count == 0) {
+            break;
+        }
+        auto const fraction = static_cast<double>(count) / static_cast<double>(profile.num_instructions());
+        ImGui::Text(
+                "%s: %12llu (%5.1f %%)",
+                emulator::opcode_pattern(opcode_classes.at(i)).data(),
+                static_cast<unsigned long long>(count),
+                fraction * 100.0
+        );
+    }
+
+    // heat map of the address space, one cell per address, logarithmic color scale
+    ImGui::Separator();
+    static constexpr auto cells_per_row = usize{ 64 };
+    auto const& address_counts = profile.address_counts();
+    auto const max_count = std::max(*std::max_element(address_counts.cbegin(), address_counts.cend()), u64{ 1 });
+    auto const log_max_count = std::log1p(static_cast<double>(max_count));
+    auto const num_rows = (address_counts.size() + cells_per_row - 1) / cells_per_row;
+    auto const available_width = ImGui::GetContentRegionAvail().x;
+    auto const cell_size = std::max(std::floor(available_width / static_cast<float>(cells_per_row)), 2.0f);
+    auto const origin = ImGui::GetCursorScreenPos();
+    auto const draw_list = ImGui::GetWindowDrawList();
+    for (usize address = 0; address < address_counts.size(); ++address) {
+        auto const intensity = std::log1p(static_cast<double>(address_counts.at(address))) / log_max_count;
+        auto const red = static_cast<int>(std::min(intensity * 2.0, 1.0) * 255.0);
+        auto const green = static_cast<int>(std::max(intensity * 2.0 - 1.0, 0.0) * 255.0);
+        auto const top_left = ImVec2{
+            origin.x + static_cast<float>(address % cells_per_row) * cell_size,
+            origin.y + static_cast<float>(address / cells_per_row) * cell_size,
+        };
+        auto const bottom_right = ImVec2{ top_left.x + cell_size, top_left.y + cell_size };
+        draw_list->AddRectFilled(top_left, bottom_right, IM_COL32(red, green, 32, 255));
+    }
+    auto const heat_map_size =
+            ImVec2{ cell_size * static_cast<float>(cells_per_row), cell_size * static_cast<float>(num_rows) };
+    ImGui::InvisibleButton("##heat_map", heat_map_size);
+    if (ImGui::IsItemHovered()) {
+        auto const mouse = ImGui::GetMousePos();
+        auto const column = static_cast<usize>((mouse.x - origin.x) / cell_size);
+        auto const row = static_cast<usize>((mouse.y - origin.y) / cell_size);
+        auto const address = row * cells_per_row + column;
+        if (column < cells_per_row and address < address_counts.size()) {
+            ImGui::SetTooltip(
+                    "0x%03zX: %llu", address, static_cast<unsigned long long>(address_counts.at(address))
+            );
+        }
+    }
+
+    // the emulated time of a routine assumes that all instructions were executed at the current frequency
+    ImGui::Separator();
+    auto const& call_graph = profile.call_graph();
+    ImGui::Text("subroutines (inclusive/exclusive instructions, emulated seconds):");
+    ImGui::SameLine();
+    if (ImGui::Button("Export folded stacks")) {
+        auto file = std::ofstream{ "call_graph.folded" };
+        call_graph.write_folded_stacks(file);
+    }
+    if (ImGui::BeginTable("##routines", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("routine");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableSetupColumn("inclusive");
+        ImGui::TableSetupColumn("exclusive");
+        ImGui::TableSetupColumn("inclusive (s)");
+        ImGui::TableHeadersRow();
+        for (auto const& routine : call_graph.routines()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", describe_address(routine.address).c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(routine.num_calls));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(routine.inclusive_count));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(routine.exclusive_count));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", static_cast<double>(routine.inclusive_count) / m_instructions_per_second);
+        }
+        ImGui::EndTable();
+    }
+    if (ImGui::BeginTable("##call_graph", 5, ImGuiTableFlags_BordersV | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("calling context");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableSetupColumn("inclusive");
+        ImGui::TableSetupColumn("exclusive");
+        ImGui::TableSetupColumn("inclusive (s)");
+        ImGui::TableHeadersRow();
+        auto const inclusive_counts = call_graph.inclusive_counts();
+        render_call_graph_node(call_graph, inclusive_counts, emulator::CallGraph::root, m_instructions_per_second);
+        ImGui::EndTable();
+    }
+#else
+    ImGui::Text("per-opcode profiling is disabled (configure with ENABLE_EMULATOR_PROFILING=ON)");
+#endif
+    ImGui::End();
+}
+
 void ChipChap::imgui_render() {
     render_screen_window();
     render_general_window();
     render_registers_window();
     render_execution_window();
     render_keypad_window();
+    render_profile_window();
 
     ImGui::ShowDemoWindow();
 
@@ -268,6 +543,22 @@ void ChipChap::imgui_render() {
     ImGui::SliderFloat("##", &execution_frequency, 1.0f, 6000.0f, "frequency = %.1f");
     m_instructions_per_second = static_cast<double>(execution_frequency);
 
+    if (m_trace_writer == nullptr) {
+        if (ImGui::Button("Record trace")) {
+            start_trace_recording();
+        }
+    } else {
+        if (ImGui::Button("Stop recording")) {
+            stop_trace_recording();
+        } else {
+            m_trace_status = std::format("recording... ({} instructions)", m_trace_writer->num_records());
+        }
+    }
+    if (not m_trace_status.empty()) {
+        ImGui::SameLine();
+        ImGui::TextUnformatted(m_trace_status.c_str());
+    }
+
     if (start_playing) {
         m_state = State::Playing;
         m_time_of_last_instruction = elapsed_seconds();
@@ -286,3 +577,26 @@ void ChipChap::make_step() {
     m_emulator.execute_next_instruction();
     ++m_steps_executed;
 }
+
+void ChipChap::start_trace_recording() {
+    try {
+        m_trace_writer = std::make_unique<instruction_trace::TraceWriter>(trace_filename);
+        m_emulator.set_trace_sink(m_trace_writer.get());
+    } catch (instruction_trace::TraceError const& e) {
+        m_trace_status = e.what();
+    }
+}
+
+void ChipChap::stop_trace_recording() {
+    if (m_trace_writer == nullptr) {
+        return;
+    }
+    m_emulator.set_trace_sink(nullptr);
+    try {
+        m_trace_writer->finish();
+        m_trace_status = std::format("wrote {} instructions to {}", m_trace_writer->num_records(), trace_filename);
+    } catch (instruction_trace::TraceError const& e) {
+        m_trace_status = e.what();
+    }
+    m_trace_writer.reset();
+}
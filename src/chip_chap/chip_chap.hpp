@@ -5,8 +5,13 @@
 #include "screen.hpp"
 #include "time_source.hpp"
 #include <chip8/chip8.hpp>
+#include <chissembler/source_map.hpp>
+#include <common/mapped_file.hpp>
+#include <filesystem>
 #include <glad/glad.h>
-#include <vector>
+#include <instruction_trace/trace_writer.hpp>
+#include <memory>
+#include <string>
 
 class ChipChap final : public Application {
 private:
@@ -15,8 +20,6 @@ private:
         Playing,
     };
 
-    std::vector<double> m_deltas;
-    double m_delta_display_value = 0.0;
     GLuint m_texture_name = 0;
     Screen m_screen;
     InputSource m_input_source;
@@ -26,10 +29,19 @@ private:
     double m_time_of_last_instruction;
     double m_instructions_per_second = 5.0;
     usize m_steps_executed = 0;
+    usize m_steps_at_last_measurement = 0;
+    double m_time_of_last_measurement = 0.0;
+    double m_measured_instructions_per_second = 0.0;
     bool m_stop_time_when_paused = true;
+    std::unique_ptr<instruction_trace::TraceWriter> m_trace_writer;
+    std::string m_trace_status;
+    Optional<MappedFile> m_source_map_file;            // keeps the data of `m_source_map` mapped
+    Optional<chissembler::SourceMapView> m_source_map; // from the .map file next to the ROM, if there is one
+    std::string m_source_map_status;
 
 public:
-    ChipChap();
+    // runs a small demo program if no ROM is given
+    explicit ChipChap(Optional<std::filesystem::path> const& rom_path = none);
     ~ChipChap() override;
 
 protected:
@@ -38,10 +50,16 @@ protected:
     void imgui_render() override;
 
 private:
+    void load_rom(std::filesystem::path const& rom_path);
+    void load_source_map(std::filesystem::path const& rom_path);
+    [[nodiscard]] std::string describe_address(u16 address) const;
     void make_step();
+    void start_trace_recording();
+    void stop_trace_recording();
     void render_keypad_window() const;
     void render_execution_window() const;
     void render_registers_window() const;
     void render_general_window() const;
     void render_screen_window() const;
+    void render_profile_window();
 };
@@ -0,0 +1,113 @@
+#include "frame_profiler.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <format>
+#include <ostream>
+#include <utility>
+
+void FrameProfiler::record(Phase const phase, double const seconds) {
+    m_current_frame.phase_seconds.at(std::to_underlying(phase)) += seconds;
+    m_current_frame.total_seconds += seconds;
+}
+
+void FrameProfiler::end_frame() {
+    if (m_num_frames < capacity) {
+        ++m_num_frames;
+    }
+    m_frames.at(m_next_index) = m_current_frame;
+    m_frame_milliseconds.at(m_next_index) = static_cast<float>(m_current_frame.total_seconds * 1000.0);
+    m_next_index = (m_next_index + 1) % capacity;
+    m_current_frame = Frame{};
+}
+
+[[nodiscard]] usize FrameProfiler::num_frames() const {
+    return m_num_frames;
+}
+
+[[nodiscard]] FrameProfiler::Statistics FrameProfiler::frame_statistics() const {
+    return compute_statistics([](Frame const& frame) { return frame.total_seconds; });
+}
+
+[[nodiscard]] FrameProfiler::Statistics FrameProfiler::phase_statistics(Phase const phase) const {
+    return compute_statistics([phase](Frame const& frame) {
+        return frame.phase_seconds.at(std::to_underlying(phase));
+    });
+}
+
+[[nodiscard]] float const* FrameProfiler::graph_values() const {
+    return m_frame_milliseconds.data();
+}
+
+[[nodiscard]] usize FrameProfiler::graph_offset() const {
+    return m_num_frames == capacity ? m_next_index : 0;
+}
+
+void FrameProfiler::write_csv(std::ostream& stream) const {
+    stream << "frame";
+    for (usize i = 0; i < num_phases; ++i) {
+        stream << ',' << phase_name(static_cast<Phase>(i)) << "_ms";
+    }
+    stream << ",total_ms\n";
+    for (usize age_index = 0; age_index < m_num_frames; ++age_index) {
+        auto const& current = frame(age_index);
+        stream << age_index;
+        for (auto const seconds : current.phase_seconds) {
+            stream << std::format(",{:.4f}", seconds * 1000.0);
+        }
+        stream << std::format(",{:.4f}\n", current.total_seconds * 1000.0);
+    }
+}
+
+[[nodiscard]] std::string_view FrameProfiler::phase_name(Phase const phase) {
+    switch (phase) {
+        case Phase::EventPolling:
+            return "events";
+        case Phase::Update:
+            return "update";
+        case Phase::ImGuiBuild:
+            return "imgui";
+        case Phase::Render:
+            return "render";
+        case Phase::Swap:
+            return "swap";
+    }
+    std::unreachable();
+}
+
+template<typename Projection>
+[[nodiscard]] FrameProfiler::Statistics FrameProfiler::compute_statistics(Projection projection) const {
+    if (m_num_frames == 0) {
+        return Statistics{};
+    }
+
+    // sorting a copy of at most `capacity` values is cheap enough to be done every frame and needs no allocation
+    auto sorted = std::array<double, capacity>{};
+    auto sum = 0.0;
+    for (usize age_index = 0; age_index < m_num_frames; ++age_index) {
+        sorted.at(age_index) = projection(frame(age_index));
+        sum += sorted.at(age_index);
+    }
+    auto const end = sorted.begin() + static_cast<std::ptrdiff_t>(m_num_frames);
+    std::sort(sorted.begin(), end);
+
+    // nearest-rank method
+    auto const percentile = [&](double const fraction) {
+        auto const rank = static_cast<usize>(std::ceil(fraction * static_cast<double>(m_num_frames)));
+        return sorted.at(std::clamp(rank, usize{ 1 }, m_num_frames) - 1);
+    };
+
+    return Statistics{
+        .p50 = percentile(0.50),
+        .p95 = percentile(0.95),
+        .p99 = percentile(0.99),
+        .max = sorted.at(m_num_frames - 1),
+        .mean = sum / static_cast<double>(m_num_frames),
+    };
+}
+
+[[nodiscard]] FrameProfiler::Frame const& FrameProfiler::frame(usize const age_index) const {
+    assert(age_index < m_num_frames);
+    auto const oldest_index = (m_next_index + capacity - m_num_frames) % capacity;
+    return m_frames.at((oldest_index + age_index) % capacity);
+}
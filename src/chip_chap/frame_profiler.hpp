@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <common/types.hpp>
+#include <iosfwd>
+#include <string_view>
+
+class FrameProfiler final {
+public:
+    enum class Phase : u8 {
+        EventPolling,
+        Update,
+        ImGuiBuild,
+        Render,
+        Swap,
+    };
+
+    static constexpr auto num_phases = usize{ 5 };
+    static constexpr auto capacity = usize{ 1024 };
+
+    struct Statistics {
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+    };
+
+private:
+    struct Frame {
+        std::array<double, num_phases> phase_seconds = {};
+        double total_seconds = 0.0;
+    };
+
+    std::array<Frame, capacity> m_frames = {};
+    std::array<float, capacity> m_frame_milliseconds = {}; // kept separately to feed ImGui::PlotLines directly
+    Frame m_current_frame;
+    usize m_next_index = 0;
+    usize m_num_frames = 0;
+
+public:
+    void record(Phase phase, double seconds);
+    void end_frame();
+
+    [[nodiscard]] usize num_frames() const;
+    [[nodiscard]] Statistics frame_statistics() const;
+    [[nodiscard]] Statistics phase_statistics(Phase phase) const;
+
+    // the oldest frame is located at index `graph_offset()`, which matches the semantics of ImGui::PlotLines()
+    [[nodiscard]] float const* graph_values() const;
+    [[nodiscard]] usize graph_offset() const;
+
+    void write_csv(std::ostream& stream) const;
+
+    [[nodiscard]] static std::string_view phase_name(Phase phase);
+
+private:
+    template<typename Projection>
+    [[nodiscard]] Statistics compute_statistics(Projection projection) const;
+
+    [[nodiscard]] Frame const& frame(usize age_index) const;
+};
@@ -1,8 +1,19 @@
 #include "chip_chap.hpp"
 #include <cstdlib>
+#include <exception>
+#include <iostream>
 
-int main(int, char**) {
-    auto chip_chap = ChipChap{};
-    chip_chap.run();
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cerr << "usage: chip_chap [rom.ch8]\n";
+        return EXIT_FAILURE;
+    }
+    try {
+        auto chip_chap = ChipChap{ argc == 2 ? Optional<std::filesystem::path>{ argv[1] } : none };
+        chip_chap.run();
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,87 @@
+#include <chissembler/object_file.hpp>
+#include <common/mapped_file.hpp>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace {
+    struct Options {
+        std::vector<std::filesystem::path> inputs;
+        Optional<std::filesystem::path> output;
+    };
+
+    void print_usage() {
+        std::cerr << "usage: chissemble-link [options] <input.cso>...\n"
+                     "The modules are laid out in the given order, so the first one contains the entry point.\n"
+                     "options:\n"
+                     "  -o, --output <file>  name of the ROM (default: the first input with the extension .ch8)\n";
+    }
+
+    [[nodiscard]] Optional<Options> parse_arguments(std::span<char const* const> const arguments) {
+        auto result = Options{};
+        for (usize i = 0; i < arguments.size(); ++i) {
+            auto const argument = std::string_view{ arguments[i] };
+            if ((argument == "-o" or argument == "--output") and i + 1 < arguments.size()) {
+                result.output = std::filesystem::path{ arguments[++i] };
+            } else if (argument.starts_with('-')) {
+                return none;
+            } else {
+                result.inputs.emplace_back(argument);
+            }
+        }
+        if (result.inputs.empty()) {
+            return none;
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::vector<chissembler::ObjectFile> read_objects(std::span<std::filesystem::path const> const paths) {
+        auto result = std::vector<chissembler::ObjectFile>{};
+        result.reserve(paths.size());
+        for (auto const& path : paths) {
+            auto const file = MappedFile{ path };
+            result.push_back(chissembler::read_object(path.string(), file.bytes()));
+        }
+        return result;
+    }
+
+    void write_file(std::filesystem::path const& path, std::span<std::byte const> const data) {
+        auto file = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+        file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.close();
+        if (not file) {
+            throw std::runtime_error{ std::format("unable to write file '{}'", path.string()) };
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    auto const arguments = std::span<char const* const>{ argv, static_cast<usize>(argc) };
+    auto const options = parse_arguments(arguments.subspan(1));
+    if (not options.has_value()) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    auto output = options->inputs.front();
+    output.replace_extension(".ch8");
+    if (options->output.has_value()) {
+        output = options->output.value();
+    }
+
+    try {
+        auto const modules = read_objects(options->inputs);
+        write_file(output, chissembler::link(modules));
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
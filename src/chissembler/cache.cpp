@@ -0,0 +1,153 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <common/atomic_file.hpp>
+#include <format>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+namespace chissembler {
+    static constexpr auto entry_extension = std::string_view{ ".ch8" };
+
+    // temporary files of writers that have been killed before renaming them are removed once they are this old
+    static constexpr auto stale_temporary_age = std::chrono::hours{ 1 };
+
+    namespace {
+        // two unrelated 64 bit hashes, so that accidental collisions are practically impossible
+        class Hasher final {
+        private:
+            u64 m_first = 0xCBF2'9CE4'8422'2325; // FNV-1a
+            u64 m_second = 0x9E37'79B9'7F4A'7C15;
+
+        public:
+            void update(std::string_view const data) {
+                for (auto const c : data) {
+                    auto const byte = static_cast<u64>(static_cast<unsigned char>(c));
+                    m_first = (m_first ^ byte) * 0x0100'0000'01B3;
+                    m_second = std::rotl(m_second ^ byte, 23) * 0xBF58'476D'1CE4'E5B9;
+                }
+            }
+
+            [[nodiscard]] CacheKey finish() const {
+                // splitmix64 finalizer
+                auto second = m_second;
+                second = (second ^ (second >> 30)) * 0xBF58'476D'1CE4'E5B9;
+                second = (second ^ (second >> 27)) * 0x94D0'49BB'1331'11EB;
+                return CacheKey{ m_first, second ^ (second >> 31) };
+            }
+        };
+    } // namespace
+
+    [[nodiscard]] std::string CacheKey::to_string() const {
+        return std::format("{:016x}{:016x}", first, second);
+    }
+
+    Cache::Cache(std::filesystem::path directory, u64 const max_size)
+        : m_directory{ std::move(directory) },
+          m_max_size{ max_size } {
+        std::filesystem::create_directories(m_directory);
+    }
+
+    [[nodiscard]] bool Cache::is_cacheable(std::string_view const source) {
+        return not source.contains("incbin");
+    }
+
+    [[nodiscard]] CacheKey Cache::key(
+            std::string_view const source,
+            AssembleOptions const& options,
+            CachedOutput const output
+    ) {
+        auto hasher = Hasher{};
+        hasher.update(std::format("chissembler {}\n", version));
+        hasher.update(output == CachedOutput::Object ? "object\n" : "machine code\n");
+        // Only options that have an influence on the machine code are hashed (the listing, the statistics, the
+        // optimization report and the source map are side channels).
+        hasher.update(options.optimize ? "optimized\n" : "unoptimized\n");
+        hasher.update(std::format("{}\n", source.size()));
+        hasher.update(source);
+        return hasher.finish();
+    }
+
+    [[nodiscard]] Optional<std::vector<std::byte>> Cache::load(CacheKey const& key) const {
+        auto const path = entry_path(key);
+        auto error = std::error_code{};
+        auto const size = std::filesystem::file_size(path, error);
+        if (error) {
+            return none;
+        }
+        auto file = std::ifstream{ path, std::ios::binary };
+        auto result = std::vector<std::byte>(static_cast<usize>(size));
+        file.read(reinterpret_cast<char*>(result.data()), static_cast<std::streamsize>(result.size()));
+        if (not file) {
+            return none; // evicted in the meantime
+        }
+        // mark as recently used (failing to do so only affects which entries are evicted first)
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return result;
+    }
+
+    void Cache::store(CacheKey const& key, std::span<std::byte const> const machine_code) const {
+        // if another process has stored the same entry in the meantime, it has the same contents and gets replaced
+        auto const path = entry_path(key);
+        if (not write_file_atomically(path, machine_code)) {
+            throw CacheError{ std::format("unable to write cache entry '{}'", path.string()) };
+        }
+    }
+
+    void Cache::trim() const {
+        struct Entry {
+            std::filesystem::path path;
+            u64 size;
+            std::filesystem::file_time_type last_used;
+        };
+
+        auto const now = std::filesystem::file_time_type::clock::now();
+        auto entries = std::vector<Entry>{};
+        auto total_size = u64{ 0 };
+        auto error = std::error_code{};
+        for (auto const& file : std::filesystem::directory_iterator{ m_directory }) {
+            auto const extension = file.path().extension();
+            auto const last_write_time = file.last_write_time(error);
+            if (error) {
+                continue; // removed by another process
+            }
+            if (extension == temporary_file_extension) {
+                if (now - last_write_time > stale_temporary_age) {
+                    std::filesystem::remove(file.path(), error);
+                }
+                continue;
+            }
+            if (extension != entry_extension) {
+                continue;
+            }
+            auto const size = file.file_size(error);
+            if (error) {
+                continue;
+            }
+            entries.push_back(Entry{ file.path(), size, last_write_time });
+            total_size += size;
+        }
+
+        if (total_size <= m_max_size) {
+            return;
+        }
+        std::sort(entries.begin(), entries.end(), [](Entry const& lhs, Entry const& rhs) {
+            return lhs.last_used < rhs.last_used;
+        });
+        for (auto const& entry : entries) {
+            if (total_size <= m_max_size) {
+                break;
+            }
+            std::filesystem::remove(entry.path, error);
+            total_size -= entry.size; // also if another process has evicted it first
+        }
+    }
+
+    [[nodiscard]] std::filesystem::path Cache::entry_path(CacheKey const& key) const {
+        auto result = m_directory / key.to_string();
+        result += entry_extension;
+        return result;
+    }
+} // namespace chissembler
@@ -1,135 +1,231 @@
 #include "chissembler.hpp"
 
+#include "debug_info.hpp"
+#include "diagnostic_sink.hpp"
 #include "emitter.hpp"
-#include "lexer.hpp"
-#include "source_location.hpp"
-
+#include "encoder.hpp"
+#include "included_binaries.hpp"
+#include "listing.hpp"
+#include "optimizer.hpp"
+#include "register_allocator.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <common/trace.hpp>
 #include <common/types.hpp>
-#include <iomanip>
-
+#include <format>
+#include <gsl/gsl>
+#include <istream>
+#include <string>
+#include <utility>
 
 namespace chissembler {
 
-    class State final : public EmitterState {
-    private:
-        std::vector<std::byte> m_machine_code;
-        u16 m_address = 0x200;
-        std::unordered_map<std::string, u16> m_labels;
-        std::vector<AddressPlaceholder> m_address_placeholders;
-
-    public:
-        [[nodiscard]] std::vector<std::byte> move_out_machine_code() && {
-            return std::move(m_machine_code);
+    static constexpr auto memory_size = usize{ 0x1000 };
+
+    [[nodiscard]] static std::vector<std::byte> assemble(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options,
+            DiagnosticSink& diagnostics
+    ) {
+        using Clock = std::chrono::steady_clock;
+        auto const start = Clock::now();
+        auto const file = SourceFile{ filename, source };
+        auto symbols = SymbolTable{};
+        auto binaries = IncludedBinaries{};
+        auto instructions = Emitter::emit(file, symbols, binaries, diagnostics);
+        if (not diagnostics.has_errors()) {
+            allocate_registers(file, symbols, instructions, diagnostics);
         }
-
-        [[nodiscard]] std::vector<std::byte>& machine_code() override {
-            return m_machine_code;
+        auto const parsed = Clock::now();
+        // runs after the register allocation, since it compares data registers
+        if (options.optimize and not diagnostics.has_errors()) {
+            optimize(file, symbols, instructions, options.optimization_report);
         }
-
-        [[nodiscard]] u16 address() const override {
-            return m_address;
+        auto const optimized = Clock::now();
+        if (diagnostics.has_errors()) {
+            // Virtual registers are left in place if the register allocation has been skipped or failed. Reporting
+            // them would only repeat the errors that prevented the allocation, but the labels are still checked.
+            std::erase_if(instructions, [](ir::Instruction const& instruction) {
+                return instruction.has_virtual_registers();
+            });
         }
-
-        void advance_adress() override {
-            m_address += 2;
+        auto machine_code = encode(file, instructions, symbols, binaries, diagnostics);
+        if (options.source_map != nullptr and program_start_address + machine_code.size() > memory_size) {
+            // the addresses of a source map only cover the memory
+            diagnostics.report(EmitterError{ Diagnostic{
+                    std::string{ filename },
+                    0,
+                    0,
+                    std::format(
+                            "no source map can be written, since the program of {} bytes doesn't fit into memory",
+                            machine_code.size()
+                    ),
+            } });
         }
-
-        [[nodiscard]] std::vector<AddressPlaceholder>& address_placeholders() override {
-            return m_address_placeholders;
+        if (options.statistics != nullptr) {
+            options.statistics->parse = parsed - start;
+            options.statistics->optimize = optimized - parsed;
+            options.statistics->encode = Clock::now() - optimized;
+            options.statistics->num_instructions = instructions.size();
+        }
+        if (diagnostics.has_errors()) {
+            return {};
         }
 
-        [[nodiscard]] std::unordered_map<std::string, u16>& labels() override {
-            return m_labels;
+        if (options.listing != nullptr) {
+            write_listing(*options.listing, file, instructions, machine_code);
         }
-    };
-
-    static void apply_address_placeholders(EmitterState& state) {
-        for (auto const& placeholder : state.address_placeholders()) {
-            auto const jump_target = visit(
-                    placeholder.target,
-                    [](u16 const addr) { return addr; },
-                    [](std::tuple<u16, V0Offset> const& address_with_offset) {
-                        return std::get<0>(address_with_offset);
-                    },
-                    [&](std::string const& label_name) {
-                        auto const find_iterator = state.labels().find(label_name);
-                        if (find_iterator == state.labels().cend()) {
-                            // todo: include source location in error message
-                            throw EmitterError{ std::format("unknown label '{}'", label_name) };
-                        }
-                        return find_iterator->second;
-                    },
-                    [&](std::tuple<std::string, V0Offset> const& label_name_with_offset) {
-                        auto const find_iterator = state.labels().find(std::get<0>(label_name_with_offset));
-                        if (find_iterator == state.labels().cend()) {
-                            // todo: include source location in error message
-                            throw EmitterError{
-                                std::format("unknown label '{}'", std::get<0>(label_name_with_offset))
-                            };
-                        }
-                        return find_iterator->second;
-                    }
-            );
-            assert((jump_target & 0xF000) == 0);
-            auto const msb = state.machine_code().at(placeholder.address - 0x200);
-            auto const lsb = state.machine_code().at(placeholder.address - 0x200 + 1);
-            state.machine_code().at(placeholder.address - 0x200) =
-                    static_cast<std::byte>(static_cast<int>(msb) | (jump_target >> 8));
-            state.machine_code().at(placeholder.address - 0x200 + 1) =
-                    static_cast<std::byte>(static_cast<int>(lsb) | (jump_target & 0xFF));
+        if (options.source_map != nullptr) {
+            *options.source_map = write_source_map(build_source_map(file, instructions, symbols));
         }
+        return machine_code;
     }
 
-    [[nodiscard]] std::vector<std::byte> assemble(std::string_view const filename, std::string_view const source) {
-        auto const tokens = Lexer::tokenize(filename, source);
-        auto const instructions = Emitter::emit(tokens);
-        auto state = State{};
+    [[nodiscard]] static ObjectFile assemble_object(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options,
+            DiagnosticSink& diagnostics
+    ) {
+        using Clock = std::chrono::steady_clock;
+        auto const start = Clock::now();
+        auto const file = SourceFile{ filename, source };
+        auto symbols = SymbolTable{};
+        auto binaries = IncludedBinaries{};
+        auto const instructions = Emitter::emit(file, symbols, binaries, diagnostics);
+        auto const parsed = Clock::now();
+        auto encoder = Encoder{ filename, symbols, binaries, diagnostics, instructions.size(), Linkage::Relocatable };
         for (auto const& instruction : instructions) {
-            instruction->append(state);
+            encoder.encode(file, instruction);
         }
-        std::cout << std::hex << std::uppercase;
-        std::cout << "Labels:\n";
-        for (auto&& [name, address] : state.labels()) {
-            std::cout << "    " << name << " @ 0x" << address << '\n';
+        auto result = ObjectFile{};
+        result.name = filename;
+        result.code = encoder.finish();
+        if (options.statistics != nullptr) {
+            options.statistics->parse = parsed - start;
+            options.statistics->encode = Clock::now() - parsed;
+            options.statistics->num_instructions = instructions.size();
         }
-        std::cout << "Placeholders:\n";
-        for (auto const& placeholder : state.address_placeholders()) {
-            std::cout << "    0x" << placeholder.address << " <- ";
-            visit(
-                    placeholder.target,
-                    [&](u16 const address) { std::cout << "0x" << address; },
-                    [&](std::tuple<u16, V0Offset> const& address_with_offset) {
-                        auto const& [address, register_] = address_with_offset;
-                        std::cout << "0x" << address << " + V0";
-                    },
-                    [&](std::string const& label_name) { std::cout << label_name; },
-                    [&](std::tuple<std::string, V0Offset> const& label_with_offset) {
-                        auto const& [label_name, register_] = label_with_offset;
-                        std::cout << label_name << " + V0";
-                    }
+        if (diagnostics.has_errors()) {
+            return {};
+        }
+
+        // apart from the constants, every interned name is either a label or refers to one
+        auto object_symbols = std::vector<u32>(symbols.size(), 0); // indexed by symbol
+        result.symbols.reserve(symbols.size());
+        for (Symbol symbol = 0; symbol < symbols.size(); ++symbol) {
+            if (symbols.constant(symbol).has_value()) {
+                continue;
+            }
+            object_symbols[symbol] = gsl::narrow<u32>(result.symbols.size());
+            result.symbols.push_back(
+                    ObjectSymbol{ std::string{ symbols.name(symbol) }, encoder.label_address(symbol) }
             );
-            std::cout << '\n';
         }
+        result.relocations.reserve(encoder.relocations().size());
+        for (auto const& relocation : encoder.relocations()) {
+            auto const code_offset = gsl::narrow<u32>(relocation.code_offset);
+            result.relocations.push_back(
+                    ObjectRelocation{ code_offset, object_symbols.at(relocation.symbol), relocation.addend }
+            );
+        }
+        return result;
+    }
+
+    static void sort_by_position(std::vector<Diagnostic>& diagnostics) {
+        // the encoder only reports label errors after the emitter is done with the whole source
+        std::stable_sort(diagnostics.begin(), diagnostics.end(), [](Diagnostic const& lhs, Diagnostic const& rhs) {
+            return std::pair{ lhs.line, lhs.column } < std::pair{ rhs.line, rhs.column };
+        });
+    }
 
-        apply_address_placeholders(state);
+    [[nodiscard]] std::vector<std::byte> assemble(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options
+    ) {
+        auto diagnostics = DiagnosticSink{};
+        return assemble(filename, source, options, diagnostics);
+    }
+
+    [[nodiscard]] AssembleResult try_assemble(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options
+    ) {
+        auto result = AssembleResult{};
+        auto diagnostics = DiagnosticSink{ &result.diagnostics };
+        result.machine_code = assemble(filename, source, options, diagnostics);
+        sort_by_position(result.diagnostics);
+        return result;
+    }
 
-        std::cout << "Binary:\n";
-        auto const previous_fill = std::cout.fill('0');
-        for (usize i = 0, address = 0x200; i < state.machine_code().size(); ++i, address += 2) {
-            if ((i / 2 % 8) == 0 and i % 2 == 0) {
-                std::cout << "    0x" << address << ": ";
+    [[nodiscard]] ObjectFile assemble_object(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options
+    ) {
+        auto diagnostics = DiagnosticSink{};
+        return assemble_object(filename, source, options, diagnostics);
+    }
+
+    [[nodiscard]] AssembleObjectResult try_assemble_object(
+            std::string_view const filename,
+            std::string_view const source,
+            AssembleOptions const& options
+    ) {
+        auto result = AssembleObjectResult{};
+        auto diagnostics = DiagnosticSink{ &result.diagnostics };
+        result.object = assemble_object(filename, source, options, diagnostics);
+        sort_by_position(result.diagnostics);
+        return result;
+    }
+
+    [[nodiscard]] std::vector<std::byte> assemble(std::string_view const filename, std::istream& source) {
+        TRACE_SCOPE("assemble stream");
+        static constexpr auto chunk_size = usize{ 64 } * 1024;
+
+        // the chunks are discarded after they have been assembled, so the symbol table has to keep its own names
+        auto symbols = SymbolTable{ 0, SymbolTable::NameStorage::Copied };
+        auto binaries = IncludedBinaries{};
+        auto diagnostics = DiagnosticSink{};
+        auto encoder = Encoder{ filename, symbols, binaries, diagnostics };
+        auto buffer = std::string{}; // the current chunk, starting with the incomplete line of the previous one
+        auto first_line = usize{ 1 };
+        auto is_at_end = false;
+        while (not is_at_end) {
+            auto const num_carried = buffer.size();
+            buffer.resize(num_carried + chunk_size);
+            source.read(buffer.data() + num_carried, static_cast<std::streamsize>(chunk_size));
+            buffer.resize(num_carried + gsl::narrow<usize>(source.gcount()));
+            if (source.bad()) {
+                throw LexerError{ Diagnostic{ std::string{ filename }, 0, 0, "unable to read source" } };
             }
-            std::cout << std::setw(2) << static_cast<int>(state.machine_code().at(i));
-            if ((i / 2 + 1) % 8 == 0 and not(i % 2) == 0) {
-                std::cout << '\n';
-                continue;
+            is_at_end = source.eof();
+
+            // statements never span lines, so every chunk of whole lines can be assembled on its own (the carried
+            // part doesn't contain any line breaks)
+            auto const last_line_break = std::string_view{ buffer }.substr(num_carried).rfind('\n');
+            auto const chunk_length = is_at_end                                       ? buffer.size()
+                                      : last_line_break == std::string_view::npos ? usize{ 0 }
+                                                                                    : num_carried + last_line_break + 1;
+            if (chunk_length == 0 and not is_at_end) {
+                continue; // the line doesn't fit into a single chunk
             }
-            if (i % 2 == 1) {
-                std::cout << ' ';
+
+            auto const file = SourceFile{ filename, std::string_view{ buffer }.substr(0, chunk_length), first_line };
+            auto emitter = Emitter{ file, symbols, binaries, diagnostics, Emitter::Scope::Chunk };
+            for (auto instruction = emitter.next(); instruction.has_value(); instruction = emitter.next()) {
+                encoder.encode(file, instruction.value());
             }
+            first_line += file.num_lines() - 1;
+            buffer.erase(0, chunk_length);
         }
-        std::cout << std::setfill(previous_fill);
-        return std::move(state).move_out_machine_code();
+        return encoder.finish();
     }
 
 } // namespace chissembler
@@ -0,0 +1,48 @@
+#include "debug_info.hpp"
+#include "encoder.hpp"
+#include <algorithm>
+#include <gsl/gsl>
+#include <string>
+
+[[nodiscard]] chissembler::SourceMap build_source_map(
+        SourceFile const& file,
+        std::span<ir::Instruction const> const instructions,
+        SymbolTable const& symbols
+) {
+    auto result = chissembler::SourceMap{};
+    result.files.emplace_back(file.filename());
+    auto const addresses = assign_addresses(instructions);
+    auto end_address = u32{ program_start_address };
+    for (usize i = 0; i < instructions.size(); ++i) {
+        auto const& instruction = instructions[i];
+        auto const address = gsl::narrow<u16>(addresses.at(i));
+        if (instruction.opcode == ir::Opcode::Label) {
+            // the size is only known once the following label has been reached
+            result.labels.push_back(
+                    chissembler::SourceMap::Label{ std::string{ symbols.name(instruction.target) }, address, 0 }
+            );
+            continue;
+        }
+        if (instruction.size() == 0) {
+            continue; // an empty included file
+        }
+        auto const [line, column] = file.line_and_column(instruction.source_offset);
+        result.ranges.push_back(chissembler::SourceMap::Range{
+                address,
+                gsl::narrow<u16>(instruction.size()),
+                0,
+                gsl::narrow<u32>(line),
+                gsl::narrow<u32>(column),
+        });
+        end_address = u32{ address } + gsl::narrow<u32>(instruction.size());
+    }
+
+    // labels at the same address all span the addresses up to the next label with a greater one
+    auto const by_address = [](chissembler::SourceMap::Label const& label) { return label.address; };
+    for (auto& label : result.labels) {
+        auto const next = std::ranges::upper_bound(result.labels, label.address, {}, by_address);
+        auto const next_address = (next == result.labels.end() ? end_address : u32{ next->address });
+        label.size = gsl::narrow<u16>(next_address - label.address);
+    }
+    return result;
+}
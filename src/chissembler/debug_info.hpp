@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ir.hpp"
+#include "source_file.hpp"
+#include "source_map.hpp"
+#include "symbol_table.hpp"
+#include <span>
+
+// the location of every instruction that emits code and the address range of every label of an absolute program
+[[nodiscard]] chissembler::SourceMap build_source_map(
+        SourceFile const& file,
+        std::span<ir::Instruction const> instructions,
+        SymbolTable const& symbols
+);
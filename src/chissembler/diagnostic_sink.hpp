@@ -0,0 +1,35 @@
+#pragma once
+
+#include "errors.hpp"
+#include <concepts>
+#include <vector>
+
+// Receives the errors found while assembling. Without a list to collect them in, every error is thrown right away,
+// otherwise the lexer, the emitter and the encoder recover and carry on.
+class DiagnosticSink final {
+private:
+    std::vector<chissembler::Diagnostic>* m_diagnostics;
+
+public:
+    explicit DiagnosticSink(std::vector<chissembler::Diagnostic>* const diagnostics = nullptr)
+        : m_diagnostics{ diagnostics } { }
+
+    [[nodiscard]] bool collects() const {
+        return m_diagnostics != nullptr;
+    }
+
+    [[nodiscard]] bool has_errors() const {
+        return m_diagnostics != nullptr and not m_diagnostics->empty();
+    }
+
+    [[nodiscard]] usize num_errors() const {
+        return m_diagnostics == nullptr ? 0 : m_diagnostics->size();
+    }
+
+    void report(std::derived_from<chissembler::AssemblerError> auto const& error) {
+        if (m_diagnostics == nullptr) {
+            throw error;
+        }
+        m_diagnostics->push_back(error.diagnostic());
+    }
+};
@@ -1,205 +1,773 @@
 #include "emitter.hpp"
 #include "../emulator/include/chip8/chip8.hpp"
-#include "common/utils.hpp"
+#include "encoder.hpp"
 #include "errors.hpp"
+#include "scanner.hpp"
 #include "utils.hpp"
 
-#include <sstream>
+#include <common/mapped_file.hpp>
+#include <common/trace.hpp>
+#include <filesystem>
+#include <format>
+#include <gsl/gsl>
+#include <limits>
+#include <string>
+#include <utility>
 
-[[nodiscard]] static u8 parse_u8(Token const& token) {
-    auto stream = std::stringstream{};
-    stream << token.lexeme();
-    auto result = u16{}; // cannot be u8, because the string stream would then interpret it as a char
-    stream >> result;
-    if (not stream or not stream.eof() or result > std::numeric_limits<u8>::max()) {
-        throw chissembler::EmitterError{
-            std::format("{}: '{}' is not a valid 8 bit value", token.source_location(), token.lexeme())
-        };
+// Intermediate results of constant expressions are limited to 32 bits, so that no operation overflows an i64.
+static constexpr auto max_magnitude = i64{ 0x7FFF'FFFF };
+static constexpr auto max_word = i64{ 0xFFFF };
+// what fits between the start of the program and the end of the memory
+static constexpr auto max_included_size = usize{ max_address } + 1 - program_start_address;
+
+// binding strength of the binary operators (as in C), 0 if the token isn't one
+[[nodiscard]] static usize precedence(TokenType const type) {
+    switch (type) {
+        case TokenType::Pipe:
+            return 1;
+        case TokenType::Ampersand:
+            return 2;
+        case TokenType::ShiftLeft:
+        case TokenType::ShiftRight:
+            return 3;
+        case TokenType::Plus:
+        case TokenType::Minus:
+            return 4;
+        case TokenType::Asterisk:
+        case TokenType::Slash:
+            return 5;
+        default:
+            return 0;
     }
-    return gsl::narrow<u8>(result);
 }
 
-[[nodiscard]] static DataRegister parse_data_register(Token const& token) {
-    assert(token.type() == TokenType::Register);
+[[nodiscard]] static DataRegister parse_data_register(SourceLocation const& token) {
     if (token.lexeme().length() != 2 or token.lexeme().front() != 'V'
         or not is_valid_register_char(token.lexeme().back())) {
         throw chissembler::EmitterError{
-            std::format("{}: '{}' does not name a valid data register", token.source_location(), token.lexeme())
+            token.diagnostic(std::format("'{}' does not name a valid data register", token.lexeme()))
         };
     }
     auto const value = token.lexeme().back();
-    return static_cast<DataRegister>(std::isdigit(static_cast<unsigned char>(value)) ? value - '0' : 10 + value - 'A');
+    return static_cast<DataRegister>(scanner::is_digit(value) ? value - '0' : 10 + value - 'A');
 }
 
-[[nodiscard]] std::vector<Instruction> Emitter::emit(std::span<Token const> const tokens) {
-    return Emitter{ tokens }.emit_implementation();
+[[nodiscard]] std::vector<ir::Instruction> Emitter::emit(
+        SourceFile const& file,
+        SymbolTable& symbols,
+        IncludedBinaries& binaries,
+        DiagnosticSink& diagnostics
+) {
+    TRACE_SCOPE("Emitter::emit");
+    // every instruction is terminated by a newline, so without macros and data directives this is an upper bound and
+    // the only allocation needed
+    auto instructions = std::vector<ir::Instruction>{};
+    instructions.reserve(file.num_lines());
+    auto emitter = Emitter{ file, symbols, binaries, diagnostics };
+    for (auto instruction = emitter.next(); instruction.has_value(); instruction = emitter.next()) {
+        instructions.push_back(instruction.value());
+    }
+    return instructions;
 }
 
-[[nodiscard]] std::vector<Instruction> Emitter::emit_implementation() {
-    auto instructions = std::vector<Instruction>{};
-    while (not is_at_end()) {
-        switch (current().type()) {
-            case TokenType::Copy: {
-                advance();
-                auto const source = read_target();
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Copy>(source, destination));
-                break;
+[[nodiscard]] Optional<ir::Instruction> Emitter::next() {
+    while (true) {
+        if (auto const replayed = m_expander.next_replayed(); replayed.has_value()) {
+            m_expander.record(replayed.value());
+            return replayed;
+        }
+        m_expander.finish_expansions();
+        if (is_at_end()) {
+            return none;
+        }
+        try {
+            auto const instruction =
+                    (m_data_directive.has_value() ? Optional<ir::Instruction>{ data_value() } : statement());
+            if (instruction.has_value()) {
+                m_expander.record(instruction.value());
+                return instruction;
             }
-            case TokenType::Add: {
-                advance();
-                auto const source = read_target();
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Add>(source, destination));
-                break;
+        } catch (chissembler::AssemblerError const& error) {
+            if (not m_diagnostics->collects()) {
+                throw;
             }
-            case TokenType::Sub: {
-                advance();
-                auto const source = read_target();
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Sub>(source, destination));
-                break;
+            m_diagnostics->report(error);
+            m_data_directive = none;
+            synchronize();
+        }
+    }
+}
+
+// panic mode: the rest of the erroneous statement is skipped, since every statement ends with a line break
+void Emitter::synchronize() {
+    while (not is_at_end() and advance().type() != TokenType::Newline) { }
+}
+
+[[nodiscard]] Optional<ir::Instruction> Emitter::statement() {
+    switch (current().type()) {
+        case TokenType::Copy:
+            return copy();
+        case TokenType::Add:
+            return arithmetic(ir::Opcode::AddImmediate, ir::Opcode::AddRegister);
+        case TokenType::Sub:
+            return arithmetic(ir::Opcode::SubImmediate, ir::Opcode::SubRegister);
+        case TokenType::And:
+            return bitwise(ir::Opcode::And);
+        case TokenType::Or:
+            return bitwise(ir::Opcode::Or);
+        case TokenType::Xor:
+            return bitwise(ir::Opcode::Xor);
+        case TokenType::Jump: {
+            auto result = make_instruction(ir::Opcode::Jump, advance());
+            auto const target = jump_target();
+            expect(TokenType::Newline);
+            result.opcode = target.with_offset ? ir::Opcode::JumpWithOffset : ir::Opcode::Jump;
+            result.target_is_symbol = target.is_symbol;
+            result.target = target.value;
+            result.set_target_addend(target.addend);
+            if (auto const distance = target.token_offset - result.source_offset; distance <= Token::max_length) {
+                result.target_offset = static_cast<u16>(distance);
             }
-            case TokenType::And: {
-                advance();
-                auto const source = write_target(); // immediates are not allowed as sources
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::And>(source, destination));
-                break;
+            return result;
+        }
+        case TokenType::Identifier: {
+            auto const label_token = advance();
+            if (current().type() == TokenType::LeftParenthesis) {
+                invocation(label_token);
+                return none;
             }
-            case TokenType::Or: {
-                advance();
-                auto const source = write_target(); // immediates are not allowed as sources
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Or>(source, destination));
-                break;
+            expect(TokenType::Colon);
+            auto result = make_instruction(ir::Opcode::Label, label_token);
+            result.target_is_symbol = true;
+            result.target = m_expander.label_symbol(label_token);
+            if (m_symbols->constant(result.target).has_value()) {
+                throw chissembler::EmitterError{ source_location(label_token).diagnostic(
+                        std::format("'{}' is already defined as a constant", lexeme(label_token))
+                ) };
             }
-            case TokenType::Xor: {
-                advance();
-                auto const source = write_target(); // immediates are not allowed as sources
-                auto const destination = write_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Xor>(source, destination));
-                break;
+            expect(TokenType::Newline);
+            return result;
+        }
+        case TokenType::Const:
+            constant_definition();
+            return none;
+        case TokenType::Macro:
+            macro_definition();
+            return none;
+        case TokenType::Db:
+        case TokenType::Dw:
+            m_data_directive = advance();
+            return data_value();
+        case TokenType::Incbin:
+            return include_binary();
+        default:
+            throw chissembler::EmitterError{ source_location(current()).diagnostic("unexpected token") };
+    }
+}
+
+// `const name = expression`, the name can be used in expressions of the following lines
+void Emitter::constant_definition() {
+    advance();
+    auto const name = expect(TokenType::Identifier);
+    expect(TokenType::Equals);
+    auto const definition = expression(Operands::Constants);
+    auto const symbol = m_symbols->intern(lexeme(name));
+    if (m_symbols->constant(symbol).has_value()) {
+        throw chissembler::EmitterError{
+            source_location(name).diagnostic(std::format("constant '{}' is already defined", lexeme(name)))
+        };
+    }
+    expect(TokenType::Newline);
+    m_symbols->define_constant(symbol, definition.value);
+}
+
+// `macro name(parameters...)`, followed by the lines of the body and `endmacro`
+void Emitter::macro_definition() {
+    auto const keyword = advance();
+    if (m_scope == Scope::Chunk) {
+        throw chissembler::EmitterError{ source_location(keyword).diagnostic(
+                "macros can only be defined when assembling a whole program from memory"
+        ) };
+    }
+    auto const name = expect(TokenType::Identifier);
+    expect(TokenType::LeftParenthesis);
+    auto parameters = std::vector<Token>{};
+    if (not try_consume(TokenType::RightParenthesis).has_value()) {
+        do {
+            parameters.push_back(expect(TokenType::Identifier));
+        } while (try_consume(TokenType::Comma).has_value());
+        expect(TokenType::RightParenthesis);
+    }
+    expect(TokenType::Newline);
+
+    auto body = std::vector<Token>{};
+    auto is_line_start = true;
+    while (not is_line_start or current().type() != TokenType::Endmacro) {
+        if (is_at_end()) {
+            throw chissembler::EmitterError{
+                source_location(keyword).diagnostic(std::format("macro '{}' is missing 'endmacro'", lexeme(name)))
+            };
+        }
+        if (current().type() == TokenType::Macro) {
+            throw chissembler::EmitterError{
+                source_location(current()).diagnostic("macros can't be defined within macros")
+            };
+        }
+        is_line_start = (current().type() == TokenType::Newline);
+        body.push_back(advance());
+    }
+    advance();
+
+    // checked after the body has been read, so that it isn't mistaken for statements
+    if (m_expander.num_parameters(lexeme(name)).has_value()) {
+        throw chissembler::EmitterError{
+            source_location(name).diagnostic(std::format("macro '{}' is already defined", lexeme(name)))
+        };
+    }
+    for (usize i = 1; i < parameters.size(); ++i) {
+        for (usize j = 0; j < i; ++j) {
+            if (lexeme(parameters[i]) == lexeme(parameters[j])) {
+                throw chissembler::EmitterError{ source_location(parameters[i]).diagnostic(
+                        std::format("parameter '{}' is already defined", lexeme(parameters[i]))
+                ) };
             }
-            case TokenType::Jump: {
-                advance();
-                auto target = jump_target();
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Jump>(std::move(target)));
-                break;
+        }
+    }
+    m_expander.define(lexeme(name), parameters, body);
+    expect(TokenType::Newline);
+}
+
+// `name(arguments...)`, the arguments are separated by the commas that aren't enclosed in parentheses
+void Emitter::invocation(Token const name) {
+    auto const num_parameters = m_expander.num_parameters(lexeme(name));
+    if (not num_parameters.has_value()) {
+        throw chissembler::EmitterError{
+            source_location(name).diagnostic(std::format("'{}' does not name a macro", lexeme(name)))
+        };
+    }
+    expect(TokenType::LeftParenthesis);
+    m_argument_tokens.clear();
+    m_argument_ends.clear();
+    if (not try_consume(TokenType::RightParenthesis).has_value()) {
+        auto depth = usize{ 0 };
+        while (true) {
+            auto const type = current().type();
+            if (type == TokenType::Newline or is_at_end()) {
+                throw_unexpected_token({ TokenType::Comma, TokenType::RightParenthesis });
             }
-            case TokenType::Identifier: {
-                auto const label_token = advance();
-                expect(TokenType::Colon);
-                expect(TokenType::Newline);
-                instructions.push_back(std::make_unique<instruction::Label>(label_token));
-                break;
+            if (depth == 0 and (type == TokenType::Comma or type == TokenType::RightParenthesis)) {
+                auto const begin = (m_argument_ends.empty() ? usize{ 0 } : m_argument_ends.back());
+                if (m_argument_tokens.size() == begin) {
+                    throw chissembler::EmitterError{ source_location(current()).diagnostic("missing macro argument") };
+                }
+                m_argument_ends.push_back(m_argument_tokens.size());
+                if (advance().type() == TokenType::RightParenthesis) {
+                    break;
+                }
+                continue;
             }
-            default:
-                throw chissembler::EmitterError{ std::format("{}: unexpected token", current().source_location()) };
-                break;
+            if (type == TokenType::LeftParenthesis) {
+                ++depth;
+            } else if (type == TokenType::RightParenthesis) {
+                --depth;
+            }
+            m_argument_tokens.push_back(advance());
         }
     }
-    return instructions;
+    if (m_argument_ends.size() != num_parameters.value()) {
+        throw chissembler::EmitterError{ source_location(name).diagnostic(std::format(
+                "wrong number of arguments for macro '{}' (expected {}, got {})",
+                lexeme(name),
+                num_parameters.value(),
+                m_argument_ends.size()
+        )) };
+    }
+    if (m_expander.is_expanding(lexeme(name))) {
+        throw chissembler::EmitterError{ source_location(name).diagnostic(
+                std::format("macro '{}' can't be expanded within its own expansion", lexeme(name))
+        ) };
+    }
+    expect(TokenType::Newline);
+    m_current = m_expander.expand(name, m_argument_tokens, m_argument_ends, m_current);
 }
 
-[[nodiscard]] bool Emitter::is_at_end() const {
-    return m_index >= m_tokens.size() or m_tokens[m_index].type() == TokenType::EndOfInput;
+[[nodiscard]] ir::Instruction Emitter::make_instruction(ir::Opcode const opcode, Token const first_token) {
+    return ir::Instruction{
+        .opcode = opcode,
+        .source_offset = static_cast<u32>(first_token.offset()),
+        .source_length = static_cast<u16>(first_token.length()),
+    };
 }
 
-[[nodiscard]] Token const& Emitter::current() const {
-    return is_at_end() ? m_tokens.back() : m_tokens[m_index];
+// `copy source destination`, the destination may also be `I`, which is set to an address (that may refer to a label)
+[[nodiscard]] ir::Instruction Emitter::copy() {
+    auto const mnemonic = advance();
+    if (not starts_expression()) {
+        auto const source = read_target();
+        auto const destination = write_target();
+        expect(TokenType::Newline);
+        return operation(mnemonic, ir::Opcode::CopyRegister, source, destination);
+    }
+    auto const value = expression(Operands::Labels);
+    if (current().type() != TokenType::AddressRegister) {
+        auto const source = immediate(value);
+        auto const destination = write_target();
+        expect(TokenType::Newline);
+        return operation(mnemonic, ir::Opcode::CopyImmediate, source, destination);
+    }
+    advance();
+    auto const target = address(value, max_address, "a valid address");
+    expect(TokenType::Newline);
+    auto result = make_instruction(ir::Opcode::SetAddressRegister, mnemonic);
+    result.target_is_symbol = target.is_symbol;
+    result.target = target.value;
+    result.set_target_addend(target.addend);
+    if (auto const distance = target.token_offset - result.source_offset; distance <= Token::max_length) {
+        result.target_offset = static_cast<u16>(distance);
+    }
+    return result;
+}
+
+[[nodiscard]] ir::Instruction Emitter::arithmetic(ir::Opcode const immediate_opcode, ir::Opcode const register_opcode) {
+    auto const mnemonic = advance();
+    auto const source = read_target();
+    auto const destination = write_target();
+    expect(TokenType::Newline);
+    return operation(mnemonic, source.is_immediate ? immediate_opcode : register_opcode, source, destination);
+}
+
+[[nodiscard]] ir::Instruction Emitter::bitwise(ir::Opcode const opcode) {
+    auto const mnemonic = advance();
+    auto const source = write_target(); // immediates are not allowed as sources
+    auto const destination = write_target();
+    expect(TokenType::Newline);
+    return operation(mnemonic, opcode, source, destination);
+}
+
+[[nodiscard]] ir::Instruction Emitter::operation(
+        Token const mnemonic,
+        ir::Opcode const opcode,
+        Operand const& source,
+        Operand const& destination
+) {
+    auto result = make_instruction(opcode, mnemonic);
+    result.destination = static_cast<DataRegister>(destination.value);
+    result.source = source.value;
+    result.set_virtual_registers(destination.virtual_register, source.virtual_register);
+    return result;
+}
+
+// one value of `db` or `dw` per call, the directive stays open as long as its values are separated by commas
+[[nodiscard]] ir::Instruction Emitter::data_value() {
+    auto const directive = m_data_directive.value();
+    if (not starts_expression()) {
+        throw chissembler::EmitterError{ source_location(current()).diagnostic(
+                std::format("token of type '{}' is not a valid data value", token_type_name(current().type()))
+        ) };
+    }
+    auto result = make_instruction(ir::Opcode::Byte, directive);
+    if (directive.type() == TokenType::Db) {
+        result.source = immediate(expression(Operands::Constants)).value;
+    } else {
+        auto const word = address(expression(Operands::Labels), max_word, "a valid 16 bit value");
+        result.opcode = ir::Opcode::Word;
+        result.target_is_symbol = word.is_symbol;
+        result.target = word.value;
+        result.set_target_addend(word.addend);
+        if (auto const distance = word.token_offset - result.source_offset; distance <= Token::max_length) {
+            result.target_offset = static_cast<u16>(distance);
+        }
+    }
+    if (try_consume(TokenType::Comma).has_value()) {
+        return result;
+    }
+    m_data_directive = none;
+    expect(TokenType::Newline);
+    return result;
+}
+
+// `incbin "path"` or `incbin "path", offset, length`, relative paths start at the directory of the source file
+[[nodiscard]] ir::Instruction Emitter::include_binary() {
+    auto const directive = advance();
+    auto const path_token = expect(TokenType::StringLiteral);
+    auto offset = Optional<Expression>{};
+    auto length = Optional<Expression>{};
+    if (try_consume(TokenType::Comma).has_value()) {
+        offset = expression(Operands::Constants);
+        expect(TokenType::Comma);
+        length = expression(Operands::Constants);
+    }
+
+    auto const quoted_path = lexeme(path_token);
+    auto const path = std::filesystem::path{ m_file->filename() }.parent_path()
+                      / std::filesystem::path{ quoted_path.substr(1, quoted_path.length() - 2) };
+    auto file = [&] {
+        try {
+            return MappedFile{ path };
+        } catch (MappedFileError const& error) {
+            throw chissembler::EmitterError{ source_location(path_token).diagnostic(error.what()) };
+        }
+    }();
+    auto const size = file.size();
+    auto const error = [&](Expression const& expression, std::string message) {
+        return chissembler::EmitterError{
+            SourceLocation{ *m_file, expression.offset, expression.length }.diagnostic(std::move(message))
+        };
+    };
+    if (offset.has_value() and (offset->value < 0 or static_cast<usize>(offset->value) > size)) {
+        throw error(
+                offset.value(),
+                std::format("offset {} is outside of {} ({} bytes)", offset->value, quoted_path, size)
+        );
+    }
+    auto const first = (offset.has_value() ? static_cast<usize>(offset->value) : usize{ 0 });
+    if (length.has_value() and (length->value < 0 or static_cast<usize>(length->value) > size - first)) {
+        throw error(
+                length.value(),
+                std::format(
+                        "length {} exceeds the {} bytes of {} behind offset {}",
+                        length->value,
+                        size - first,
+                        quoted_path,
+                        first
+                )
+        );
+    }
+    auto const count = (length.has_value() ? static_cast<usize>(length->value) : size - first);
+    if (count > max_included_size) {
+        throw chissembler::EmitterError{ source_location(path_token).diagnostic(
+                std::format("{} bytes of {} don't fit into the memory", count, quoted_path)
+        ) };
+    }
+    if (m_binaries->size() > std::numeric_limits<u16>::max()) {
+        throw chissembler::EmitterError{ source_location(directive).diagnostic("too many included files") };
+    }
+    expect(TokenType::Newline);
+
+    auto result = make_instruction(ir::Opcode::IncludeBinary, directive);
+    result.target = static_cast<u32>(count);
+    result.set_binary_index(static_cast<u16>(m_binaries->add(std::move(file), first, count)));
+    return result;
 }
 
-[[nodiscard]] Token const& Emitter::peek(usize const offset) const {
-    return (m_index + offset >= m_tokens.size() ? m_tokens.back() : m_tokens[m_index + offset]);
+[[nodiscard]] bool Emitter::is_at_end() const {
+    return m_current.type() == TokenType::EndOfInput;
 }
 
-Token const& Emitter::advance() {
-    auto const& result = current();
+[[nodiscard]] Token const& Emitter::current() const {
+    return m_current;
+}
+
+Token Emitter::advance() {
+    auto const result = m_current;
     if (not is_at_end()) {
-        ++m_index;
+        m_previous_end = m_current.offset() + m_current.length();
+        m_current = m_expander.next();
+        m_current_follows_previous =
+                (scanner::skip<scanner::Run::Whitespace>(m_file->source(), m_previous_end) == m_current.offset());
+        if (not m_current_follows_previous) {
+            ++m_num_gaps;
+        }
     }
     return result;
 }
 
-[[nodiscard]] Optional<Token const&> Emitter::try_consume(TokenType const type) {
+[[nodiscard]] Optional<Token> Emitter::try_consume(TokenType const type) {
     if (current().type() != type) {
         return none;
     }
     return advance();
 }
 
-[[nodiscard]] Target Emitter::read_target() {
-    if (current().type() == TokenType::IntegerLiteral) {
-        auto const result = U8Immediate{ parse_u8(current()) };
-        advance();
-        return result;
+[[noreturn]] void Emitter::throw_unexpected_token(std::initializer_list<TokenType> const expected_types) const {
+    auto allowed_tokens = std::string{};
+    for (auto const type : expected_types) {
+        if (not allowed_tokens.empty()) {
+            allowed_tokens += ", ";
+        }
+        allowed_tokens += token_type_name(type);
     }
-    if (current().type() == TokenType::Register) {
-        auto const result = parse_data_register(current());
-        advance();
-        return result;
+    throw chissembler::EmitterError{ source_location(current()).diagnostic(std::format(
+            "expected token type '{}', got '{}' instead",
+            allowed_tokens,
+            token_type_name(current().type())
+    )) };
+}
+
+[[nodiscard]] Emitter::Operand Emitter::read_target() {
+    if (current().type() == TokenType::Register or current().type() == TokenType::VirtualRegister) {
+        return write_target();
+    }
+    if (starts_expression()) {
+        return immediate(expression(Operands::Constants));
     }
     throw chissembler::EmitterError{
-        std::format("{}: '{}' is not a valid target for reading", current().source_location(), current().lexeme())
+        source_location(current()).diagnostic(std::format("'{}' is not a valid target for reading", lexeme(current())))
     };
 }
 
-[[nodiscard]] Target Emitter::write_target() {
+// labels are only allowed in the expression so that `copy` can decide on them once it knows its destination
+[[nodiscard]] Emitter::Operand Emitter::immediate(Expression const& value) const {
+    if (value.label.has_value()) {
+        auto const label = SourceLocation{ *m_file, value.label_offset, value.label_length };
+        throw chissembler::EmitterError{
+            label.diagnostic(std::format("'{}' does not name a constant", label.lexeme()))
+        };
+    }
+    if (value.value < 0 or value.value > std::numeric_limits<u8>::max()) {
+        auto const location = SourceLocation{ *m_file, value.offset, value.length };
+        throw chissembler::EmitterError{ location.diagnostic(invalid_value_message(value, "a valid 8 bit value")) };
+    }
+    return Operand{ true, static_cast<u8>(value.value), none };
+}
+
+[[nodiscard]] Emitter::Operand Emitter::write_target() {
     if (current().type() == TokenType::Register) {
-        auto const result = parse_data_register(current());
+        auto const result = Operand{ false, std::to_underlying(parse_data_register(source_location(current()))), none };
         advance();
         return result;
     }
+    if (current().type() == TokenType::VirtualRegister) {
+        return Operand{ false, 0, virtual_register() };
+    }
     throw chissembler::EmitterError{
-        std::format("{}: '{}' is not a valid target for writing", current().source_location(), current().lexeme())
+        source_location(current()).diagnostic(std::format("'{}' is not a valid target for writing", lexeme(current())))
     };
 }
 
-[[nodiscard]] JumpTarget Emitter::jump_target() {
-    auto const try_parse_offset = [&]() -> bool {
-        if (not try_consume(TokenType::Plus).has_value()) {
-            return false;
-        }
-        auto const& register_token = current();
-        auto const data_register = parse_data_register(expect(TokenType::Register));
-        if (data_register != DataRegister::V0) {
-            throw chissembler::EmitterError{
-                std::format("{}: only 'V0' is allowed as jump offset", register_token.source_location())
-            };
-        }
-        return true;
-    };
+// virtual registers share the symbol table with the labels, their names include the '%'
+[[nodiscard]] Symbol Emitter::virtual_register() {
+    auto const token = advance();
+    auto const symbol = m_symbols->intern(lexeme(token));
+    if (symbol > ir::max_virtual_register_symbol) {
+        throw chissembler::EmitterError{ source_location(token).diagnostic("too many names for a virtual register") };
+    }
+    return symbol;
+}
 
-    if (current().type() == TokenType::IntegerLiteral) {
-        auto const address = to_int<u16>(current().lexeme());
-        if (not address.has_value() or (address.value() & 0xF000) != 0) {
-            throw chissembler::EmitterError{ std::format("'{}' is not a valid address", current().lexeme()) };
-        }
-        advance();
-        if (not try_parse_offset()) {
-            return address.value();
+// `label`, `address` or any constant expression involving them, optionally followed by `+ V0`
+[[nodiscard]] Emitter::JumpTarget Emitter::jump_target() {
+    if (not starts_expression()) {
+        throw chissembler::EmitterError{ source_location(current()).diagnostic(
+                std::format("token of type '{}' is not a valid jump target", token_type_name(current().type()))
+        ) };
+    }
+    return address(expression(Operands::JumpTargets), max_address, "a valid address");
+}
+
+// `label + constant` (which is checked by the encoder) or a constant up to `max_value`
+[[nodiscard]] Emitter::JumpTarget Emitter::address(
+        Expression const& target,
+        i64 const max_value,
+        std::string_view const description
+) const {
+    auto const location = SourceLocation{ *m_file, target.offset, target.length };
+    if (target.label.has_value()) {
+        if (auto const max_offset = i64{ max_address }; target.value < -max_offset or target.value > max_offset) {
+            throw chissembler::EmitterError{ location.diagnostic(
+                    std::format("offset {} of '{}' is out of range", target.value, location.lexeme())
+            ) };
         }
-        return std::tuple{ address.value(), V0Offset{} };
+        auto const addend = static_cast<i16>(target.value);
+        return JumpTarget{ true, target.label.value(), addend, target.adds_v0, target.label_offset };
     }
+    if (target.value < 0 or target.value > max_value) {
+        throw chissembler::EmitterError{ location.diagnostic(invalid_value_message(target, description)) };
+    }
+    return JumpTarget{ false, static_cast<u32>(target.value), 0, target.adds_v0, target.offset };
+}
 
-    if (current().type() == TokenType::Identifier) {
-        auto label_name = std::string{ current().lexeme() };
-        advance();
-        if (not try_parse_offset()) {
-            return std::move(label_name);
+[[nodiscard]] bool Emitter::starts_expression() const {
+    switch (current().type()) {
+        case TokenType::IntegerLiteral:
+        case TokenType::Identifier:
+        case TokenType::Minus:
+        case TokenType::LeftParenthesis:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// precedence climbing: folds all binary operators that bind at least as strong as `min_precedence`
+[[nodiscard]] Emitter::Expression Emitter::expression(
+        Operands const operands,
+        usize const depth,
+        usize const min_precedence
+) {
+    auto const first_token = current();
+    auto const num_gaps = m_num_gaps;
+    auto result = operand(operands, depth);
+    for (auto operator_precedence = precedence(current().type()); operator_precedence >= min_precedence;
+         operator_precedence = precedence(current().type())) {
+        auto const operator_token = advance();
+        auto const rhs = expression(operands, depth, operator_precedence + 1);
+        result = fold(operator_token, result, rhs);
+    }
+    set_source_text(result, first_token, num_gaps);
+    return result;
+}
+
+[[nodiscard]] Emitter::Expression Emitter::operand(Operands const operands, usize const depth) {
+    static constexpr auto max_depth = usize{ 64 };
+    auto const start = current().offset();
+    auto const token = current();
+    auto const num_gaps = m_num_gaps;
+    switch (token.type()) {
+        case TokenType::IntegerLiteral: {
+            advance();
+            auto const value = parse_integer_literal<u32>(lexeme(token));
+            if (not value.has_value() or value.value() > max_magnitude) {
+                throw chissembler::EmitterError{ source_location(token).diagnostic(
+                        std::format("'{}' is not a valid integer literal", lexeme(token))
+                ) };
+            }
+            return Expression{ value.value(), none, 0, 0, false, start, token.length() };
+        }
+        case TokenType::Identifier: {
+            advance();
+            auto const symbol = m_symbols->find(lexeme(token));
+            if (auto const value = symbol.and_then([&](Symbol const found) { return m_symbols->constant(found); });
+                value.has_value()) {
+                return Expression{ value.value(), none, 0, 0, false, start, token.length() };
+            }
+            if (operands == Operands::Constants) {
+                throw chissembler::EmitterError{
+                    source_location(token).diagnostic(std::format("'{}' does not name a constant", lexeme(token)))
+                };
+            }
+            auto const label = m_expander.label_symbol(token);
+            return Expression{ 0, label, token.offset(), token.length(), false, start, token.length() };
         }
-        return std::tuple{ std::move(label_name), V0Offset{} };
+        case TokenType::Register:
+            if (operands != Operands::JumpTargets) {
+                break;
+            }
+            advance();
+            if (parse_data_register(source_location(token)) != DataRegister::V0) {
+                throw chissembler::EmitterError{
+                    source_location(token).diagnostic("only 'V0' is allowed as jump offset")
+                };
+            }
+            return Expression{ 0, none, 0, 0, true, start, token.length() };
+        case TokenType::Minus:
+        case TokenType::LeftParenthesis: {
+            if (depth == max_depth) {
+                throw chissembler::EmitterError{ source_location(token).diagnostic("expression is nested too deeply") };
+            }
+            advance();
+            auto result = (token.type() == TokenType::Minus ? operand(operands, depth + 1)
+                                                            : expression(operands, depth + 1));
+            if (token.type() == TokenType::LeftParenthesis) {
+                expect(TokenType::RightParenthesis);
+            } else if (result.label.has_value() or result.adds_v0) {
+                throw chissembler::EmitterError{
+                    source_location(token).diagnostic("labels and 'V0' can't be negated")
+                };
+            } else {
+                result.value = -result.value;
+            }
+            set_source_text(result, token, num_gaps);
+            return result;
+        }
+        default:
+            break;
     }
+    throw chissembler::EmitterError{ source_location(token).diagnostic(
+            std::format("token of type '{}' is not a valid operand", token_type_name(token.type()))
+    ) };
+}
 
-    throw chissembler::EmitterError{
-        std::format("token of type '{}' is not a valid jump target", magic_enum::enum_name(current().type()))
+// Labels and V0 are only allowed as summands, so that a jump target is always `label + constant (+ V0)`.
+[[nodiscard]] Emitter::Expression Emitter::fold(
+        Token const operator_token,
+        Expression lhs,
+        Expression const& rhs
+) const {
+    auto const error = [&](std::string message) {
+        return chissembler::EmitterError{ source_location(operator_token).diagnostic(std::move(message)) };
     };
+    auto const is_constant = [](Expression const& expression) {
+        return not expression.label.has_value() and not expression.adds_v0;
+    };
+
+    switch (operator_token.type()) {
+        case TokenType::Plus:
+            if (lhs.label.has_value() and rhs.label.has_value()) {
+                throw error("a jump target can only refer to one label");
+            }
+            if (lhs.adds_v0 and rhs.adds_v0) {
+                throw error("'V0' can only be added once");
+            }
+            if (rhs.label.has_value()) {
+                lhs.label = rhs.label;
+                lhs.label_offset = rhs.label_offset;
+                lhs.label_length = rhs.label_length;
+            }
+            lhs.adds_v0 = lhs.adds_v0 or rhs.adds_v0;
+            lhs.value += rhs.value;
+            break;
+        case TokenType::Minus:
+            if (not is_constant(rhs)) {
+                throw error("labels and 'V0' can't be subtracted");
+            }
+            lhs.value -= rhs.value;
+            break;
+        default:
+            if (not is_constant(lhs) or not is_constant(rhs)) {
+                throw error(std::format("'{}' can't be applied to labels or 'V0'", lexeme(operator_token)));
+            }
+            switch (operator_token.type()) {
+                case TokenType::Asterisk:
+                    lhs.value *= rhs.value;
+                    break;
+                case TokenType::Slash:
+                    if (rhs.value == 0) {
+                        throw error("division by zero");
+                    }
+                    lhs.value /= rhs.value;
+                    break;
+                case TokenType::ShiftLeft:
+                case TokenType::ShiftRight:
+                    if (rhs.value < 0 or rhs.value > 31) {
+                        throw error(std::format("shift by {} is out of range", rhs.value));
+                    }
+                    lhs.value = (operator_token.type() == TokenType::ShiftLeft ? lhs.value << rhs.value
+                                                                               : lhs.value >> rhs.value);
+                    break;
+                case TokenType::Ampersand:
+                    lhs.value &= rhs.value;
+                    break;
+                default:
+                    lhs.value |= rhs.value;
+                    break;
+            }
+            break;
+    }
+    if (lhs.value < -max_magnitude or lhs.value > max_magnitude) {
+        throw error("result of the constant expression doesn't fit into 32 bits");
+    }
+    return lhs;
+}
+
+// Quotes the source text from `first_token` to the last token that has been read. If there are gaps between these
+// tokens (within a macro expansion), only `first_token` is quoted, since the text in between is unrelated.
+void Emitter::set_source_text(Expression& expression, Token const first_token, usize const num_gaps_before) const {
+    // the token after the expression has already been read, its own gap doesn't matter
+    auto const num_gaps = m_num_gaps - (m_current_follows_previous ? 0 : 1);
+    expression.offset = first_token.offset();
+    expression.length = (num_gaps == num_gaps_before ? m_previous_end - first_token.offset() : first_token.length());
+}
+
+// quotes single literals as they are, other expressions along with their value
+[[nodiscard]] std::string Emitter::invalid_value_message(
+        Expression const& expression,
+        std::string_view const what
+) const {
+    auto const text = m_file->text(expression.offset, expression.length);
+    if (auto const literal = parse_integer_literal<u32>(text);
+        literal.has_value() and i64{ literal.value() } == expression.value) {
+        return std::format("'{}' is not {}", text, what);
+    }
+    return std::format("'{}' evaluates to {}, which is not {}", text, expression.value, what);
 }
@@ -1,59 +1,159 @@
 #pragma once
 
+#include "diagnostic_sink.hpp"
 #include "errors.hpp"
-#include "instruction.hpp"
+#include "included_binaries.hpp"
+#include "ir.hpp"
+#include "keywords.hpp"
+#include "macro_expander.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
 #include "token.hpp"
-#include <magic_enum.hpp>
-#include <span>
+#include <initializer_list>
+#include <string>
+#include <string_view>
 #include <vector>
 
 class Emitter final {
+public:
+    // macros need the whole source, the streaming assembler passes the source chunk by chunk
+    enum class Scope {
+        WholeSource,
+        Chunk,
+    };
+
 private:
-    std::span<Token const> m_tokens;
-    usize m_index = 0;
+    struct Operand {
+        bool is_immediate;
+        u8 value;                          // immediate or register index
+        Optional<Symbol> virtual_register; // the register index is meaningless if set
+    };
+
+    // what an expression may refer to apart from constants
+    enum class Operands {
+        Constants,
+        Labels,      // a label plus a constant, e.g. for `copy label I`
+        JumpTargets, // a label plus a constant plus V0
+    };
+
+    // the target of a jump, but also any other address that may refer to a label
+    struct JumpTarget {
+        bool is_symbol;
+        u32 value;  // symbol or address
+        i16 addend; // added to the address of the symbol
+        bool with_offset;
+        usize token_offset;
+    };
 
-    explicit Emitter(std::span<Token const> const tokens) : m_tokens{ tokens } { }
+    // a constant expression folded at assembly time, jump targets may also refer to a label and add V0
+    struct Expression {
+        i64 value;
+        Optional<Symbol> label;
+        usize label_offset; // of the label's token
+        usize label_length;
+        bool adds_v0;
+        usize offset; // source text of the whole expression
+        usize length;
+    };
+
+    SourceFile const* m_file;
+    DiagnosticSink* m_diagnostics;
+    MacroExpander m_expander;
+    Token m_current; // the only token that is held at any time
+    // end of the token before `m_current`, so that diagnostics can quote whole expressions
+    usize m_previous_end = 0;
+    // Tokens of macro expansions come from both the body and the arguments, so consecutive tokens may lie anywhere in
+    // the source. Counts the tokens read so far that don't directly follow their predecessor.
+    usize m_num_gaps = 0;
+    bool m_current_follows_previous = true;
+    SymbolTable* m_symbols;
+    IncludedBinaries* m_binaries;
+    Scope m_scope;
+    Optional<Token> m_data_directive; // `db` or `dw` while its values are emitted one by one
+    std::vector<Token> m_argument_tokens; // of the current macro invocation, reused to avoid allocations
+    std::vector<usize> m_argument_ends;
 
 public:
-    [[nodiscard]] static std::vector<Instruction> emit(std::span<Token const> tokens);
+    // identifiers are interned into `symbols` and included files are added to `binaries`, the source file must
+    // outlive the emitter
+    Emitter(
+            SourceFile const& file,
+            SymbolTable& symbols,
+            IncludedBinaries& binaries,
+            DiagnosticSink& diagnostics,
+            Scope const scope = Scope::WholeSource
+    )
+        : m_file{ &file },
+          m_diagnostics{ &diagnostics },
+          m_expander{ file, symbols, diagnostics },
+          m_current{ m_expander.next() },
+          m_symbols{ &symbols },
+          m_binaries{ &binaries },
+          m_scope{ scope } { }
+
+    // parses the next statement, pulling tokens from the macro expander as needed; returns `none` at the end of the
+    // source (erroneous statements are reported and skipped if the diagnostics are collected)
+    [[nodiscard]] Optional<ir::Instruction> next();
+
+    [[nodiscard]] static std::vector<ir::Instruction> emit(
+            SourceFile const& file,
+            SymbolTable& symbols,
+            IncludedBinaries& binaries,
+            DiagnosticSink& diagnostics
+    );
 
 private:
-    [[nodiscard]] std::vector<Instruction> emit_implementation();
+    [[nodiscard]] Optional<ir::Instruction> statement();
+    void constant_definition();
+    void macro_definition();
+    void invocation(Token name);
+    void synchronize();
+    [[nodiscard]] static ir::Instruction make_instruction(ir::Opcode opcode, Token first_token);
+    [[nodiscard]] ir::Instruction copy();
+    [[nodiscard]] ir::Instruction arithmetic(ir::Opcode immediate_opcode, ir::Opcode register_opcode);
+    [[nodiscard]] ir::Instruction bitwise(ir::Opcode opcode);
+    [[nodiscard]] static ir::Instruction operation(
+            Token mnemonic,
+            ir::Opcode opcode,
+            Operand const& source,
+            Operand const& destination
+    );
+    [[nodiscard]] ir::Instruction data_value();
+    [[nodiscard]] ir::Instruction include_binary();
     [[nodiscard]] bool is_at_end() const;
     [[nodiscard]] Token const& current() const;
-    [[nodiscard]] Token const& peek(usize offset = 1) const;
-    Token const& advance();
-    [[nodiscard]] Optional<Token const&> try_consume(TokenType type);
+    Token advance();
+    [[nodiscard]] Optional<Token> try_consume(TokenType type);
 
-    Token const& expect(std::convertible_to<TokenType> auto... token_types) {
-        static_assert(sizeof...(token_types) > 0);
+    [[nodiscard]] std::string_view lexeme(Token const token) const {
+        return token.lexeme(*m_file);
+    }
+
+    [[nodiscard]] SourceLocation source_location(Token const token) const {
+        return token.source_location(*m_file);
+    }
 
-        auto result = static_cast<Token const*>(nullptr);
-        auto const token_found = ([&] {
-            if (current().type() == token_types) {
-                result = &advance();
-                return true;
-            }
-            return false;
-        }() || ...);
-
-        auto allowed_tokens = std::string{};
-        ([&] { allowed_tokens = std::format("{}{}, ", allowed_tokens, magic_enum::enum_name(token_types)); }(), ...);
-        allowed_tokens.pop_back();
-        allowed_tokens.pop_back();
-
-        if (token_found) {
-            return *result;
+    Token expect(std::convertible_to<TokenType> auto... token_types) {
+        static_assert(sizeof...(token_types) > 0);
+        if (((current().type() == token_types) or ...)) {
+            return advance();
         }
-        throw chissembler::EmitterError{ std::format(
-                "{}: expected token type '{}', got '{}' instead",
-                current().source_location(),
-                allowed_tokens,
-                magic_enum::enum_name(current().type())
-        ) };
+        throw_unexpected_token({ TokenType{ token_types }... });
     }
 
-    [[nodiscard]] Target read_target();
-    [[nodiscard]] Target write_target();
+    // the message is only built on failure, so successful calls to `expect` don't allocate
+    [[noreturn]] void throw_unexpected_token(std::initializer_list<TokenType> expected_types) const;
+
+    [[nodiscard]] Operand read_target();
+    [[nodiscard]] Operand immediate(Expression const& value) const;
+    [[nodiscard]] Operand write_target();
+    [[nodiscard]] Symbol virtual_register();
     [[nodiscard]] JumpTarget jump_target();
+    [[nodiscard]] JumpTarget address(Expression const& target, i64 max_value, std::string_view description) const;
+    [[nodiscard]] bool starts_expression() const;
+    [[nodiscard]] Expression expression(Operands operands, usize depth = 0, usize min_precedence = 1);
+    [[nodiscard]] Expression operand(Operands operands, usize depth);
+    [[nodiscard]] Expression fold(Token operator_token, Expression lhs, Expression const& rhs) const;
+    void set_source_text(Expression& expression, Token first_token, usize num_gaps_before) const;
+    [[nodiscard]] std::string invalid_value_message(Expression const& expression, std::string_view what) const;
 };
@@ -0,0 +1,289 @@
+#include "encoder.hpp"
+#include "errors.hpp"
+#include "source_location.hpp"
+#include <algorithm>
+#include <common/trace.hpp>
+#include <format>
+#include <gsl/gsl>
+#include <limits>
+#include <string>
+#include <utility>
+
+static constexpr auto no_address = std::numeric_limits<u32>::max();
+static constexpr auto reported_unknown = no_address - 1; // unknown label whose uses have already been reported
+
+[[nodiscard]] std::vector<u32> assign_addresses(std::span<ir::Instruction const> const instructions) {
+    auto result = std::vector<u32>{};
+    result.reserve(instructions.size());
+    auto address = u32{ program_start_address };
+    for (auto const& instruction : instructions) {
+        result.push_back(address);
+        address += static_cast<u32>(instruction.size());
+    }
+    return result;
+}
+
+[[nodiscard]] std::string format_addend(i64 const addend) {
+    if (addend == 0) {
+        return {};
+    }
+    return std::format(" {} {}", addend < 0 ? '-' : '+', addend < 0 ? -addend : addend);
+}
+
+[[nodiscard]] static SourceLocation source_location(SourceFile const& file, ir::Instruction const& instruction) {
+    return SourceLocation{ file, instruction.source_offset, instruction.source_length };
+}
+
+// location of the label name within a jump (or of the jump itself if the name's offset couldn't be stored)
+[[nodiscard]] static SourceLocation
+target_location(SourceFile const& file, ir::Instruction const& instruction, SymbolTable const& symbols) {
+    if (instruction.target_offset == 0) {
+        return source_location(file, instruction);
+    }
+    return SourceLocation{
+        file,
+        usize{ instruction.source_offset } + instruction.target_offset,
+        symbols.name(instruction.target).length(),
+    };
+}
+
+Encoder::Encoder(
+        std::string_view const filename,
+        SymbolTable const& symbols,
+        IncludedBinaries const& binaries,
+        DiagnosticSink& diagnostics,
+        usize const expected_num_instructions,
+        Linkage const linkage
+)
+    : m_filename{ filename },
+      m_symbols{ &symbols },
+      m_binaries{ &binaries },
+      m_diagnostics{ &diagnostics },
+      m_linkage{ linkage } {
+    m_machine_code.reserve(expected_num_instructions * 2);
+}
+
+void Encoder::encode(SourceFile const& file, ir::Instruction const& instruction) {
+    if (instruction.has_virtual_registers()) {
+        // only whole programs are passed through the register allocator
+        auto const symbol = instruction.virtual_destination().value_or(instruction.virtual_source().value_or(0));
+        m_diagnostics->report(chissembler::EmitterError{ source_location(file, instruction).diagnostic(std::format(
+                "virtual register '{}' can only be used when assembling a whole program from memory",
+                m_symbols->name(symbol)
+        )) });
+        return;
+    }
+    auto const x = static_cast<u16>(std::to_underlying(instruction.destination) << 8);
+    auto const y = static_cast<u16>(instruction.source << 4);
+    switch (instruction.opcode) {
+        case ir::Opcode::Label:
+            define_label(file, instruction);
+            break;
+        case ir::Opcode::CopyImmediate:
+            append(static_cast<u16>(0x6000 | x | instruction.source));
+            break;
+        case ir::Opcode::CopyRegister:
+            append(static_cast<u16>(0x8000 | x | y));
+            break;
+        case ir::Opcode::AddImmediate:
+            append(static_cast<u16>(0x7000 | x | instruction.source));
+            break;
+        case ir::Opcode::AddRegister:
+            append(static_cast<u16>(0x8004 | x | y));
+            break;
+        case ir::Opcode::SubImmediate: {
+            // there's no opcode to subtract an immediate from a register, thus we will abuse overflow here
+            auto const offset = gsl::narrow_cast<u8>(256 - instruction.source);
+            append(static_cast<u16>(0x7000 | x | offset));
+            break;
+        }
+        case ir::Opcode::SubRegister:
+            append(static_cast<u16>(0x8005 | x | y));
+            break;
+        case ir::Opcode::And:
+            append(static_cast<u16>(0x8002 | x | y));
+            break;
+        case ir::Opcode::Or:
+            append(static_cast<u16>(0x8001 | x | y));
+            break;
+        case ir::Opcode::Xor:
+            append(static_cast<u16>(0x8003 | x | y));
+            break;
+        case ir::Opcode::Jump:
+            append(static_cast<u16>(0x1000 | jump_target(file, instruction)));
+            break;
+        case ir::Opcode::JumpWithOffset:
+            append(static_cast<u16>(0xB000 | jump_target(file, instruction)));
+            break;
+        case ir::Opcode::SetAddressRegister:
+            append(static_cast<u16>(0xA000 | jump_target(file, instruction)));
+            break;
+        case ir::Opcode::StoreRegisters:
+            append(static_cast<u16>(0xF055 | x));
+            break;
+        case ir::Opcode::LoadRegisters:
+            append(static_cast<u16>(0xF065 | x));
+            break;
+        case ir::Opcode::Byte:
+            m_machine_code.push_back(static_cast<std::byte>(instruction.source));
+            break;
+        case ir::Opcode::Word:
+            append(jump_target(file, instruction));
+            break;
+        case ir::Opcode::IncludeBinary: {
+            auto const bytes = m_binaries->bytes(instruction.binary_index());
+            m_machine_code.insert(m_machine_code.end(), bytes.begin(), bytes.end());
+            break;
+        }
+    }
+}
+
+[[nodiscard]] std::vector<std::byte> Encoder::finish() {
+    for (auto const& fixup : m_fixups) {
+        auto const address = m_label_addresses.at(fixup.symbol);
+        if (address == no_address) {
+            report_unknown_label(fixup.symbol);
+            m_label_addresses.at(fixup.symbol) = reported_unknown;
+            continue;
+        }
+        if (address == reported_unknown or not is_addressable(address, fixup.symbol, fixup.addend, fixup.position)) {
+            continue;
+        }
+        patch_address(m_machine_code, fixup.code_offset, static_cast<u32>(static_cast<i64>(address) + fixup.addend));
+    }
+    m_fixups.clear();
+    return std::move(m_machine_code);
+}
+
+[[nodiscard]] Optional<u32> Encoder::label_address(Symbol const symbol) const {
+    if (symbol >= m_label_addresses.size() or m_label_addresses[symbol] >= reported_unknown) {
+        return none;
+    }
+    return m_label_addresses[symbol];
+}
+
+void Encoder::append(u16 const opcode) {
+    m_machine_code.push_back(static_cast<std::byte>(opcode >> 8));
+    m_machine_code.push_back(static_cast<std::byte>(opcode & 0xFF));
+}
+
+void Encoder::define_label(SourceFile const& file, ir::Instruction const& instruction) {
+    auto const symbol = instruction.target;
+    ensure_label_capacity(symbol);
+    auto const [line, column] = source_location(file, instruction).line_and_column();
+    if (m_label_addresses[symbol] != no_address) {
+        // the first definition stays in effect
+        m_diagnostics->report(chissembler::EmitterError{ diagnostic(
+                Position{ line, column },
+                std::format(
+                        "duplicate label name '{}' (first defined at {})",
+                        m_symbols->name(symbol),
+                        format_position(m_label_definitions[symbol])
+                )
+        ) });
+        return;
+    }
+    auto const base_address = (m_linkage == Linkage::Absolute ? usize{ program_start_address } : usize{ 0 });
+    m_label_addresses[symbol] = gsl::narrow<u32>(base_address + m_machine_code.size());
+    m_label_definitions[symbol] = Position{ line, column };
+}
+
+[[nodiscard]] u16 Encoder::jump_target(SourceFile const& file, ir::Instruction const& instruction) {
+    if (not instruction.target_is_symbol) {
+        return gsl::narrow<u16>(instruction.target);
+    }
+    auto const symbol = instruction.target;
+    auto const addend = instruction.target_addend();
+    if (m_linkage == Linkage::Relocatable) {
+        m_relocations.push_back(Relocation{ m_machine_code.size(), symbol, addend });
+        return 0;
+    }
+    ensure_label_capacity(symbol);
+    auto const [line, column] = target_location(file, instruction, *m_symbols).line_and_column();
+    auto const address = m_label_addresses[symbol];
+    if (address == no_address) {
+        m_fixups.push_back(Fixup{ m_machine_code.size(), symbol, addend, Position{ line, column } });
+        return 0;
+    }
+    if (not is_addressable(address, symbol, addend, Position{ line, column })) {
+        return 0;
+    }
+    return static_cast<u16>(static_cast<i64>(address) + addend);
+}
+
+// the symbol table may grow while instructions are being encoded
+void Encoder::ensure_label_capacity(Symbol const symbol) {
+    if (symbol >= m_label_addresses.size()) {
+        m_label_addresses.resize(std::max(usize{ symbol } + 1, m_symbols->size()), no_address);
+        m_label_definitions.resize(m_label_addresses.size(), Position{ 0, 0 });
+    }
+}
+
+[[nodiscard]] bool Encoder::is_addressable(
+        u32 const address,
+        Symbol const symbol,
+        i16 const addend,
+        Position const position
+) {
+    if (auto const target = static_cast<i64>(address) + addend; target >= 0 and target <= max_address) {
+        return true;
+    }
+    m_diagnostics->report(chissembler::EmitterError{ diagnostic(
+            position,
+            std::format(
+                    "label '{}'{} is outside of the addressable memory",
+                    m_symbols->name(symbol),
+                    format_addend(addend)
+            )
+    ) });
+    return false;
+}
+
+// every use of a label that is never defined is still waiting to be patched
+void Encoder::report_unknown_label(Symbol const symbol) {
+    auto first_use = Optional<Position>{};
+    auto other_uses = std::string{};
+    for (auto const& fixup : m_fixups) {
+        if (fixup.symbol != symbol) {
+            continue;
+        }
+        if (not first_use.has_value()) {
+            first_use = fixup.position;
+        } else {
+            other_uses += std::format(
+                    "{}{}",
+                    other_uses.empty() ? " (also used at " : ", ",
+                    format_position(fixup.position)
+            );
+        }
+    }
+    if (not other_uses.empty()) {
+        other_uses += ')';
+    }
+    m_diagnostics->report(chissembler::EmitterError{
+            diagnostic(first_use.value(), std::format("unknown label '{}'{}", m_symbols->name(symbol), other_uses))
+    });
+}
+
+[[nodiscard]] chissembler::Diagnostic Encoder::diagnostic(Position const position, std::string message) const {
+    return chissembler::Diagnostic{ std::string{ m_filename }, position.line, position.column, std::move(message) };
+}
+
+[[nodiscard]] std::string Encoder::format_position(Position const position) const {
+    return std::format("{}:{}:{}", m_filename, position.line, position.column);
+}
+
+[[nodiscard]] std::vector<std::byte> encode(
+        SourceFile const& file,
+        std::span<ir::Instruction const> const instructions,
+        SymbolTable const& symbols,
+        IncludedBinaries const& binaries,
+        DiagnosticSink& diagnostics
+) {
+    TRACE_SCOPE("encode instructions");
+    auto encoder = Encoder{ file.filename(), symbols, binaries, diagnostics, instructions.size() };
+    for (auto const& instruction : instructions) {
+        encoder.encode(file, instruction);
+    }
+    return encoder.finish();
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "chissembler.hpp"
+#include "diagnostic_sink.hpp"
+#include "included_binaries.hpp"
+#include "ir.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using chissembler::program_start_address;
+inline constexpr auto max_address = u32{ 0x0FFF }; // the last byte of the memory
+
+// Fills in the address of the jump (or any other instruction that takes an address) at `code_offset`. The low 12 bits
+// of its opcode have been left empty for the address when it was encoded.
+inline void patch_address(std::span<std::byte> const code, usize const code_offset, u32 const address) {
+    code[code_offset] |= static_cast<std::byte>(address >> 8);
+    code[code_offset + 1] = static_cast<std::byte>(address & 0xFF);
+}
+
+// Address of every instruction and every label. Labels take up no space, so they share the address of the
+// instruction that follows them. Data may leave the following instructions at odd addresses.
+[[nodiscard]] std::vector<u32> assign_addresses(std::span<ir::Instruction const> instructions);
+
+// Absolute code is loaded at `program_start_address`. Relocatable code starts at address 0 and leaves the address of
+// every jump to a label for the linker, since the labels may be defined by other modules.
+enum class Linkage {
+    Absolute,
+    Relocatable,
+};
+
+// a jump whose address is filled in by the linker
+struct Relocation {
+    usize code_offset;
+    Symbol symbol;
+    i16 addend;
+};
+
+// " + 2" or " - 2" to describe offset labels in diagnostics, empty for 0
+[[nodiscard]] std::string format_addend(i64 addend);
+
+// Translates instructions into machine code as soon as they are emitted. Jumps to labels that haven't been defined
+// yet are encoded without an address and patched by `finish()`, so apart from the machine code only the labels and
+// the pending jumps are kept in memory.
+class Encoder final {
+private:
+    // resolved right away, since the source may be gone by the time a diagnostic is reported
+    struct Position {
+        usize line;
+        usize column;
+    };
+
+    struct Fixup {
+        usize code_offset;
+        Symbol symbol;
+        i16 addend;
+        Position position;
+    };
+
+    std::string_view m_filename;
+    SymbolTable const* m_symbols;
+    IncludedBinaries const* m_binaries;
+    DiagnosticSink* m_diagnostics;
+    std::vector<std::byte> m_machine_code;
+    std::vector<u32> m_label_addresses;        // indexed by symbol
+    std::vector<Position> m_label_definitions; // indexed by symbol
+    std::vector<Fixup> m_fixups;
+    Linkage m_linkage;
+    std::vector<Relocation> m_relocations;
+
+public:
+    Encoder(
+            std::string_view filename,
+            SymbolTable const& symbols,
+            IncludedBinaries const& binaries,
+            DiagnosticSink& diagnostics,
+            usize expected_num_instructions = 0,
+            Linkage linkage = Linkage::Absolute
+    );
+
+    // `file` is the source the instruction has been emitted from, it only has to live until this call returns
+    void encode(SourceFile const& file, ir::Instruction const& instruction);
+    [[nodiscard]] std::vector<std::byte> finish();
+
+    // address of the label (relative to the start of the code if relocatable), none if it hasn't been defined
+    [[nodiscard]] Optional<u32> label_address(Symbol symbol) const;
+
+    // only relocatable code has relocations, the pending jumps of absolute code are patched by `finish()`
+    [[nodiscard]] std::span<Relocation const> relocations() const {
+        return m_relocations;
+    }
+
+private:
+    void append(u16 opcode);
+    void define_label(SourceFile const& file, ir::Instruction const& instruction);
+    [[nodiscard]] u16 jump_target(SourceFile const& file, ir::Instruction const& instruction); // or any other address
+    void ensure_label_capacity(Symbol symbol);
+    [[nodiscard]] bool is_addressable(u32 address, Symbol symbol, i16 addend, Position position);
+    void report_unknown_label(Symbol symbol);
+    [[nodiscard]] chissembler::Diagnostic diagnostic(Position position, std::string message) const;
+    [[nodiscard]] std::string format_position(Position position) const;
+};
+
+// Translates the whole IR of a source into machine code.
+[[nodiscard]] std::vector<std::byte> encode(
+        SourceFile const& file,
+        std::span<ir::Instruction const> instructions,
+        SymbolTable const& symbols,
+        IncludedBinaries const& binaries,
+        DiagnosticSink& diagnostics
+);
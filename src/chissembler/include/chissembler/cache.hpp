@@ -0,0 +1,63 @@
+#pragma once
+
+#include "chissembler.hpp"
+#include <common/types.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chissembler {
+    class CacheError final : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // what a cache entry holds
+    enum class CachedOutput {
+        MachineCode,
+        Object, // serialized by `write_object()`
+    };
+
+    // identifies the machine code of a source: depends on its contents, the assembler version and the options
+    struct CacheKey {
+        u64 first;
+        u64 second;
+
+        [[nodiscard]] std::string to_string() const;
+
+        [[nodiscard]] friend bool operator==(CacheKey const&, CacheKey const&) = default;
+    };
+
+    // On-disk cache of assembled machine code, one file per entry. Entries are written to temporary files and renamed,
+    // so any number of processes may share a cache directory. Looking up an entry marks it as recently used, `trim()`
+    // evicts the least recently used entries until the cache fits into its size limit.
+    class Cache final {
+    private:
+        std::filesystem::path m_directory;
+        u64 m_max_size;
+
+    public:
+        // creates the directory if it doesn't exist
+        Cache(std::filesystem::path directory, u64 max_size);
+
+        // The key only covers the source itself, so sources that include binary files can't be cached. This is decided
+        // on the text alone: any mention of `incbin` bypasses the cache.
+        [[nodiscard]] static bool is_cacheable(std::string_view source);
+
+        [[nodiscard]] static CacheKey key(
+                std::string_view source,
+                AssembleOptions const& options,
+                CachedOutput output = CachedOutput::MachineCode
+        );
+
+        [[nodiscard]] Optional<std::vector<std::byte>> load(CacheKey const& key) const;
+        void store(CacheKey const& key, std::span<std::byte const> machine_code) const;
+        void trim() const;
+
+    private:
+        [[nodiscard]] std::filesystem::path entry_path(CacheKey const& key) const;
+    };
+} // namespace chissembler
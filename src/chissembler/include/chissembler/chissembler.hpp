@@ -1,10 +1,85 @@
 #pragma once
 
 #include "errors.hpp"
+#include "object_file.hpp"
+#include "source_map.hpp"
+#include <chrono>
+#include <common/types.hpp>
 #include <cstddef>
+#include <iosfwd>
 #include <string_view>
 #include <vector>
 
 namespace chissembler {
-    [[nodiscard]] std::vector<std::byte> assemble(std::string_view filename, std::string_view source);
-}
+    // has to be incremented whenever a source may assemble to different machine code than before (it's part of the
+    // key of cached results)
+    //   2: data directives, 3: removal of unreachable code, 4: constants and object file version 2, 5: macros
+    inline constexpr auto version = u32{ 5 };
+
+    // where ROMs are loaded into memory, and therefore where absolute code starts
+    inline constexpr auto program_start_address = u16{ 0x200 };
+
+    struct AssembleStatistics {
+        std::chrono::nanoseconds parse{}; // lexing and parsing, which are interleaved
+        std::chrono::nanoseconds optimize{};
+        std::chrono::nanoseconds encode{};
+        usize num_instructions = 0; // including labels
+    };
+
+    struct AssembleOptions {
+        std::ostream* listing = nullptr;         // receives an assembly listing if set, nothing is printed otherwise
+        AssembleStatistics* statistics = nullptr; // receives the time spent in each phase if set
+        bool optimize = false;                    // rewrites the program into fewer and cheaper instructions
+        // receives a note for every change of the optimizer if set
+        std::vector<Diagnostic>* optimization_report = nullptr;
+        // receives the serialized source map of the ROM if set (see `SourceMapView`), left untouched for objects and
+        // if there are any diagnostics (a program that doesn't fit into memory is an error then)
+        std::vector<std::byte>* source_map = nullptr;
+    };
+
+    struct AssembleResult {
+        std::vector<std::byte> machine_code; // empty if there are any diagnostics
+        std::vector<Diagnostic> diagnostics; // ordered by line and column
+    };
+
+    // throws the first error as `LexerError` or `EmitterError`
+    [[nodiscard]] std::vector<std::byte> assemble(
+            std::string_view filename,
+            std::string_view source,
+            AssembleOptions const& options = {}
+    );
+
+    // Doesn't stop at the first error: erroneous statements are skipped up to the next line break and all errors are
+    // returned together. The listing is only written if there are none.
+    [[nodiscard]] AssembleResult try_assemble(
+            std::string_view filename,
+            std::string_view source,
+            AssembleOptions const& options = {}
+    );
+
+    struct AssembleObjectResult {
+        ObjectFile object;                   // empty if there are any diagnostics
+        std::vector<Diagnostic> diagnostics; // ordered by line and column
+    };
+
+    // Assembles a module into a relocatable object which has to be linked (see `link()`). Labels that aren't defined
+    // in the source are no error but imported from other modules. No listing is written for objects, and they aren't
+    // optimized, since other modules may jump into any of their labels with an offset.
+    [[nodiscard]] ObjectFile assemble_object(
+            std::string_view filename,
+            std::string_view source,
+            AssembleOptions const& options = {}
+    );
+
+    // like `assemble_object()`, but collects all errors instead of throwing the first one
+    [[nodiscard]] AssembleObjectResult try_assemble_object(
+            std::string_view filename,
+            std::string_view source,
+            AssembleOptions const& options = {}
+    );
+
+    // Assembles while reading, so the source never has to be resident in memory as a whole: tokens are pulled on
+    // demand, every instruction is encoded right after it has been parsed and forward jumps are patched at the end.
+    // Memory usage is proportional to the machine code and the labels. No listing can be written in this mode.
+    [[nodiscard]] std::vector<std::byte> assemble(std::string_view filename, std::istream& source);
+} // namespace chissembler
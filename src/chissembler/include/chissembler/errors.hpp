@@ -1,13 +1,51 @@
 #pragma once
 
+#include <common/types.hpp>
+#include <format>
 #include <stdexcept>
+#include <string>
+#include <utility>
 
 namespace chissembler {
-    class LexerError final : public std::runtime_error {
-        using std::runtime_error::runtime_error;
+    // A problem found in a source. Line and column are 1-based, both are 0 if the problem concerns the whole source.
+    struct Diagnostic {
+        std::string filename;
+        usize line;
+        usize column;
+        std::string message;
+
+        [[nodiscard]] std::string to_string() const {
+            if (line == 0) {
+                return std::format("{}: {}", filename, message);
+            }
+            return std::format("{}:{}:{}: {}", filename, line, column, message);
+        }
+    };
+
+    class AssemblerError : public std::runtime_error {
+    private:
+        Diagnostic m_diagnostic;
+
+    public:
+        explicit AssemblerError(Diagnostic diagnostic)
+            : std::runtime_error{ diagnostic.to_string() },
+              m_diagnostic{ std::move(diagnostic) } { }
+
+        [[nodiscard]] Diagnostic const& diagnostic() const {
+            return m_diagnostic;
+        }
+    };
+
+    class LexerError final : public AssemblerError {
+        using AssemblerError::AssemblerError;
+    };
+
+    class EmitterError final : public AssemblerError {
+        using AssemblerError::AssemblerError;
     };
 
-    class EmitterError final : public std::runtime_error {
-        using std::runtime_error::runtime_error;
+    // the diagnostic names the offending module, its line and column are 0
+    class LinkerError final : public AssemblerError {
+        using AssemblerError::AssemblerError;
     };
 } // namespace chissembler
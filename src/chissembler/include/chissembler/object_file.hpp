@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <common/types.hpp>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary layout of a relocatable object file (.cso, all integers are little endian):
+//
+//   header:      "CH8OBJCT", u32 version
+//   code:        u32 size, machine code as if the module was loaded at address 0
+//   symbols:     u32 #symbols, per symbol: u32 name length, name, u8 is defined, u32 offset into the code
+//   relocations: u32 #relocations, per relocation: u32 offset of the jump opcode within the code, u32 symbol index,
+//                i32 addend (two's complement)
+//
+// Every label of a module is exported, labels that are used but not defined are imported from other modules.
+
+namespace chissembler {
+
+    class ObjectFileError final : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    inline constexpr auto object_file_magic = std::array{ 'C', 'H', '8', 'O', 'B', 'J', 'C', 'T' };
+    inline constexpr auto object_file_version = u32{ 2 };
+
+    struct ObjectSymbol {
+        std::string name;
+        Optional<u32> offset; // none if the symbol is imported
+    };
+
+    // The low 12 bits of the jump at `code_offset` receive the address of the symbol plus the addend (as in
+    // `jump label + 2`). Jumps to labels of the same module are relocated as well, since the address the module gets
+    // loaded at is only known to the linker.
+    struct ObjectRelocation {
+        u32 code_offset;
+        u32 symbol; // index into the symbols of the object
+        i32 addend;
+    };
+
+    struct ObjectFile {
+        std::string name; // identifies the module in diagnostics of the linker, not part of the binary layout
+        std::vector<std::byte> code;
+        std::vector<ObjectSymbol> symbols;
+        std::vector<ObjectRelocation> relocations;
+    };
+
+    [[nodiscard]] std::vector<std::byte> write_object(ObjectFile const& object);
+
+    // throws `ObjectFileError` if the data is truncated or inconsistent
+    [[nodiscard]] ObjectFile read_object(std::string name, std::span<std::byte const> data);
+
+    // Lays out the modules one after another in the given order, starting at the program start address, and patches
+    // every relocation with the address of its symbol. Throws a `LinkerError` if a symbol is defined by more than one
+    // module, isn't defined at all or lies outside of the addressable memory.
+    [[nodiscard]] std::vector<std::byte> link(std::span<ObjectFile const> modules);
+
+} // namespace chissembler
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <common/types.hpp>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary layout of a source map (.map, all integers are little endian), the debug info of a ROM:
+//
+//   header:  "CH8SRCMP", u32 version, u32 #files, u32 #ranges, u32 #labels, u32 size of the string table
+//   files:   per file: u32 name offset, u32 name length
+//   ranges:  per range of emitted bytes: u16 address, u16 size, u32 file index, u32 line, u32 column
+//   labels:  per label: u16 address, u16 size, u32 name offset, u32 name length
+//   strings: the names of the files and labels (offsets are relative to the start of the string table)
+//
+// Every entry has a fixed size and both ranges and labels are sorted by address, so the file is meant to be mapped
+// into memory and searched in place instead of being parsed. Since a ROM has less than 4 KiB, looking up an address
+// takes at most 12 probes, no matter how long the program runs. Lines and columns are 1-based. A label spans the
+// addresses up to the next label with a greater address (or the end of the code).
+
+namespace chissembler {
+
+    class SourceMapError final : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    inline constexpr auto source_map_magic = std::array{ 'C', 'H', '8', 'S', 'R', 'C', 'M', 'P' };
+    inline constexpr auto source_map_version = u32{ 1 };
+
+    struct SourceMap {
+        struct Range {
+            u16 address;
+            u16 size;
+            u32 file; // index into `files`
+            u32 line;
+            u32 column;
+        };
+
+        struct Label {
+            std::string name;
+            u16 address;
+            u16 size;
+        };
+
+        std::vector<std::string> files;
+        std::vector<Range> ranges; // sorted by address, not overlapping
+        std::vector<Label> labels; // sorted by address
+    };
+
+    [[nodiscard]] std::vector<std::byte> write_source_map(SourceMap const& source_map);
+
+    // Looks up addresses directly in the serialized data, which has to outlive the view. The constructor checks all
+    // entries once (without copying anything) and throws `SourceMapError` if the data is truncated or inconsistent,
+    // so lookups never fail.
+    class SourceMapView final {
+    public:
+        struct Location {
+            std::string_view file;
+            u32 line;
+            u32 column;
+        };
+
+        struct Label {
+            std::string_view name;
+            u16 address;
+            u16 size;
+        };
+
+    private:
+        std::span<std::byte const> m_files;
+        std::span<std::byte const> m_ranges;
+        std::span<std::byte const> m_labels;
+        std::span<std::byte const> m_strings;
+
+    public:
+        explicit SourceMapView(std::span<std::byte const> data);
+
+        // none if no code has been emitted at the address
+        [[nodiscard]] Optional<Location> find(u16 address) const;
+        // the last label at or before the address that spans it, none if there is none
+        [[nodiscard]] Optional<Label> find_label(u16 address) const;
+
+        [[nodiscard]] usize num_ranges() const;
+        [[nodiscard]] usize num_labels() const;
+
+    private:
+        void check_string(u32 offset, u32 length) const;
+        [[nodiscard]] std::string_view string(u32 offset, u32 length) const;
+    };
+
+} // namespace chissembler
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common/mapped_file.hpp>
+#include <common/types.hpp>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+// The files included by `incbin`. They stay mapped into memory until the machine code has been encoded, so the
+// encoder copies their bytes straight from the mapping into the machine code. Instructions refer to them by index.
+class IncludedBinaries final {
+private:
+    struct Binary {
+        MappedFile file;
+        usize offset;
+        usize length;
+    };
+
+    std::vector<Binary> m_binaries;
+
+public:
+    // returns the index of the included bytes (`length` bytes from `offset` on, which must lie within the file)
+    [[nodiscard]] usize add(MappedFile file, usize const offset, usize const length) {
+        m_binaries.push_back(Binary{ std::move(file), offset, length });
+        return m_binaries.size() - 1;
+    }
+
+    [[nodiscard]] std::span<std::byte const> bytes(usize const index) const {
+        auto const& binary = m_binaries.at(index);
+        return binary.file.bytes().subspan(binary.offset, binary.length);
+    }
+
+    [[nodiscard]] usize size() const {
+        return m_binaries.size();
+    }
+};
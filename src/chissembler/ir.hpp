@@ -0,0 +1,184 @@
+#pragma once
+
+#include <bit>
+#include <common/types.hpp>
+#include <type_traits>
+#include <utility>
+
+enum class DataRegister : u8 {
+    V0,
+    V1,
+    V2,
+    V3,
+    V4,
+    V5,
+    V6,
+    V7,
+    V8,
+    V9,
+    VA,
+    VB,
+    VC,
+    VD,
+    VE,
+    VF,
+};
+
+// dense id of an interned identifier (see `SymbolTable`)
+using Symbol = u32;
+
+namespace ir {
+
+    enum class Opcode : u8 {
+        Label,          // defines `target` (a symbol) at the current address, emits nothing
+        CopyImmediate,  // destination = immediate
+        CopyRegister,   // destination = source
+        AddImmediate,   // destination += immediate
+        AddRegister,    // destination += source
+        SubImmediate,   // destination -= immediate
+        SubRegister,    // destination -= source
+        And,            // destination &= source
+        Or,             // destination |= source
+        Xor,            // destination ^= source
+        Jump,           // jump to `target` (+ addend)
+        JumpWithOffset, // jump to `target` (+ addend) + V0
+        SetAddressRegister, // I = `target` (+ addend)
+        // only generated by the register allocator to spill virtual registers
+        StoreRegisters, // memory[I...I + destination] = V0...destination
+        LoadRegisters,  // V0...destination = memory[I...I + destination]
+        // data, which is emitted as it is
+        Byte,          // the immediate in `source`
+        Word,          // `target` (+ addend), big endian
+        IncludeBinary, // `target` bytes of an included file
+    };
+
+    [[nodiscard]] inline Optional<Symbol> decode_virtual_register(u32 const encoded) {
+        if (encoded == 0) {
+            return none;
+        }
+        return encoded - 1;
+    }
+
+    // One element of the flat intermediate representation the emitter produces. Operands are stored inline, so a
+    // whole program is a single contiguous array.
+    struct Instruction {
+        Opcode opcode;
+        DataRegister destination = DataRegister::V0;
+        u8 source = 0;                 // data register or immediate, depending on the opcode
+        bool target_is_symbol = false; // whether `target` is a symbol or an absolute address
+        u32 target = 0;                // jump target or label
+        u32 source_offset = 0;         // location of the instruction's first token (for diagnostics and listings)
+        u16 source_length = 0;
+        u16 target_offset = 0; // offset of a symbolic target's token relative to `source_offset` (0 if unknown)
+
+        [[nodiscard]] bool emits_code() const {
+            return opcode != Opcode::Label;
+        }
+
+        // number of bytes of machine code or data
+        [[nodiscard]] usize size() const {
+            switch (opcode) {
+                case Opcode::Label:
+                    return 0;
+                case Opcode::Byte:
+                    return 1;
+                case Opcode::IncludeBinary:
+                    return target;
+                default:
+                    return 2;
+            }
+        }
+
+        [[nodiscard]] bool is_data() const {
+            return opcode == Opcode::Byte or opcode == Opcode::Word or opcode == Opcode::IncludeBinary;
+        }
+
+        [[nodiscard]] DataRegister source_register() const {
+            return static_cast<DataRegister>(source);
+        }
+
+        // whether `destination` (and `source`, if the opcode reads a register) are data registers
+        [[nodiscard]] bool has_register_operands() const {
+            switch (opcode) {
+                case Opcode::CopyImmediate:
+                case Opcode::CopyRegister:
+                case Opcode::AddImmediate:
+                case Opcode::AddRegister:
+                case Opcode::SubImmediate:
+                case Opcode::SubRegister:
+                case Opcode::And:
+                case Opcode::Or:
+                case Opcode::Xor:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        [[nodiscard]] bool reads_source_register() const {
+            return has_register_operands() and opcode != Opcode::CopyImmediate and opcode != Opcode::AddImmediate
+                   and opcode != Opcode::SubImmediate;
+        }
+
+        [[nodiscard]] bool reads_destination() const {
+            return has_register_operands() and opcode != Opcode::CopyImmediate and opcode != Opcode::CopyRegister;
+        }
+
+        // Register operands may name virtual registers, which are mapped to data registers by `allocate_registers()`.
+        // Instructions with register operands have no target, so the low and high half of `target` hold the symbol
+        // of the virtual destination and source register plus one (0 for data registers).
+        [[nodiscard]] Optional<Symbol> virtual_destination() const {
+            return decode_virtual_register(target & 0xFFFF);
+        }
+
+        [[nodiscard]] Optional<Symbol> virtual_source() const {
+            return decode_virtual_register(target >> 16);
+        }
+
+        void set_virtual_registers(Optional<Symbol> const destination_symbol, Optional<Symbol> const source_symbol) {
+            auto const encode = [](Optional<Symbol> const symbol) {
+                return symbol.has_value() ? symbol.value() + 1 : u32{ 0 };
+            };
+            target = encode(destination_symbol) | (encode(source_symbol) << 16);
+        }
+
+        [[nodiscard]] bool has_virtual_registers() const {
+            return has_register_operands() and target != 0;
+        }
+
+        // Jumps (as well as `SetAddressRegister` and `Word`) have no register operands either, so `destination` and
+        // `source` hold the offset that is added to a symbolic target (`jump label + 2`).
+        [[nodiscard]] i16 target_addend() const {
+            return std::bit_cast<i16>(packed_operands());
+        }
+
+        void set_target_addend(i16 const addend) {
+            set_packed_operands(std::bit_cast<u16>(addend));
+        }
+
+        // the index of the included file's bytes (see `IncludedBinaries`), stored like the addend
+        [[nodiscard]] u16 binary_index() const {
+            return packed_operands();
+        }
+
+        void set_binary_index(u16 const index) {
+            set_packed_operands(index);
+        }
+
+        [[nodiscard]] u16 packed_operands() const {
+            return static_cast<u16>((std::to_underlying(destination) << 8) | source);
+        }
+
+        void set_packed_operands(u16 const bits) {
+            destination = static_cast<DataRegister>(bits >> 8);
+            source = static_cast<u8>(bits & 0xFF);
+        }
+    };
+
+    // the largest symbol a virtual register may have
+    inline constexpr auto max_virtual_register_symbol = Symbol{ 0xFFFE };
+
+    static_assert(std::is_trivially_copyable_v<Instruction>);
+    static_assert(sizeof(Instruction) == 16);
+
+} // namespace ir
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "token_type.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <common/types.hpp>
+#include <limits>
+#include <magic_enum.hpp>
+#include <string_view>
+
+struct Keyword {
+    std::string_view spelling;
+    TokenType type;
+};
+
+// The single list of all keywords (including the address register `I`, which can't be told apart from an identifier
+// otherwise). The lexer recognizes them through the perfect hash below, diagnostics print them by their spelling.
+inline constexpr auto keywords = std::array{
+    Keyword{     "copy",            TokenType::Copy },
+    Keyword{      "add",             TokenType::Add },
+    Keyword{      "sub",             TokenType::Sub },
+    Keyword{      "and",             TokenType::And },
+    Keyword{       "or",              TokenType::Or },
+    Keyword{      "xor",             TokenType::Xor },
+    Keyword{     "jump",            TokenType::Jump },
+    Keyword{    "const",           TokenType::Const },
+    Keyword{    "macro",           TokenType::Macro },
+    Keyword{ "endmacro",        TokenType::Endmacro },
+    Keyword{       "db",              TokenType::Db },
+    Keyword{       "dw",              TokenType::Dw },
+    Keyword{   "incbin",          TokenType::Incbin },
+    Keyword{        "I", TokenType::AddressRegister },
+};
+
+namespace detail {
+    inline constexpr auto keyword_table_size = std::bit_ceil(keywords.size() * 2);
+    inline constexpr auto keyword_table_bits = std::countr_zero(keyword_table_size);
+    inline constexpr auto no_keyword = std::numeric_limits<u8>::max();
+
+    // multiplicative hash of the first, second and last character and the length (lexeme must not be empty)
+    [[nodiscard]] constexpr usize keyword_hash(std::string_view const lexeme, u32 const seed) {
+        auto const first = static_cast<u32>(static_cast<unsigned char>(lexeme.front()));
+        auto const second = static_cast<u32>(static_cast<unsigned char>(lexeme[lexeme.length() > 1 ? 1 : 0]));
+        auto const last = static_cast<u32>(static_cast<unsigned char>(lexeme.back()));
+        auto const key = first | (second << 8) | (last << 16) | (static_cast<u32>(lexeme.length()) << 24);
+        return static_cast<usize>((key * seed) >> (32 - keyword_table_bits));
+    }
+
+    [[nodiscard]] constexpr bool is_collision_free(u32 const seed) {
+        auto is_used = std::array<bool, keyword_table_size>{};
+        for (auto const& keyword : keywords) {
+            auto const slot = keyword_hash(keyword.spelling, seed);
+            if (is_used.at(slot)) {
+                return false;
+            }
+            is_used.at(slot) = true;
+        }
+        return true;
+    }
+
+    [[nodiscard]] constexpr u32 find_keyword_hash_seed() {
+        for (auto seed = u32{ 0x9E37'79B1 }; seed < 0x9E37'79B1 + 100'000; seed += 2) {
+            if (is_collision_free(seed)) {
+                return seed;
+            }
+        }
+        return 0;
+    }
+
+    inline constexpr auto keyword_hash_seed = find_keyword_hash_seed();
+    static_assert(keyword_hash_seed != 0, "no perfect hash found for the keywords, increase the table size");
+
+    inline constexpr auto keyword_table = [] {
+        auto result = std::array<u8, keyword_table_size>{};
+        result.fill(no_keyword);
+        for (usize i = 0; i < keywords.size(); ++i) {
+            result.at(keyword_hash(keywords.at(i).spelling, keyword_hash_seed)) = static_cast<u8>(i);
+        }
+        return result;
+    }();
+
+    inline constexpr auto max_keyword_length = [] {
+        auto result = usize{ 0 };
+        for (auto const& keyword : keywords) {
+            result = std::max(result, keyword.spelling.length());
+        }
+        return result;
+    }();
+} // namespace detail
+
+// constant time lookup: one hash and at most one string comparison
+[[nodiscard]] inline Optional<TokenType> find_keyword(std::string_view const lexeme) {
+    if (lexeme.empty() or lexeme.length() > detail::max_keyword_length) {
+        return none;
+    }
+    auto const index = detail::keyword_table[detail::keyword_hash(lexeme, detail::keyword_hash_seed)];
+    if (index == detail::no_keyword or keywords[index].spelling != lexeme) {
+        return none;
+    }
+    return keywords[index].type;
+}
+
+// keywords are named by their spelling, all other token types by their enumerator name
+[[nodiscard]] inline std::string_view token_type_name(TokenType const type) {
+    for (auto const& keyword : keywords) {
+        if (keyword.type == type) {
+            return keyword.spelling;
+        }
+    }
+    return magic_enum::enum_name(type);
+}
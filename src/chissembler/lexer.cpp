@@ -1,106 +1,133 @@
 #include "lexer.hpp"
 #include "errors.hpp"
+#include "keywords.hpp"
+#include "scanner.hpp"
 #include "utils.hpp"
-#include <cctype>
+#include <string>
 
-[[nodiscard]] std::vector<Token> Lexer::tokenize(std::string_view const filename, std::string_view const source) {
-    return Lexer{ filename, source }.tokenize_implementation(filename, source);
+// tokens consisting of a single character
+[[nodiscard]] static Optional<TokenType> punctuation(char const c) {
+    switch (c) {
+        case ':':
+            return TokenType::Colon;
+        case '+':
+            return TokenType::Plus;
+        case '-':
+            return TokenType::Minus;
+        case '*':
+            return TokenType::Asterisk;
+        case '/':
+            return TokenType::Slash;
+        case '&':
+            return TokenType::Ampersand;
+        case '|':
+            return TokenType::Pipe;
+        case '(':
+            return TokenType::LeftParenthesis;
+        case ')':
+            return TokenType::RightParenthesis;
+        case '=':
+            return TokenType::Equals;
+        case ',':
+            return TokenType::Comma;
+        default:
+            return none;
+    }
 }
 
-// clang-format off
-[[nodiscard]] std::vector<Token> Lexer::tokenize_implementation(
-    std::string_view const filename,
-    std::string_view const source
-) { // clang-format on
-    auto tokens = std::vector<Token>{};
+Lexer::Lexer(SourceFile const& file, DiagnosticSink& diagnostics)
+    : m_file{ &file },
+      m_source{ file.source() },
+      m_diagnostics{ &diagnostics } {
+    if (m_source.length() > Token::max_offset) {
+        m_diagnostics->report(chissembler::LexerError{
+                chissembler::Diagnostic{ std::string{ file.filename() }, 0, 0, "source file is too large" } });
+        m_source = {};
+    }
+}
+
+[[nodiscard]] Token Lexer::next() {
     while (not is_at_end()) {
         if (current() == '\n') {
-            tokens.emplace_back(TokenType::Newline, SourceLocation{ filename, source, m_index, 1 });
             advance();
-            continue;
+            return make_token(TokenType::Newline, m_index - 1, 1);
         }
 
-        if (current() == ':') {
-            tokens.emplace_back(TokenType::Colon, SourceLocation{ filename, source, m_index, 1 });
+        if (auto const type = punctuation(current()); type.has_value()) {
             advance();
-            continue;
+            return make_token(type.value(), m_index - 1, 1);
         }
 
-        if (current() == '+') {
-            tokens.emplace_back(TokenType::Plus, SourceLocation{ filename, source, m_index, 1 });
+        if ((current() == '<' or current() == '>') and peek() == current()) {
+            auto const type = (current() == '<' ? TokenType::ShiftLeft : TokenType::ShiftRight);
             advance();
-            continue;
+            advance();
+            return make_token(type, m_index - 2, 2);
         }
 
-        if (std::isspace(static_cast<unsigned char>(current()))) {
-            advance();
+        if (scanner::matches<scanner::Run::Whitespace>(current())) {
+            m_index = scanner::skip<scanner::Run::Whitespace>(m_source, m_index + 1);
             continue;
         }
 
-        if (std::isdigit(static_cast<unsigned char>(current()))) {
+        if (current() == '"') {
+            // no escape sequences, string literals can't contain quotes or line breaks
             auto const start_index = m_index;
-            advance();
-            while (not is_at_end() and std::isdigit(static_cast<unsigned char>(current()))) {
-                advance();
+            auto const end = m_source.find_first_of("\"\n", m_index + 1);
+            if (end == std::string_view::npos or m_source[end] == '\n') {
+                m_diagnostics->report(chissembler::LexerError{
+                        SourceLocation{ *m_file, start_index, 1 }.diagnostic("unterminated string literal") });
+                m_index = (end == std::string_view::npos ? m_source.length() : end);
+                continue;
             }
-            tokens.emplace_back(
-                    TokenType::IntegerLiteral,
-                    SourceLocation{ filename, source, start_index, m_index - start_index }
-            );
-            continue;
+            m_index = end + 1;
+            return make_token(TokenType::StringLiteral, start_index, m_index - start_index);
+        }
+
+        if (scanner::is_digit(current())) {
+            auto const start_index = m_index;
+            // the digits of hexadecimal and binary literals are only validated when the literal is parsed
+            auto const has_prefix =
+                    current() == '0' and (peek() == 'x' or peek() == 'X' or peek() == 'b' or peek() == 'B');
+            m_index = has_prefix ? scanner::skip<scanner::Run::IdentifierCharacters>(m_source, m_index + 2)
+                                 : scanner::skip<scanner::Run::Digits>(m_source, m_index + 1);
+            return make_token(TokenType::IntegerLiteral, start_index, m_index - start_index);
         }
 
         if (current() == 'V' and is_valid_register_char(peek())) {
-            tokens.emplace_back(TokenType::Register, SourceLocation{ filename, source, m_index, 2 });
             advance();
             advance();
-            continue;
+            return make_token(TokenType::Register, m_index - 2, 2);
         }
 
-        if (std::isalpha(static_cast<unsigned char>(current()))) {
+        if (current() == '%' and scanner::matches<scanner::Run::IdentifierCharacters>(peek())) {
             auto const start_index = m_index;
-            advance();
-            while (not is_at_end() and (current() == '_' or std::isalnum(static_cast<unsigned char>(current())))) {
-                advance();
-            }
-            auto const source_location = SourceLocation{ filename, source, start_index, m_index - start_index };
-            auto const lexeme = source_location.lexeme();
-            if (lexeme == "copy") {
-                tokens.emplace_back(TokenType::Copy, source_location);
-                continue;
-            }
-            if (lexeme == "add") {
-                tokens.emplace_back(TokenType::Add, source_location);
-                continue;
-            }
-            if (lexeme == "sub") {
-                tokens.emplace_back(TokenType::Sub, source_location);
-                continue;
-            }
-            if (lexeme == "and") {
-                tokens.emplace_back(TokenType::And, source_location);
-                continue;
-            }
-            if (lexeme == "or") {
-                tokens.emplace_back(TokenType::Or, source_location);
-                continue;
-            }
-            if (lexeme == "xor") {
-                tokens.emplace_back(TokenType::Xor, source_location);
-                continue;
-            }
-            if (lexeme == "jump") {
-                tokens.emplace_back(TokenType::Jump, source_location);
-                continue;
-            }
-            tokens.emplace_back(TokenType::Identifier, source_location);
-            continue;
+            m_index = scanner::skip<scanner::Run::IdentifierCharacters>(m_source, m_index + 2);
+            return make_token(TokenType::VirtualRegister, start_index, m_index - start_index);
         }
 
-        throw chissembler::LexerError{
-            std::format("{}: source contains invalid characters", SourceLocation{ filename, source, m_index, 1 })
-        };
+        if (scanner::is_letter(current())) {
+            auto const start_index = m_index;
+            m_index = scanner::skip<scanner::Run::IdentifierCharacters>(m_source, m_index + 1);
+            auto const length = m_index - start_index;
+            auto const lexeme = m_source.substr(start_index, length);
+            auto const keyword = find_keyword(lexeme);
+            return make_token(keyword.value_or(TokenType::Identifier), start_index, length);
+        }
+
+        m_diagnostics->report(chissembler::LexerError{
+                SourceLocation{ *m_file, m_index, 1 }.diagnostic("source contains invalid characters") });
+        advance();
+    }
+    return make_token(TokenType::EndOfInput, m_source.empty() ? 0 : m_source.length() - 1, 1);
+}
+
+[[nodiscard]] Token Lexer::make_token(TokenType const type, usize const offset, usize const length) {
+    if (length > Token::max_length) {
+        m_diagnostics->report(
+                chissembler::LexerError{ SourceLocation{ *m_file, offset, length }.diagnostic("token is too long") }
+        );
+        return Token{ type, static_cast<u32>(offset), static_cast<u16>(Token::max_length) };
     }
-    tokens.emplace_back(TokenType::EndOfInput, SourceLocation{ filename, source, source.length() - 1, 1 });
-    return tokens;
+    return Token{ type, static_cast<u32>(offset), static_cast<u16>(length) };
 }
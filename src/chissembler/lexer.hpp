@@ -1,38 +1,42 @@
 #pragma once
 
+#include "diagnostic_sink.hpp"
+#include "source_file.hpp"
 #include "token.hpp"
 #include <common/types.hpp>
-#include <stdexcept>
 
+// Produces the tokens of a source on demand, so they never have to be stored all at once. Invalid characters are
+// reported and skipped.
 class Lexer final {
 private:
-    std::string_view m_filename;
+    SourceFile const* m_file;
     std::string_view m_source;
+    DiagnosticSink* m_diagnostics;
     usize m_index = 0;
 
 public:
-    [[nodiscard]] static std::vector<Token> tokenize(std::string_view filename, std::string_view source);
+    // the source file must outlive the lexer and the returned tokens
+    Lexer(SourceFile const& file, DiagnosticSink& diagnostics);
 
-private:
-    Lexer(std::string_view const filename, std::string_view const source)
-        : m_filename{ filename },
-          m_source{ source } { }
+    // returns `EndOfInput` once the whole source has been read (and on every call after that)
+    [[nodiscard]] Token next();
 
-    [[nodiscard]] std::vector<Token> tokenize_implementation(std::string_view filename, std::string_view source);
+private:
+    [[nodiscard]] Token make_token(TokenType type, usize offset, usize length);
 
     [[nodiscard]] bool is_at_end() const {
         return m_index >= m_source.length();
     }
 
     [[nodiscard]] char current() const {
-        return is_at_end() ? '\0' : m_source.at(m_index);
+        return is_at_end() ? '\0' : m_source[m_index];
     }
 
     [[nodiscard]] char peek() const {
         if (m_index + 1 >= m_source.length()) {
             return '\0';
         }
-        return m_source.at(m_index + 1);
+        return m_source[m_index + 1];
     }
 
     char advance() {
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <common/types.hpp>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Offsets of the first character of every line of a source. It is built once per source, so that looking up the
+// line and column of a source location is a binary search instead of a scan from the beginning of the source.
+class LineIndex final {
+private:
+    std::vector<usize> m_line_starts;
+
+public:
+    explicit LineIndex(std::string_view const source) {
+        m_line_starts.reserve(static_cast<usize>(std::count(source.cbegin(), source.cend(), '\n')) + 1);
+        m_line_starts.push_back(0);
+        for (auto line_break = source.find('\n'); line_break != std::string_view::npos;
+             line_break = source.find('\n', line_break + 1)) {
+            m_line_starts.push_back(line_break + 1);
+        }
+    }
+
+    [[nodiscard]] usize num_lines() const {
+        return m_line_starts.size();
+    }
+
+    // both line and column are 1-based
+    [[nodiscard]] std::pair<usize, usize> line_and_column(usize const offset) const {
+        auto const next_line_start = std::upper_bound(m_line_starts.cbegin(), m_line_starts.cend(), offset);
+        auto const line_start = std::prev(next_line_start);
+        return { static_cast<usize>(next_line_start - m_line_starts.cbegin()), offset - *line_start + 1 };
+    }
+};
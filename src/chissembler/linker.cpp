@@ -0,0 +1,90 @@
+#include "encoder.hpp"
+#include "errors.hpp"
+#include "object_file.hpp"
+#include <common/trace.hpp>
+#include <format>
+#include <gsl/gsl>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace chissembler {
+    [[nodiscard]] static LinkerError linker_error(ObjectFile const& module, std::string message) {
+        return LinkerError{ Diagnostic{ module.name, 0, 0, std::move(message) } };
+    }
+
+    [[nodiscard]] std::vector<std::byte> link(std::span<ObjectFile const> const modules) {
+        TRACE_SCOPE("link");
+        struct Definition {
+            usize address;
+            ObjectFile const* module;
+        };
+
+        auto definitions = std::unordered_map<std::string_view, Definition>{};
+        auto load_addresses = std::vector<usize>{};
+        load_addresses.reserve(modules.size());
+        auto address = usize{ program_start_address };
+        for (auto const& module : modules) {
+            load_addresses.push_back(address);
+            for (auto const& symbol : module.symbols) {
+                if (not symbol.offset.has_value()) {
+                    continue;
+                }
+                auto const [definition, inserted] =
+                        definitions.try_emplace(symbol.name, Definition{ address + symbol.offset.value(), &module });
+                if (not inserted) {
+                    throw linker_error(
+                            module,
+                            std::format(
+                                    "duplicate symbol '{}' (first defined in {})",
+                                    symbol.name,
+                                    definition->second.module->name
+                            )
+                    );
+                }
+            }
+            address += module.code.size();
+            if (address > usize{ max_address } + 1) {
+                throw linker_error(
+                        module,
+                        std::format("program of {} bytes doesn't fit into memory", address - program_start_address)
+                );
+            }
+        }
+
+        auto result = std::vector<std::byte>{};
+        result.reserve(address - program_start_address);
+        for (auto const& module : modules) {
+            result.insert(result.end(), module.code.begin(), module.code.end());
+        }
+
+        for (usize i = 0; i < modules.size(); ++i) {
+            auto const& module = modules[i];
+            for (auto const& relocation : module.relocations) {
+                auto const& symbol = module.symbols.at(relocation.symbol);
+                auto const definition = definitions.find(symbol.name);
+                if (definition == definitions.end()) {
+                    throw linker_error(module, std::format("undefined symbol '{}'", symbol.name));
+                }
+                auto const target = static_cast<i64>(definition->second.address) + relocation.addend;
+                if (target < 0 or target > i64{ max_address }) {
+                    throw linker_error(
+                            module,
+                            std::format(
+                                    "symbol '{}'{} is outside of the addressable memory",
+                                    symbol.name,
+                                    format_addend(relocation.addend)
+                            )
+                    );
+                }
+                if (usize{ relocation.code_offset } + 2 > module.code.size()) {
+                    throw linker_error(module, "relocation is outside of the code");
+                }
+                auto const code_offset = load_addresses[i] - program_start_address + relocation.code_offset;
+                patch_address(result, code_offset, static_cast<u32>(target));
+            }
+        }
+        return result;
+    }
+} // namespace chissembler
@@ -0,0 +1,40 @@
+#include "listing.hpp"
+#include "encoder.hpp"
+#include "source_location.hpp"
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <ostream>
+#include <string>
+
+void write_listing(
+        std::ostream& stream,
+        SourceFile const& file,
+        std::span<ir::Instruction const> const instructions,
+        std::span<std::byte const> const machine_code
+) {
+    auto const addresses = assign_addresses(instructions);
+    auto line = std::string{};
+    for (usize i = 0; i < instructions.size(); ++i) {
+        auto const& instruction = instructions[i];
+        line.clear();
+        if (not instruction.emits_code()) {
+            line.append(6, ' ');
+        } else {
+            // data may be longer than an instruction, only its first bytes are shown
+            auto const offset = addresses.at(i) - program_start_address;
+            auto const bytes = machine_code.subspan(offset, std::min(instruction.size(), usize{ 2 }));
+            std::format_to(std::back_inserter(line), "0x{:03X}  ", addresses.at(i));
+            for (auto const byte : bytes) {
+                std::format_to(std::back_inserter(line), "{:02X}", static_cast<u8>(byte));
+            }
+            if (instruction.size() > bytes.size()) {
+                line += "..";
+            }
+        }
+        line.resize(std::max(line.size(), usize{ 18 }), ' ');
+        auto const location = SourceLocation{ file, instruction.source_offset, instruction.source_length };
+        std::format_to(std::back_inserter(line), "{}\n", location.line());
+        stream << line;
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ir.hpp"
+#include "source_file.hpp"
+#include <common/types.hpp>
+#include <cstddef>
+#include <iosfwd>
+#include <span>
+
+// writes one line per instruction: address, emitted bytes and the source line that produced them
+void write_listing(
+        std::ostream& stream,
+        SourceFile const& file,
+        std::span<ir::Instruction const> instructions,
+        std::span<std::byte const> machine_code
+);
@@ -0,0 +1,298 @@
+#include "macro_expander.hpp"
+#include <algorithm>
+#include <format>
+#include <gsl/gsl>
+#include <ranges>
+#include <utility>
+
+[[nodiscard]] Token MacroExpander::next() {
+    while (not m_frames.empty()) {
+        auto& frame = m_frames.back();
+        if (frame.next == frame.end) {
+            if (frame.expansion.has_value()) {
+                m_expansions.at(frame.expansion.value()).is_finished = true;
+            }
+            m_frames.pop_back();
+            continue;
+        }
+        auto const token = m_tokens[frame.next++];
+        if (frame.expansion.has_value() and token.type() == TokenType::Identifier) {
+            auto const& expansion = m_expansions.at(frame.expansion.value());
+            auto const parameter = find_parameter(m_macros[expansion.macro], token.lexeme(*m_file));
+            if (parameter.has_value()) {
+                auto const argument = m_arguments.at(expansion.first_argument + parameter.value());
+                m_frames.push_back(Frame{ argument.begin, argument.end, none });
+                continue;
+            }
+        }
+        if (depends_on_other_names(token)) {
+            // the tokens are part of the enclosing expansions as well
+            for (auto& expansion : m_expansions) {
+                expansion.is_cacheable = false;
+            }
+        }
+        return token;
+    }
+    if (m_pushed_back.has_value()) {
+        auto const result = m_pushed_back.value();
+        m_pushed_back = none;
+        return result;
+    }
+    return m_lexer.next();
+}
+
+[[nodiscard]] Optional<usize> MacroExpander::num_parameters(std::string_view const name) const {
+    auto const macro = m_macro_indices.find(name);
+    if (macro == m_macro_indices.end()) {
+        return none;
+    }
+    return m_macros[macro->second].num_parameters;
+}
+
+void MacroExpander::define(
+        std::string_view const name,
+        std::span<Token const> const parameters,
+        std::span<Token const> const body
+) {
+    auto macro = Macro{};
+    macro.first_parameter = m_names.size();
+    macro.num_parameters = parameters.size();
+    for (auto const& parameter : parameters) {
+        m_names.push_back(parameter.lexeme(*m_file));
+    }
+
+    // every label that is defined at the start of a line of the body (unless it's named by an argument)
+    macro.first_local = m_names.size();
+    for (usize i = 0; i + 1 < body.size(); ++i) {
+        auto const is_line_start = (i == 0 or body[i - 1].type() == TokenType::Newline);
+        if (not is_line_start or body[i].type() != TokenType::Identifier or body[i + 1].type() != TokenType::Colon) {
+            continue;
+        }
+        auto const label = body[i].lexeme(*m_file);
+        auto const locals = std::span{ m_names }.subspan(macro.first_local);
+        if (not find_parameter(macro, label).has_value() and std::ranges::find(locals, label) == locals.end()) {
+            m_names.push_back(label);
+        }
+    }
+    macro.num_locals = m_names.size() - macro.first_local;
+
+    macro.body = TokenRange{ m_tokens.size(), m_tokens.size() + body.size() };
+    m_tokens.insert(m_tokens.end(), body.begin(), body.end());
+    if (not body.empty()) {
+        macro.source_begin = body.front().offset();
+        macro.source_end = body.back().offset() + body.back().length();
+    }
+    m_macro_indices.emplace(name, m_macros.size());
+    m_macros.push_back(macro);
+}
+
+[[nodiscard]] bool MacroExpander::is_expanding(std::string_view const name) const {
+    auto const macro = m_macro_indices.find(name);
+    return macro != m_macro_indices.end()
+           and std::ranges::any_of(m_expansions, [&](Expansion const& expansion) {
+                   return expansion.macro == macro->second;
+               });
+}
+
+[[nodiscard]] Token MacroExpander::expand(
+        Token const name,
+        std::span<Token const> const argument_tokens,
+        std::span<usize const> const argument_ends,
+        Token const lookahead
+) {
+    auto const macro_index = m_macro_indices.at(name.lexeme(*m_file));
+
+    // Arguments are identified by their spelling, apart from the local labels of enclosing expansions, which are
+    // different labels in every expansion.
+    auto key = std::string{ name.lexeme(*m_file) };
+    auto begin = usize{ 0 };
+    for (auto const end : argument_ends) {
+        key += '\n';
+        for (auto const& token : argument_tokens.subspan(begin, end - begin)) {
+            auto const local = (token.type() == TokenType::Identifier ? find_local_label(token) : none);
+            if (local.has_value()) {
+                key += std::format("@{} ", local.value());
+            } else {
+                key += token.lexeme(*m_file);
+                key += ' ';
+            }
+        }
+        begin = end;
+    }
+    if (auto const cached = m_cache_indices.find(key); cached != m_cache_indices.end()) {
+        replay(m_cache[cached->second]);
+        return lookahead;
+    }
+
+    // the lookahead is read again after the body
+    if (m_frames.empty()) {
+        m_pushed_back = lookahead;
+    } else {
+        --m_frames.back().next;
+    }
+    auto const first_token = m_tokens.size();
+    auto const first_argument = m_arguments.size();
+    begin = 0;
+    for (auto const end : argument_ends) {
+        m_arguments.push_back(TokenRange{ m_tokens.size(), m_tokens.size() + (end - begin) });
+        auto const tokens = argument_tokens.subspan(begin, end - begin);
+        m_tokens.insert(m_tokens.end(), tokens.begin(), tokens.end());
+        begin = end;
+    }
+    auto const& macro = m_macros[macro_index];
+    m_expansions.push_back(Expansion{
+            macro_index,
+            first_argument,
+            first_token,
+            std::move(key),
+            std::vector<Optional<Symbol>>(macro.num_locals, none),
+            m_recorded.size(),
+            m_generated.size(),
+            m_diagnostics->num_errors(),
+            true,
+            false,
+    });
+    m_frames.push_back(Frame{ macro.body.begin, macro.body.end, m_expansions.size() - 1 });
+    return next();
+}
+
+[[nodiscard]] Optional<ir::Instruction> MacroExpander::next_replayed() {
+    if (m_num_replayed == m_replayed.size()) {
+        return none;
+    }
+    return m_replayed[m_num_replayed++];
+}
+
+void MacroExpander::record(ir::Instruction const& instruction) {
+    if (not m_expansions.empty()) {
+        m_recorded.push_back(instruction);
+    }
+}
+
+void MacroExpander::finish_expansions() {
+    while (not m_expansions.empty() and m_expansions.back().is_finished) {
+        auto& expansion = m_expansions.back();
+        if (expansion.is_cacheable and m_diagnostics->num_errors() == expansion.num_errors) {
+            auto const instructions = std::span{ m_recorded }.subspan(expansion.first_recorded);
+            auto const labels = std::span{ m_generated }.subspan(expansion.first_generated);
+            m_cache_indices.emplace(std::move(expansion.key), m_cache.size());
+            m_cache.push_back(CachedExpansion{
+                    m_cached_instructions.size(),
+                    instructions.size(),
+                    m_cached_labels.size(),
+                    labels.size(),
+            });
+            m_cached_instructions.insert(m_cached_instructions.end(), instructions.begin(), instructions.end());
+            m_cached_labels.insert(m_cached_labels.end(), labels.begin(), labels.end());
+        }
+        // the arguments are the last tokens of the arena, since macros can't be defined within expansions
+        m_tokens.erase(m_tokens.begin() + gsl::narrow<std::ptrdiff_t>(expansion.first_token), m_tokens.end());
+        m_arguments.resize(expansion.first_argument);
+        m_expansions.pop_back();
+    }
+    if (m_expansions.empty()) {
+        m_recorded.clear();
+        m_generated.clear();
+    }
+}
+
+[[nodiscard]] Symbol MacroExpander::label_symbol(Token const token) {
+    if (auto const local = find_local_label(token); local.has_value()) {
+        return local.value();
+    }
+    return m_symbols->intern(token.lexeme(*m_file));
+}
+
+// Tokens of a macro body are told apart from the tokens of its arguments by their position in the source. Tokens of an
+// enclosing macro's body may have been passed as arguments, so all active expansions are searched.
+[[nodiscard]] Optional<Symbol> MacroExpander::find_local_label(Token const token) {
+    auto const name = token.lexeme(*m_file);
+    for (auto& expansion : m_expansions | std::views::reverse) {
+        auto const& macro = m_macros[expansion.macro];
+        if (token.offset() < macro.source_begin or token.offset() >= macro.source_end) {
+            continue;
+        }
+        auto const locals = std::span{ m_names }.subspan(macro.first_local, macro.num_locals);
+        for (usize i = 0; i < locals.size(); ++i) {
+            if (locals[i] != name) {
+                continue;
+            }
+            if (not expansion.locals.at(i).has_value()) {
+                expansion.locals.at(i) = generate_label(name);
+            }
+            return expansion.locals.at(i);
+        }
+        return none;
+    }
+    return none;
+}
+
+// like `find_local_label()`, but without generating the label
+[[nodiscard]] bool MacroExpander::is_local_label(Token const token) const {
+    auto const name = token.lexeme(*m_file);
+    for (auto const& expansion : m_expansions | std::views::reverse) {
+        auto const& macro = m_macros[expansion.macro];
+        if (token.offset() < macro.source_begin or token.offset() >= macro.source_end) {
+            continue;
+        }
+        auto const locals = std::span{ m_names }.subspan(macro.first_local, macro.num_locals);
+        return std::ranges::find(locals, name) != locals.end();
+    }
+    return false;
+}
+
+// Constants and labels of the source may change their meaning between expansions (a label that is used before being
+// defined may turn out to be a constant). Macros can't be redefined.
+[[nodiscard]] bool MacroExpander::depends_on_other_names(Token const token) const {
+    if (token.type() == TokenType::Const) {
+        return true;
+    }
+    if (token.type() != TokenType::Identifier) {
+        return false;
+    }
+    return not is_local_label(token) and not m_macro_indices.contains(token.lexeme(*m_file));
+}
+
+[[nodiscard]] Optional<usize> MacroExpander::find_parameter(Macro const& macro, std::string_view const name) const {
+    auto const parameters = std::span{ m_names }.subspan(macro.first_parameter, macro.num_parameters);
+    for (usize i = 0; i < parameters.size(); ++i) {
+        if (parameters[i] == name) {
+            return i;
+        }
+    }
+    return none;
+}
+
+// the '@' can't be part of an identifier, and the file name keeps the labels of different modules apart
+[[nodiscard]] Symbol MacroExpander::generate_label(std::string_view const name) {
+    auto const symbol = m_symbols->intern_generated(
+            std::format("{}@{}:{}", name, m_file->filename(), ++m_num_generated_labels)
+    );
+    if (not m_expansions.empty()) {
+        m_generated.push_back(GeneratedLabel{ symbol, name });
+    }
+    return symbol;
+}
+
+void MacroExpander::replay(CachedExpansion const& cached) {
+    auto const instructions =
+            std::span{ m_cached_instructions }.subspan(cached.first_instruction, cached.num_instructions);
+    auto const labels = std::span{ m_cached_labels }.subspan(cached.first_label, cached.num_labels);
+    m_fresh_labels.clear();
+    for (auto const& label : labels) {
+        m_fresh_labels.push_back(generate_label(label.name));
+    }
+    m_replayed.clear();
+    m_num_replayed = 0;
+    for (auto instruction : instructions) {
+        if (instruction.target_is_symbol) {
+            for (usize i = 0; i < labels.size(); ++i) {
+                if (labels[i].symbol == instruction.target) {
+                    instruction.target = m_fresh_labels[i];
+                    break;
+                }
+            }
+        }
+        m_replayed.push_back(instruction);
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "diagnostic_sink.hpp"
+#include "ir.hpp"
+#include "lexer.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
+#include "token.hpp"
+#include <common/types.hpp>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Sits between the lexer and the emitter and replaces the invocations of macros by their bodies.
+//
+// Macro bodies are stored as tokens, which are only spans into the source, so an expansion replays them with the
+// tokens of the arguments in place of the parameters without copying any text. Labels defined by a macro body are
+// local to each expansion (they get generated names that can't clash with the labels of the source).
+//
+// If the instructions of an expansion only depend on the macro and its arguments, they are recorded and cached per
+// argument tuple. Expanding a macro with the same arguments again copies the cached instructions (with fresh local
+// labels) instead of parsing the body again. Expansions that define constants or refer to names other than their local
+// labels and macros aren't cached, since the meaning of these names may change between expansions (and defining a
+// constant has to happen in every expansion).
+class MacroExpander final {
+private:
+    struct TokenRange {
+        usize begin; // into `m_tokens`
+        usize end;
+    };
+
+    struct Macro {
+        usize first_parameter; // into `m_names`
+        usize num_parameters;
+        usize first_local; // names of the labels the body defines, into `m_names`
+        usize num_locals;
+        TokenRange body;
+        usize source_begin; // source text of the body, to tell its tokens apart from the ones of the arguments
+        usize source_end;
+    };
+
+    // the body of an expansion or one of its arguments (arguments have already been expanded)
+    struct Frame {
+        usize next; // into `m_tokens`
+        usize end;
+        Optional<usize> expansion; // none for arguments
+    };
+
+    struct GeneratedLabel {
+        Symbol symbol;
+        std::string_view name; // of the label within the macro body
+    };
+
+    struct Expansion {
+        usize macro;
+        usize first_argument; // into `m_arguments`
+        usize first_token;    // of the arguments, everything behind it is discarded when the expansion is finished
+        std::string key;      // of the cache entry that the recorded instructions are stored in
+        std::vector<Optional<Symbol>> locals; // parallel to the macro's locals, generated on first use
+        usize first_recorded;                 // into `m_recorded`
+        usize first_generated;                // into `m_generated`
+        usize num_errors;                     // when the expansion started, erroneous expansions aren't cached
+        bool is_cacheable;                    // whether the instructions only depend on the arguments
+        bool is_finished;                     // all tokens of the body have been read
+    };
+
+    struct CachedExpansion {
+        usize first_instruction; // into `m_cached_instructions`
+        usize num_instructions;
+        usize first_label; // into `m_cached_labels`
+        usize num_labels;
+    };
+
+    SourceFile const* m_file;
+    SymbolTable* m_symbols;
+    DiagnosticSink* m_diagnostics;
+    Lexer m_lexer;
+    Optional<Token> m_pushed_back;         // lexer token that is read again after the expansion it preceded
+    std::vector<Token> m_tokens;           // arena of all macro bodies and the arguments of active expansions
+    std::vector<std::string_view> m_names; // parameters and locals of all macros
+    std::vector<Macro> m_macros;
+    std::unordered_map<std::string_view, usize> m_macro_indices;
+    std::vector<TokenRange> m_arguments;
+    std::vector<Frame> m_frames;
+    std::vector<Expansion> m_expansions;
+    std::vector<ir::Instruction> m_recorded; // instructions emitted while any expansion is active
+    std::vector<GeneratedLabel> m_generated; // local labels generated while any expansion is active
+    std::unordered_map<std::string, usize> m_cache_indices;
+    std::vector<CachedExpansion> m_cache;
+    std::vector<ir::Instruction> m_cached_instructions;
+    std::vector<GeneratedLabel> m_cached_labels;
+    std::vector<ir::Instruction> m_replayed; // copied from the cache, waiting to be passed to the emitter
+    std::vector<Symbol> m_fresh_labels;      // parallel to the cached labels of the replayed expansion
+    usize m_num_replayed = 0;
+    usize m_num_generated_labels = 0;
+
+public:
+    // the source file must outlive the expander and the returned tokens
+    MacroExpander(SourceFile const& file, SymbolTable& symbols, DiagnosticSink& diagnostics)
+        : m_file{ &file },
+          m_symbols{ &symbols },
+          m_diagnostics{ &diagnostics },
+          m_lexer{ file, diagnostics } { }
+
+    // the next token of the source, with the bodies of expanding macros in place of their invocations
+    [[nodiscard]] Token next();
+
+    [[nodiscard]] Optional<usize> num_parameters(std::string_view name) const;
+
+    // `body` consists of whole lines
+    void define(std::string_view name, std::span<Token const> parameters, std::span<Token const> body);
+
+    // whether the tokens that are read belong to an expansion of the macro `name`
+    [[nodiscard]] bool is_expanding(std::string_view name) const;
+
+    // Starts expanding the macro `name` (which has to be defined and must not be expanding). The arguments are given
+    // by the tokens of all of them and the end of each one within these. `lookahead` is the token the emitter holds,
+    // it's read again after the body. Returns the token the emitter has to hold instead.
+    [[nodiscard]] Token expand(
+            Token name,
+            std::span<Token const> argument_tokens,
+            std::span<usize const> argument_ends,
+            Token lookahead
+    );
+
+    // instructions of an expansion that have been copied from the cache, they precede the remaining tokens
+    [[nodiscard]] Optional<ir::Instruction> next_replayed();
+
+    // every instruction the emitter produces has to pass through here, so that expansions can be cached
+    void record(ir::Instruction const& instruction);
+
+    // caches the expansions whose bodies have been read completely, once their last instruction has been recorded
+    void finish_expansions();
+
+    // the symbol of a label, which is generated for each expansion if the macro body defines the label
+    [[nodiscard]] Symbol label_symbol(Token token);
+
+private:
+    [[nodiscard]] Optional<Symbol> find_local_label(Token token);
+    [[nodiscard]] bool is_local_label(Token token) const;
+    [[nodiscard]] bool depends_on_other_names(Token token) const;
+    [[nodiscard]] Optional<usize> find_parameter(Macro const& macro, std::string_view name) const;
+    [[nodiscard]] Symbol generate_label(std::string_view name);
+    void replay(CachedExpansion const& cached);
+};
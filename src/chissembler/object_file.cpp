@@ -0,0 +1,124 @@
+#include "object_file.hpp"
+#include <algorithm>
+#include <common/little_endian.hpp>
+#include <concepts>
+#include <format>
+#include <gsl/gsl>
+#include <utility>
+
+namespace chissembler {
+    namespace {
+        void append_bytes(std::vector<std::byte>& buffer, std::span<std::byte const> const bytes) {
+            append_little_endian(buffer, gsl::narrow<u32>(bytes.size()));
+            buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+        }
+
+        // reads the fields of an object file one after another, every read is bounds checked
+        class Reader final {
+        private:
+            std::span<std::byte const> m_data;
+            usize m_offset = 0;
+
+        public:
+            explicit Reader(std::span<std::byte const> const data) : m_data{ data } { }
+
+            template<std::unsigned_integral T>
+            [[nodiscard]] T read() {
+                return read_little_endian<T>(take(sizeof(T)), 0);
+            }
+
+            // a u32 length followed by that many bytes
+            [[nodiscard]] std::span<std::byte const> read_bytes() {
+                return take(read<u32>());
+            }
+
+            [[nodiscard]] std::span<std::byte const> take(usize const size) {
+                if (size > m_data.size() - m_offset) {
+                    throw ObjectFileError{ "truncated object file" };
+                }
+                auto const result = m_data.subspan(m_offset, size);
+                m_offset += size;
+                return result;
+            }
+
+            [[nodiscard]] bool is_at_end() const {
+                return m_offset == m_data.size();
+            }
+        };
+    } // namespace
+
+    [[nodiscard]] std::vector<std::byte> write_object(ObjectFile const& object) {
+        auto result = std::vector<std::byte>{};
+        for (auto const c : object_file_magic) {
+            result.push_back(static_cast<std::byte>(c));
+        }
+        append_little_endian(result, object_file_version);
+        append_bytes(result, object.code);
+
+        append_little_endian(result, gsl::narrow<u32>(object.symbols.size()));
+        for (auto const& symbol : object.symbols) {
+            append_bytes(result, std::as_bytes(std::span{ symbol.name }));
+            append_little_endian(result, static_cast<u8>(symbol.offset.has_value()));
+            append_little_endian(result, symbol.offset.value_or(0));
+        }
+
+        append_little_endian(result, gsl::narrow<u32>(object.relocations.size()));
+        for (auto const& relocation : object.relocations) {
+            append_little_endian(result, relocation.code_offset);
+            append_little_endian(result, relocation.symbol);
+            append_little_endian(result, static_cast<u32>(relocation.addend));
+        }
+        return result;
+    }
+
+    [[nodiscard]] ObjectFile read_object(std::string name, std::span<std::byte const> const data) {
+        auto reader = Reader{ data };
+        auto const magic = reader.take(object_file_magic.size());
+        auto const has_magic = std::ranges::equal(magic, object_file_magic, {}, {}, [](char const c) {
+            return static_cast<std::byte>(c);
+        });
+        if (not has_magic) {
+            throw ObjectFileError{ std::format("'{}' is not an object file", name) };
+        }
+        if (auto const version = reader.read<u32>(); version != object_file_version) {
+            throw ObjectFileError{ std::format("object file '{}' has unsupported version {}", name, version) };
+        }
+
+        auto result = ObjectFile{};
+        result.name = std::move(name);
+        auto const code = reader.read_bytes();
+        result.code.assign(code.begin(), code.end());
+
+        auto const num_symbols = reader.read<u32>();
+        for (u32 i = 0; i < num_symbols; ++i) {
+            auto const symbol_name = reader.read_bytes();
+            auto const is_defined = reader.read<u8>() != 0;
+            auto const offset = reader.read<u32>();
+            if (is_defined and offset > result.code.size()) {
+                throw ObjectFileError{ std::format("symbol offset of object file '{}' is out of range", result.name) };
+            }
+            auto& symbol = result.symbols.emplace_back(ObjectSymbol{
+                    std::string{ reinterpret_cast<char const*>(symbol_name.data()), symbol_name.size() },
+                    none,
+            });
+            if (is_defined) {
+                symbol.offset = offset;
+            }
+        }
+
+        auto const num_relocations = reader.read<u32>();
+        for (u32 i = 0; i < num_relocations; ++i) {
+            auto const relocation =
+                    ObjectRelocation{ reader.read<u32>(), reader.read<u32>(), static_cast<i32>(reader.read<u32>()) };
+            if (usize{ relocation.code_offset } + 2 > result.code.size() or relocation.symbol >= num_symbols) {
+                throw ObjectFileError{ std::format("relocation of object file '{}' is out of range", result.name) };
+            }
+            result.relocations.push_back(relocation);
+        }
+
+        if (not reader.is_at_end()) {
+            throw ObjectFileError{ std::format("object file '{}' has trailing data", result.name) };
+        }
+        return result;
+    }
+} // namespace chissembler
@@ -0,0 +1,388 @@
+#include "optimizer.hpp"
+#include "encoder.hpp"
+#include "source_location.hpp"
+#include <common/trace.hpp>
+#include <format>
+#include <limits>
+#include <string>
+#include <utility>
+
+namespace {
+    constexpr auto no_index = std::numeric_limits<usize>::max();
+
+    [[nodiscard]] std::string destination_name(ir::Instruction const& instruction) {
+        return std::format("V{:X}", std::to_underlying(instruction.destination));
+    }
+
+    [[nodiscard]] std::string_view describe(ir::Instruction const& instruction) {
+        return instruction.opcode == ir::Opcode::SubImmediate ? "subtraction" : "addition";
+    }
+
+    // the value added by an immediate addition or subtraction, modulo 256
+    [[nodiscard]] u8 immediate_delta(ir::Instruction const& instruction) {
+        if (instruction.opcode == ir::Opcode::SubImmediate) {
+            return static_cast<u8>(256 - instruction.source);
+        }
+        return instruction.source;
+    }
+
+    class Optimizer final {
+    private:
+        SourceFile const* m_file;
+        SymbolTable const* m_symbols;
+        std::vector<ir::Instruction>* m_instructions;
+        std::vector<chissembler::Diagnostic>* m_report;
+        std::vector<usize> m_label_indices; // indexed by symbol
+        std::vector<usize> m_num_label_uses; // indexed by symbol
+        usize m_first_pinned_index = no_index;
+        bool m_has_label_errors = false;
+
+    public:
+        Optimizer(
+                SourceFile const& file,
+                SymbolTable const& symbols,
+                std::vector<ir::Instruction>& instructions,
+                std::vector<chissembler::Diagnostic>* const report
+        )
+            : m_file{ &file },
+              m_symbols{ &symbols },
+              m_instructions{ &instructions },
+              m_report{ report } { }
+
+        void run() {
+            if (has_fixed_addresses()) {
+                return;
+            }
+            index_labels();
+            if (m_has_label_errors) {
+                return; // removing code could hide them from the encoder
+            }
+            for (auto changed = true; changed;) {
+                index_labels();
+                changed = thread_jumps();
+                changed = rewrite() or changed;
+                index_labels();
+                changed = remove_unreachable_code() or changed;
+                index_labels();
+                changed = remove_unused_labels() or changed;
+            }
+        }
+
+    private:
+        // whether the program refers to addresses that would change when instructions are moved, data is never
+        // reached by any jump but must not be removed either
+        [[nodiscard]] bool has_fixed_addresses() {
+            auto program_size = usize{ 0 };
+            for (auto const& instruction : *m_instructions) {
+                program_size += instruction.size();
+            }
+            auto const program_end = program_start_address + program_size;
+            for (auto const& instruction : *m_instructions) {
+                if (instruction.is_data()) {
+                    note(instruction, "program is not optimized because it contains data");
+                    return true;
+                }
+                if (instruction.opcode != ir::Opcode::Jump and instruction.opcode != ir::Opcode::JumpWithOffset
+                    and instruction.opcode != ir::Opcode::SetAddressRegister) {
+                    continue;
+                }
+                auto const what =
+                        (instruction.opcode == ir::Opcode::SetAddressRegister ? "the address" : "the jump to");
+                // A jump with offset may land up to 255 bytes behind its target. Addresses outside of the program
+                // (like the spill area of the register allocator) stay valid when the program shrinks.
+                auto const max_offset = (instruction.opcode == ir::Opcode::JumpWithOffset ? u32{ 0xFF } : u32{ 0 });
+                if (not instruction.target_is_symbol and instruction.target + max_offset >= program_start_address
+                    and instruction.target < program_end) {
+                    auto const target = instruction.target;
+                    note(instruction, std::format("program is not optimized because of {} 0x{:03X}", what, target));
+                    return true;
+                }
+                if (auto const addend = instruction.target_addend(); instruction.target_is_symbol and addend != 0) {
+                    auto const label = m_symbols->name(instruction.target);
+                    auto const message = std::format(
+                            "program is not optimized because of {} '{}{}'",
+                            what,
+                            label,
+                            format_addend(addend)
+                    );
+                    note(instruction, message);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void index_labels() {
+            auto const& instructions = *m_instructions;
+            auto is_offset_target = std::vector<bool>(m_symbols->size(), false);
+            m_num_label_uses.assign(m_symbols->size(), 0);
+            for (auto const& instruction : instructions) {
+                if (not instruction.emits_code() or not instruction.target_is_symbol) {
+                    continue;
+                }
+                ++m_num_label_uses.at(instruction.target);
+                if (instruction.opcode == ir::Opcode::JumpWithOffset) {
+                    is_offset_target[instruction.target] = true;
+                }
+            }
+
+            m_label_indices.assign(m_symbols->size(), no_index);
+            m_first_pinned_index = no_index;
+            m_has_label_errors = false;
+            for (usize i = 0; i < instructions.size(); ++i) {
+                if (instructions[i].opcode != ir::Opcode::Label) {
+                    continue;
+                }
+                auto const symbol = instructions[i].target;
+                if (m_label_indices.at(symbol) != no_index) {
+                    m_has_label_errors = true; // duplicate
+                    continue;
+                }
+                m_label_indices[symbol] = i;
+                if (is_offset_target[symbol] and m_first_pinned_index == no_index) {
+                    m_first_pinned_index = i;
+                }
+            }
+            for (Symbol symbol = 0; symbol < m_symbols->size(); ++symbol) {
+                if (m_num_label_uses[symbol] > 0 and m_label_indices[symbol] == no_index) {
+                    m_has_label_errors = true; // unknown
+                }
+            }
+        }
+
+        // index of the first instruction at or after `index` that emits code
+        [[nodiscard]] usize next_code_index(usize index) const {
+            auto const& instructions = *m_instructions;
+            while (index < instructions.size() and not instructions[index].emits_code()) {
+                ++index;
+            }
+            return index;
+        }
+
+        // where execution continues after jumping to the label, none if it's unknown
+        [[nodiscard]] Optional<usize> label_destination(Symbol const symbol) const {
+            auto const label_index = m_label_indices.at(symbol);
+            if (label_index == no_index) {
+                return none; // unknown labels are reported by the encoder
+            }
+            auto const destination = next_code_index(label_index);
+            if (destination == m_instructions->size()) {
+                return none;
+            }
+            return destination;
+        }
+
+        [[nodiscard]] bool thread_jumps() {
+            auto& instructions = *m_instructions;
+            auto changed = false;
+            for (auto& instruction : instructions) {
+                if (instruction.opcode != ir::Opcode::Jump or not instruction.target_is_symbol) {
+                    continue;
+                }
+                auto target = instruction.target;
+                auto num_steps = usize{ 0 };
+                for (auto destination = label_destination(target); destination.has_value();
+                     destination = label_destination(target)) {
+                    auto const& next = instructions[destination.value()];
+                    if (next.opcode != ir::Opcode::Jump or not next.target_is_symbol or next.target == target) {
+                        break;
+                    }
+                    if (++num_steps > instructions.size()) {
+                        target = instruction.target; // the jumps form a cycle, any of them is as good as the others
+                        break;
+                    }
+                    target = next.target;
+                }
+                if (target == instruction.target) {
+                    continue;
+                }
+                auto const from = m_symbols->name(instruction.target);
+                note(instruction, std::format("jump to '{}' threaded through to '{}'", from, m_symbols->name(target)));
+                instruction.target = target;
+                instruction.target_offset = 0; // the instruction doesn't mention the new target's name
+                changed = true;
+            }
+            return changed;
+        }
+
+        [[nodiscard]] bool rewrite() {
+            auto const& instructions = *m_instructions;
+            auto result = std::vector<ir::Instruction>{};
+            result.reserve(instructions.size());
+            for (usize i = 0; i < instructions.size(); ++i) {
+                auto const& instruction = instructions[i];
+                if (i < m_first_pinned_index and try_rewrite(i, result)) {
+                    continue;
+                }
+                result.push_back(instruction);
+            }
+            auto const changed = result.size() != instructions.size();
+            *m_instructions = std::move(result);
+            return changed;
+        }
+
+        // Walks the control flow graph from the first instruction. Execution continues with the next instruction unless
+        // it's a jump. A jump with offset may land anywhere behind its target label.
+        [[nodiscard]] std::vector<bool> find_reachable_instructions() const {
+            auto const& instructions = *m_instructions;
+            auto is_reachable = std::vector<bool>(instructions.size(), false);
+            auto pending = std::vector<usize>{ 0 };
+            while (not pending.empty()) {
+                auto index = pending.back();
+                pending.pop_back();
+                for (; index < instructions.size() and not is_reachable[index]; ++index) {
+                    is_reachable[index] = true;
+                    auto const& instruction = instructions[index];
+                    if (instruction.opcode != ir::Opcode::Jump and instruction.opcode != ir::Opcode::JumpWithOffset) {
+                        continue;
+                    }
+                    if (instruction.target_is_symbol) {
+                        auto const label_index = m_label_indices.at(instruction.target);
+                        pending.push_back(label_index);
+                        if (instruction.opcode == ir::Opcode::JumpWithOffset) {
+                            for (auto i = label_index + 1; i < instructions.size(); ++i) {
+                                pending.push_back(i);
+                            }
+                        }
+                    }
+                    break;
+                }
+            }
+            return is_reachable;
+        }
+
+        [[nodiscard]] bool remove_unreachable_code() {
+            auto const& instructions = *m_instructions;
+            auto const is_reachable = find_reachable_instructions();
+            auto result = std::vector<ir::Instruction>{};
+            result.reserve(instructions.size());
+            auto first_removed = Optional<usize>{}; // of the current run of unreachable instructions
+            auto num_removed = usize{ 0 };
+            auto const report_run = [&] {
+                if (first_removed.has_value()) {
+                    auto const plural = (num_removed == 1 ? "" : "s");
+                    auto message = std::format("removed {} unreachable instruction{}", num_removed, plural);
+                    note(instructions[first_removed.value()], std::move(message));
+                }
+                first_removed = none;
+                num_removed = 0;
+            };
+
+            for (usize i = 0; i < instructions.size(); ++i) {
+                auto const& instruction = instructions[i];
+                // labels don't end a run, the unused ones are removed afterwards
+                if (is_reachable[i] or i >= m_first_pinned_index or not instruction.emits_code()) {
+                    if (instruction.emits_code()) {
+                        report_run();
+                    }
+                    result.push_back(instruction);
+                    continue;
+                }
+                if (not first_removed.has_value()) {
+                    first_removed = i;
+                }
+                ++num_removed;
+            }
+            report_run();
+
+            auto const changed = result.size() != instructions.size();
+            *m_instructions = std::move(result);
+            return changed;
+        }
+
+        [[nodiscard]] bool remove_unused_labels() {
+            auto const& instructions = *m_instructions;
+            auto result = std::vector<ir::Instruction>{};
+            result.reserve(instructions.size());
+            for (auto const& instruction : instructions) {
+                if (instruction.opcode == ir::Opcode::Label and m_num_label_uses.at(instruction.target) == 0) {
+                    note(instruction, std::format("removed unused label '{}'", m_symbols->name(instruction.target)));
+                    continue;
+                }
+                result.push_back(instruction);
+            }
+            auto const changed = result.size() != instructions.size();
+            *m_instructions = std::move(result);
+            return changed;
+        }
+
+        // returns whether the instruction has been removed or merged into the last one of `result`
+        [[nodiscard]] bool try_rewrite(usize const index, std::vector<ir::Instruction>& result) {
+            auto const& instruction = (*m_instructions)[index];
+            switch (instruction.opcode) {
+                case ir::Opcode::CopyRegister:
+                    if (instruction.source_register() != instruction.destination) {
+                        return false;
+                    }
+                    note(instruction, std::format("removed copy of {} into itself", destination_name(instruction)));
+                    return true;
+                case ir::Opcode::AddImmediate:
+                case ir::Opcode::SubImmediate: {
+                    if (instruction.source == 0) {
+                        note(instruction, std::format("removed {} of 0", describe(instruction)));
+                        return true;
+                    }
+                    // labels are part of `result` as well, so no jump can land between the two instructions
+                    if (result.empty() or result.back().destination != instruction.destination) {
+                        return false;
+                    }
+                    auto& previous = result.back();
+                    if (previous.opcode == ir::Opcode::CopyImmediate) {
+                        previous.source = static_cast<u8>(previous.source + immediate_delta(instruction));
+                        note(instruction, std::format("folded into the copy into {}", destination_name(instruction)));
+                        return true;
+                    }
+                    if (previous.opcode != ir::Opcode::AddImmediate and previous.opcode != ir::Opcode::SubImmediate) {
+                        return false;
+                    }
+                    auto const delta = static_cast<u8>(immediate_delta(previous) + immediate_delta(instruction));
+                    if (delta == 0) {
+                        result.pop_back();
+                        note(instruction, std::format("removed {} along with its inverse", describe(instruction)));
+                        return true;
+                    }
+                    previous.opcode = ir::Opcode::AddImmediate;
+                    previous.source = delta;
+                    note(instruction, std::format("merged with the addition to {}", destination_name(instruction)));
+                    return true;
+                }
+                case ir::Opcode::Jump: {
+                    if (not instruction.target_is_symbol) {
+                        return false;
+                    }
+                    auto const label_index = m_label_indices.at(instruction.target);
+                    if (label_index == no_index or label_index < index or next_code_index(index + 1) < label_index) {
+                        return false;
+                    }
+                    auto const target = m_symbols->name(instruction.target);
+                    note(instruction, std::format("removed jump to '{}', which is the next instruction", target));
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        void note(ir::Instruction const& instruction, std::string message) {
+            if (m_report == nullptr) {
+                return;
+            }
+            m_report->push_back(
+                    SourceLocation{ *m_file, instruction.source_offset, instruction.source_length }.diagnostic(
+                            std::move(message)
+                    )
+            );
+        }
+    };
+} // namespace
+
+void optimize(
+        SourceFile const& file,
+        SymbolTable const& symbols,
+        std::vector<ir::Instruction>& instructions,
+        std::vector<chissembler::Diagnostic>* const report
+) {
+    TRACE_SCOPE("optimize instructions");
+    auto optimizer = Optimizer{ file, symbols, instructions, report };
+    optimizer.run();
+}
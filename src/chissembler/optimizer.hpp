@@ -0,0 +1,27 @@
+#pragma once
+
+#include "errors.hpp"
+#include "ir.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
+#include <vector>
+
+// Optimizations on the IR of a whole program:
+//   - copies of a register into itself and additions of 0 are removed
+//   - consecutive immediate additions and subtractions on the same register are merged
+//   - an immediate addition or subtraction right after an immediate copy is folded into the copy
+//   - jumps to jumps are threaded to the final target, jumps to the next instruction are removed
+//   - instructions that can't be reached from the first one (following the jumps) are removed, as well as labels
+//     that are no jump's target
+// Instructions are only merged if no label lies between them. Since removing instructions moves everything behind
+// them, the program is left as it is if it jumps to (or sets I to) an absolute address within itself or an offset from
+// a label, and nothing is removed from the first label used by a jump with offset (which may address a jump table)
+// onwards. Programs that contain data aren't optimized either.
+// Programs with unknown or duplicate labels aren't optimized, so that the encoder reports all of them.
+// Every change is appended to `report` if it's set.
+void optimize(
+        SourceFile const& file,
+        SymbolTable const& symbols,
+        std::vector<ir::Instruction>& instructions,
+        std::vector<chissembler::Diagnostic>* report
+);
@@ -0,0 +1,506 @@
+#include "register_allocator.hpp"
+#include "encoder.hpp"
+#include "errors.hpp"
+#include "source_location.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <common/trace.hpp>
+#include <format>
+#include <gsl/gsl>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace {
+    constexpr auto no_index = std::numeric_limits<usize>::max();
+    constexpr auto no_color = std::numeric_limits<u8>::max();
+    constexpr auto num_data_registers = usize{ 16 };
+    constexpr auto flag_register = DataRegister::VF;
+    constexpr auto memory_end = usize{ 0x1000 };
+
+    // The value lives in the second byte. Storing V1 writes V0 into the first one, since FX55 always starts at V0.
+    constexpr auto spill_slot_size = usize{ 2 };
+
+    // set of virtual registers, identified by their dense index
+    class RegisterSet final {
+    private:
+        std::vector<u64> m_words;
+
+    public:
+        explicit RegisterSet(usize const size) : m_words((size + 63) / 64, u64{ 0 }) { }
+
+        [[nodiscard]] bool contains(usize const index) const {
+            return ((m_words[index / 64] >> (index % 64)) & 1) != 0;
+        }
+
+        void insert(usize const index) {
+            m_words[index / 64] |= u64{ 1 } << (index % 64);
+        }
+
+        void erase(usize const index) {
+            m_words[index / 64] &= ~(u64{ 1 } << (index % 64));
+        }
+
+        // returns whether any register has been added
+        bool unite(RegisterSet const& other) {
+            auto changed = false;
+            for (usize i = 0; i < m_words.size(); ++i) {
+                auto const united = m_words[i] | other.m_words[i];
+                changed = changed or united != m_words[i];
+                m_words[i] = united;
+            }
+            return changed;
+        }
+
+        void for_each(auto const& function) const {
+            for (usize i = 0; i < m_words.size(); ++i) {
+                for (auto word = m_words[i]; word != 0; word &= word - 1) {
+                    function(i * 64 + static_cast<usize>(std::countr_zero(word)));
+                }
+            }
+        }
+
+        [[nodiscard]] friend bool operator==(RegisterSet const&, RegisterSet const&) = default;
+    };
+
+    class RegisterAllocator final {
+    private:
+        SourceFile const* m_file;
+        SymbolTable const* m_symbols;
+        std::vector<ir::Instruction>* m_instructions;
+        DiagnosticSink* m_diagnostics;
+        std::vector<usize> m_virtual_indices; // indexed by symbol, `no_index` if the symbol is no virtual register
+        std::vector<Symbol> m_virtual_symbols; // indexed by virtual register
+        std::vector<usize> m_label_indices;    // indexed by symbol
+        std::array<bool, num_data_registers> m_is_used_directly = {};
+        bool m_sets_address_register = false;
+
+    public:
+        RegisterAllocator(
+                SourceFile const& file,
+                SymbolTable const& symbols,
+                std::vector<ir::Instruction>& instructions,
+                DiagnosticSink& diagnostics
+        )
+            : m_file{ &file },
+              m_symbols{ &symbols },
+              m_instructions{ &instructions },
+              m_diagnostics{ &diagnostics } { }
+
+        void run() {
+            collect_virtual_registers();
+            if (m_virtual_symbols.empty() or not analyze_program()) {
+                return;
+            }
+            auto const interference = build_interference_graph(analyze_liveness());
+            auto const costs = count_occurrences();
+
+            auto pool = std::vector<DataRegister>{};
+            for (usize i = 0; i < num_data_registers; ++i) {
+                if (static_cast<DataRegister>(i) != flag_register and not m_is_used_directly[i]) {
+                    pool.push_back(static_cast<DataRegister>(i));
+                }
+            }
+            auto is_spilled = std::vector<bool>(m_virtual_symbols.size(), false);
+            auto colors = color(interference, costs, pool, is_spilled);
+            if (std::find(colors.begin(), colors.end(), no_color) != colors.end()) {
+                // V0 and V1 are needed to transfer the spilled registers, all others are colored again without them
+                if (m_is_used_directly[0] or m_is_used_directly[1]) {
+                    report_missing_spill_registers(colors, "spilling requires V0 and V1, which are used directly");
+                    return;
+                }
+                if (m_sets_address_register) {
+                    report_missing_spill_registers(colors, "spilling requires I, which is set directly");
+                    return;
+                }
+                std::erase(pool, DataRegister::V0);
+                std::erase(pool, DataRegister::V1);
+                for (auto has_new_spills = true; has_new_spills;) {
+                    colors = color(interference, costs, pool, is_spilled);
+                    has_new_spills = false;
+                    for (usize i = 0; i < colors.size(); ++i) {
+                        if (colors[i] == no_color and not is_spilled[i]) {
+                            is_spilled[i] = true;
+                            has_new_spills = true;
+                        }
+                    }
+                }
+            }
+            rewrite(colors);
+        }
+
+    private:
+        void collect_virtual_registers() {
+            m_virtual_indices.assign(m_symbols->size(), no_index);
+            auto const add = [&](Optional<Symbol> const symbol) {
+                if (symbol.has_value() and m_virtual_indices.at(symbol.value()) == no_index) {
+                    m_virtual_indices[symbol.value()] = m_virtual_symbols.size();
+                    m_virtual_symbols.push_back(symbol.value());
+                }
+            };
+            for (auto const& instruction : *m_instructions) {
+                if (instruction.has_virtual_registers()) {
+                    add(instruction.virtual_destination());
+                    add(instruction.virtual_source());
+                }
+            }
+        }
+
+        // finds the labels and the data registers that are used directly, returns false if the control flow can't
+        // be determined
+        [[nodiscard]] bool analyze_program() {
+            m_label_indices.assign(m_symbols->size(), no_index);
+            auto const& instructions = *m_instructions;
+            for (usize i = 0; i < instructions.size(); ++i) {
+                auto const& instruction = instructions[i];
+                switch (instruction.opcode) {
+                    case ir::Opcode::Label:
+                        if (m_label_indices.at(instruction.target) == no_index) { // duplicates are reported later
+                            m_label_indices[instruction.target] = i;
+                        }
+                        break;
+                    case ir::Opcode::Jump:
+                    case ir::Opcode::JumpWithOffset: {
+                        if (instruction.opcode == ir::Opcode::JumpWithOffset) {
+                            m_is_used_directly[0] = true;
+                        }
+                        // a jump with offset may land up to 255 bytes behind its target
+                        auto const max_offset =
+                                (instruction.opcode == ir::Opcode::JumpWithOffset ? u32{ 0xFF } : u32{ 0 });
+                        if (not instruction.target_is_symbol
+                            and instruction.target + max_offset >= program_start_address) {
+                            m_diagnostics->report(chissembler::EmitterError{ location(instruction).diagnostic(
+                                    "virtual registers can't be combined with jumps to absolute addresses within the "
+                                    "program"
+                            ) });
+                            return false;
+                        }
+                        if (instruction.target_is_symbol and instruction.target_addend() != 0) {
+                            m_diagnostics->report(chissembler::EmitterError{ location(instruction).diagnostic(
+                                    "virtual registers can't be combined with jumps to offsets from labels"
+                            ) });
+                            return false;
+                        }
+                        break;
+                    }
+                    case ir::Opcode::SetAddressRegister:
+                        m_sets_address_register = true;
+                        break;
+                    default:
+                        if (not instruction.has_register_operands()) {
+                            break;
+                        }
+                        if (not instruction.virtual_destination().has_value()) {
+                            m_is_used_directly.at(std::to_underlying(instruction.destination)) = true;
+                        }
+                        if (instruction.reads_source_register() and not instruction.virtual_source().has_value()) {
+                            m_is_used_directly.at(instruction.source) = true;
+                        }
+                        break;
+                }
+            }
+            return true;
+        }
+
+        // the virtual registers that are live on entry of each instruction (iterated backwards until stable)
+        [[nodiscard]] std::vector<RegisterSet> analyze_liveness() const {
+            auto const& instructions = *m_instructions;
+            auto const num_virtual_registers = m_virtual_symbols.size();
+            auto live_in = std::vector<RegisterSet>(instructions.size(), RegisterSet{ num_virtual_registers });
+            auto live_out = RegisterSet{ num_virtual_registers };
+            for (auto changed = true; changed;) {
+                changed = false;
+                for (auto i = instructions.size(); i-- > 0;) {
+                    auto const& instruction = instructions[i];
+                    live_out = RegisterSet{ num_virtual_registers };
+                    for_each_successor(i, [&](usize const successor) { live_out.unite(live_in[successor]); });
+
+                    auto live = live_out;
+                    if (auto const destination = virtual_destination(instruction); destination != no_index) {
+                        live.erase(destination);
+                        if (instruction.reads_destination()) {
+                            live.insert(destination);
+                        }
+                    }
+                    if (auto const source = virtual_source(instruction); source != no_index) {
+                        live.insert(source);
+                    }
+                    if (live != live_in[i]) {
+                        live_in[i] = std::move(live);
+                        changed = true;
+                    }
+                }
+            }
+            return live_in;
+        }
+
+        void for_each_successor(usize const index, auto const& function) const {
+            auto const& instructions = *m_instructions;
+            auto const& instruction = instructions[index];
+            switch (instruction.opcode) {
+                case ir::Opcode::Jump:
+                case ir::Opcode::JumpWithOffset: {
+                    if (not instruction.target_is_symbol) {
+                        return; // leaves the program
+                    }
+                    auto const label_index = m_label_indices.at(instruction.target);
+                    if (label_index == no_index) {
+                        return; // unknown labels are reported by the encoder
+                    }
+                    // a jump with offset may land on any instruction behind its target
+                    auto const last_index =
+                            (instruction.opcode == ir::Opcode::Jump ? label_index + 1 : instructions.size());
+                    for (auto i = label_index; i < last_index; ++i) {
+                        function(i);
+                    }
+                    return;
+                }
+                default:
+                    if (index + 1 < instructions.size()) {
+                        function(index + 1);
+                    }
+                    return;
+            }
+        }
+
+        // Two virtual registers interfere if they are live on entry of the same instruction or if one of them is
+        // written while the other one stays live (unless the write copies the other one).
+        [[nodiscard]] std::vector<RegisterSet> build_interference_graph(std::vector<RegisterSet> const& live_in) const {
+            auto const& instructions = *m_instructions;
+            auto const num_virtual_registers = m_virtual_symbols.size();
+            auto result = std::vector<RegisterSet>(num_virtual_registers, RegisterSet{ num_virtual_registers });
+            for (usize i = 0; i < instructions.size(); ++i) {
+                live_in[i].for_each([&](usize const live) { result[live].unite(live_in[i]); });
+
+                auto const destination = virtual_destination(instructions[i]);
+                if (destination == no_index) {
+                    continue;
+                }
+                auto const is_copy = (instructions[i].opcode == ir::Opcode::CopyRegister);
+                auto const copied = (is_copy ? virtual_source(instructions[i]) : no_index);
+                for_each_successor(i, [&](usize const successor) {
+                    live_in[successor].for_each([&](usize const live) {
+                        if (live != copied) {
+                            result[destination].insert(live);
+                            result[live].insert(destination);
+                        }
+                    });
+                });
+            }
+            for (usize i = 0; i < num_virtual_registers; ++i) {
+                result[i].erase(i);
+            }
+            return result;
+        }
+
+        // the number of reads and writes, which is what spilling a register costs
+        [[nodiscard]] std::vector<usize> count_occurrences() const {
+            auto result = std::vector<usize>(m_virtual_symbols.size(), 0);
+            for (auto const& instruction : *m_instructions) {
+                if (auto const destination = virtual_destination(instruction); destination != no_index) {
+                    ++result[destination];
+                }
+                if (auto const source = virtual_source(instruction); source != no_index) {
+                    ++result[source];
+                }
+            }
+            return result;
+        }
+
+        // Simplifies the graph by removing registers with fewer neighbors than there are colors, if there are none
+        // the cheapest register relative to its number of neighbors is removed optimistically. The registers are
+        // colored in reverse order, the ones that can't be colored get `no_color`.
+        [[nodiscard]] static std::vector<u8> color(
+                std::vector<RegisterSet> const& interference,
+                std::vector<usize> const& costs,
+                std::vector<DataRegister> const& pool,
+                std::vector<bool> const& is_spilled
+        ) {
+            auto const num_registers = interference.size();
+            auto is_removed = is_spilled;
+            auto degrees = std::vector<usize>(num_registers, 0);
+            auto num_remaining = usize{ 0 };
+            for (usize i = 0; i < num_registers; ++i) {
+                if (is_removed[i]) {
+                    continue;
+                }
+                ++num_remaining;
+                interference[i].for_each([&](usize const neighbor) {
+                    if (not is_removed[neighbor]) {
+                        ++degrees[i];
+                    }
+                });
+            }
+
+            auto stack = std::vector<usize>{};
+            stack.reserve(num_remaining);
+            for (; num_remaining > 0; --num_remaining) {
+                auto chosen = no_index;
+                for (usize i = 0; i < num_registers and chosen == no_index; ++i) {
+                    if (not is_removed[i] and degrees[i] < pool.size()) {
+                        chosen = i;
+                    }
+                }
+                if (chosen == no_index) {
+                    for (usize i = 0; i < num_registers; ++i) {
+                        // cost / (degree + 1) < chosen cost / (chosen degree + 1)
+                        if (not is_removed[i]
+                            and (chosen == no_index
+                                 or costs[i] * (degrees[chosen] + 1) < costs[chosen] * (degrees[i] + 1))) {
+                            chosen = i;
+                        }
+                    }
+                }
+                stack.push_back(chosen);
+                is_removed[chosen] = true;
+                interference[chosen].for_each([&](usize const neighbor) {
+                    if (not is_removed[neighbor]) {
+                        --degrees[neighbor];
+                    }
+                });
+            }
+
+            auto result = std::vector<u8>(num_registers, no_color);
+            for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+                auto is_taken = std::array<bool, num_data_registers>{};
+                interference[*it].for_each([&](usize const neighbor) {
+                    if (result[neighbor] != no_color) {
+                        is_taken.at(result[neighbor]) = true;
+                    }
+                });
+                for (auto const data_register : pool) {
+                    if (not is_taken.at(std::to_underlying(data_register))) {
+                        result[*it] = std::to_underlying(data_register);
+                        break;
+                    }
+                }
+            }
+            return result;
+        }
+
+        void report_missing_spill_registers(std::vector<u8> const& colors, std::string_view const reason) {
+            for (auto const& instruction : *m_instructions) {
+                for (auto const index : { virtual_destination(instruction), virtual_source(instruction) }) {
+                    if (index != no_index and colors[index] == no_color) {
+                        m_diagnostics->report(chissembler::EmitterError{ location(instruction).diagnostic(std::format(
+                                "not enough data registers for '{}' ({})",
+                                m_symbols->name(m_virtual_symbols[index]),
+                                reason
+                        )) });
+                        return;
+                    }
+                }
+            }
+        }
+
+        void rewrite(std::vector<u8> const& colors) {
+            auto slot_addresses = std::vector<usize>(colors.size(), 0); // of the value byte
+            auto num_spilled = usize{ 0 };
+            for (auto const color : colors) {
+                num_spilled += (color == no_color ? usize{ 1 } : usize{ 0 });
+            }
+            auto const spill_area = memory_end - num_spilled * spill_slot_size;
+            for (usize i = 0, slot = 0; i < colors.size(); ++i) {
+                if (colors[i] == no_color) {
+                    slot_addresses[i] = spill_area + slot++ * spill_slot_size + 1;
+                }
+            }
+
+            auto const& instructions = *m_instructions;
+            auto result = std::vector<ir::Instruction>{};
+            result.reserve(instructions.size());
+            // FX65 loads V0 up to VX, so a register is loaded into V1 by loading the byte in front of it into V0
+            auto const transfer = [&](
+                    ir::Opcode const opcode, ir::Instruction const& origin, usize const index, u8 const scratch
+            ) {
+                auto address = origin;
+                address.opcode = ir::Opcode::SetAddressRegister;
+                address.target = gsl::narrow<u32>(slot_addresses[index] - scratch);
+                result.push_back(address);
+                auto transfer_instruction = origin;
+                transfer_instruction.opcode = opcode;
+                transfer_instruction.destination = static_cast<DataRegister>(scratch);
+                transfer_instruction.target = 0;
+                result.push_back(transfer_instruction);
+            };
+
+            for (auto const& instruction : instructions) {
+                if (not instruction.has_virtual_registers()) {
+                    result.push_back(instruction);
+                    continue;
+                }
+                auto const destination = virtual_destination(instruction);
+                auto const source = virtual_source(instruction);
+                auto const is_destination_spilled = (destination != no_index and colors[destination] == no_color);
+                auto const is_source_spilled = (source != no_index and colors[source] == no_color);
+                // two different spilled registers are transferred through V1 (source) and V0 (destination)
+                auto const source_scratch =
+                        (is_destination_spilled and is_source_spilled and source != destination) ? u8{ 1 } : u8{ 0 };
+
+                auto rewritten = instruction;
+                rewritten.set_virtual_registers(none, none);
+                if (destination != no_index) {
+                    rewritten.destination =
+                            static_cast<DataRegister>(is_destination_spilled ? u8{ 0 } : colors[destination]);
+                }
+                if (source != no_index) {
+                    rewritten.source = is_source_spilled ? source_scratch : colors[source];
+                }
+
+                // V1 has to be loaded first, since loading it overwrites V0
+                if (is_source_spilled) {
+                    transfer(ir::Opcode::LoadRegisters, instruction, source, source_scratch);
+                }
+                if (is_destination_spilled and instruction.reads_destination() and source != destination) {
+                    transfer(ir::Opcode::LoadRegisters, instruction, destination, 0);
+                }
+                result.push_back(rewritten);
+                if (is_destination_spilled) {
+                    transfer(ir::Opcode::StoreRegisters, instruction, destination, 0);
+                }
+            }
+
+            auto program_size = usize{ 0 };
+            for (auto const& instruction : result) {
+                program_size += instruction.size();
+            }
+            if (program_start_address + program_size > spill_area) {
+                m_diagnostics->report(chissembler::EmitterError{ chissembler::Diagnostic{
+                        std::string{ m_file->filename() },
+                        0,
+                        0,
+                        std::format("program overlaps the spill area of its virtual registers at 0x{:03X}", spill_area),
+                } });
+                return;
+            }
+            *m_instructions = std::move(result);
+        }
+
+        [[nodiscard]] usize virtual_destination(ir::Instruction const& instruction) const {
+            auto const symbol = instruction.has_register_operands() ? instruction.virtual_destination() : none;
+            return symbol.has_value() ? m_virtual_indices.at(symbol.value()) : no_index;
+        }
+
+        [[nodiscard]] usize virtual_source(ir::Instruction const& instruction) const {
+            auto const symbol = instruction.reads_source_register() ? instruction.virtual_source() : none;
+            return symbol.has_value() ? m_virtual_indices.at(symbol.value()) : no_index;
+        }
+
+        [[nodiscard]] SourceLocation location(ir::Instruction const& instruction) const {
+            return SourceLocation{ *m_file, instruction.source_offset, instruction.source_length };
+        }
+    };
+} // namespace
+
+void allocate_registers(
+        SourceFile const& file,
+        SymbolTable const& symbols,
+        std::vector<ir::Instruction>& instructions,
+        DiagnosticSink& diagnostics
+) {
+    TRACE_SCOPE("allocate registers");
+    auto allocator = RegisterAllocator{ file, symbols, instructions, diagnostics };
+    allocator.run();
+}
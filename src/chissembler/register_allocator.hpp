@@ -0,0 +1,23 @@
+#pragma once
+
+#include "diagnostic_sink.hpp"
+#include "ir.hpp"
+#include "source_file.hpp"
+#include "symbol_table.hpp"
+#include <vector>
+
+// Maps the virtual registers (`%name`) of a whole program to the data registers V0 to VE that the program doesn't use
+// directly. VF is never allocated, since arithmetic instructions overwrite it. A liveness analysis on the control flow
+// graph determines which virtual registers are live at the same time, the resulting interference graph is colored
+// with the free data registers (Chaitin-Briggs).
+//
+// Virtual registers that don't get a color are spilled into two byte slots at the top of the memory: every read
+// loads them into V0 or V1 right before the instruction and every write stores them right after it. Since FX65 and
+// FX55 always transfer V0 up to VX, spilling requires the program to leave V0 and V1 alone (as well as I, which
+// addresses the slots).
+void allocate_registers(
+        SourceFile const& file,
+        SymbolTable const& symbols,
+        std::vector<ir::Instruction>& instructions,
+        DiagnosticSink& diagnostics
+);
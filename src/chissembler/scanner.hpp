@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <common/types.hpp>
+#include <string_view>
+
+#if defined(__AVX2__)
+#define CHISSEMBLER_SCANNER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) or defined(_M_X64) or (defined(_M_IX86_FP) and _M_IX86_FP >= 2)
+#define CHISSEMBLER_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Locale independent character classification for the lexer. Runs of whitespace, digits and identifier characters
+// are skipped 16 (SSE2) or 32 (AVX2) bytes at a time if the target supports it. The scalar versions are always
+// available and produce the same results.
+namespace scanner {
+
+    enum class Run {
+        Whitespace, // ' ', '\t', '\v', '\f' and '\r' (line breaks are tokens and therefore not included)
+        Digits,
+        IdentifierCharacters, // letters, digits and '_'
+    };
+
+    [[nodiscard]] constexpr bool is_digit(char const c) {
+        return c >= '0' and c <= '9';
+    }
+
+    [[nodiscard]] constexpr bool is_letter(char const c) {
+        return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z');
+    }
+
+    template<Run run>
+    [[nodiscard]] constexpr bool matches(char const c) {
+        if constexpr (run == Run::Whitespace) {
+            return c == ' ' or c == '\t' or c == '\v' or c == '\f' or c == '\r';
+        } else if constexpr (run == Run::Digits) {
+            return is_digit(c);
+        } else {
+            return is_letter(c) or is_digit(c) or c == '_';
+        }
+    }
+
+    // index of the first character at or after `index` that doesn't belong to the run
+    template<Run run>
+    [[nodiscard]] constexpr usize skip_scalar(std::string_view const source, usize index) {
+        while (index < source.length() and matches<run>(source[index])) {
+            ++index;
+        }
+        return index;
+    }
+
+#if defined(CHISSEMBLER_SCANNER_AVX2)
+    // all comparisons are signed, which is fine since every character we look for is below 0x80
+    template<Run run>
+    [[nodiscard]] inline __m256i classify(__m256i const chunk) {
+        auto const in_range = [&](char const first, char const last) {
+            return _mm256_and_si256(
+                    _mm256_cmpgt_epi8(chunk, _mm256_set1_epi8(static_cast<char>(first - 1))),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(last + 1)), chunk)
+            );
+        };
+        if constexpr (run == Run::Whitespace) {
+            auto const control =
+                    _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')), in_range('\t', '\r'));
+            return _mm256_or_si256(control, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')));
+        } else if constexpr (run == Run::Digits) {
+            return in_range('0', '9');
+        } else {
+            auto const lower_case = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+            auto const letters = _mm256_and_si256(
+                    _mm256_cmpgt_epi8(lower_case, _mm256_set1_epi8('a' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower_case)
+            );
+            return _mm256_or_si256(
+                    _mm256_or_si256(letters, in_range('0', '9')),
+                    _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_'))
+            );
+        }
+    }
+
+    template<Run run>
+    [[nodiscard]] inline usize skip(std::string_view const source, usize index) {
+        static constexpr auto chunk_size = usize{ 32 };
+        while (index + chunk_size <= source.length()) {
+            auto const chunk = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(source.data() + index));
+            auto const mask = static_cast<u32>(_mm256_movemask_epi8(classify<run>(chunk)));
+            if (mask != 0xFFFF'FFFF) {
+                return index + static_cast<usize>(std::countr_one(mask));
+            }
+            index += chunk_size;
+        }
+        return skip_scalar<run>(source, index);
+    }
+#elif defined(CHISSEMBLER_SCANNER_SSE2)
+    // all comparisons are signed, which is fine since every character we look for is below 0x80
+    template<Run run>
+    [[nodiscard]] inline __m128i classify(__m128i const chunk) {
+        auto const in_range = [&](char const first, char const last) {
+            return _mm_and_si128(
+                    _mm_cmpgt_epi8(chunk, _mm_set1_epi8(static_cast<char>(first - 1))),
+                    _mm_cmplt_epi8(chunk, _mm_set1_epi8(static_cast<char>(last + 1)))
+            );
+        };
+        if constexpr (run == Run::Whitespace) {
+            auto const control = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), in_range('\t', '\r'));
+            return _mm_or_si128(control, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+        } else if constexpr (run == Run::Digits) {
+            return in_range('0', '9');
+        } else {
+            auto const lower_case = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+            auto const letters = _mm_and_si128(
+                    _mm_cmpgt_epi8(lower_case, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lower_case, _mm_set1_epi8('z' + 1))
+            );
+            return _mm_or_si128(_mm_or_si128(letters, in_range('0', '9')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+        }
+    }
+
+    template<Run run>
+    [[nodiscard]] inline usize skip(std::string_view const source, usize index) {
+        static constexpr auto chunk_size = usize{ 16 };
+        while (index + chunk_size <= source.length()) {
+            auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source.data() + index));
+            auto const mask = static_cast<u32>(_mm_movemask_epi8(classify<run>(chunk)));
+            if (mask != 0xFFFF) {
+                return index + static_cast<usize>(std::countr_one(mask));
+            }
+            index += chunk_size;
+        }
+        return skip_scalar<run>(source, index);
+    }
+#else
+    template<Run run>
+    [[nodiscard]] inline usize skip(std::string_view const source, usize const index) {
+        return skip_scalar<run>(source, index);
+    }
+#endif
+
+} // namespace scanner
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "line_index.hpp"
+#include <common/types.hpp>
+#include <string_view>
+#include <utility>
+
+// A source that is being assembled. Tokens and source locations only store offsets into it. When assembling from a
+// stream, every chunk of whole lines is a source file of its own that starts at `first_line`.
+class SourceFile final {
+private:
+    std::string_view m_filename;
+    std::string_view m_source;
+    LineIndex m_line_index;
+    usize m_first_line;
+
+public:
+    SourceFile(std::string_view const filename, std::string_view const source, usize const first_line = 1)
+        : m_filename{ filename },
+          m_source{ source },
+          m_line_index{ source },
+          m_first_line{ first_line } { }
+
+    [[nodiscard]] std::string_view filename() const {
+        return m_filename;
+    }
+
+    [[nodiscard]] std::string_view source() const {
+        return m_source;
+    }
+
+    [[nodiscard]] std::string_view text(usize const offset, usize const length) const {
+        return m_source.substr(offset, length);
+    }
+
+    [[nodiscard]] usize num_lines() const {
+        return m_line_index.num_lines();
+    }
+
+    [[nodiscard]] std::pair<usize, usize> line_and_column(usize const offset) const {
+        auto const [line, column] = m_line_index.line_and_column(offset);
+        return { m_first_line - 1 + line, column };
+    }
+};
@@ -1,48 +1,52 @@
 #pragma once
 
+#include "errors.hpp"
+#include "source_file.hpp"
 #include <common/ostream_formatter.hpp>
 #include <common/types.hpp>
 #include <iostream>
+#include <string>
 #include <string_view>
+#include <utility>
 
 struct SourceLocation final {
-    std::string_view filename;
-    std::string_view source;
+    SourceFile const* file;
     usize offset;
     usize length;
 
-    SourceLocation(
-            std::string_view const filename_,
-            std::string_view const source_,
-            usize const offset_,
-            usize const length_
-    )
-        : filename{ filename_ },
-          source{ source_ },
+    SourceLocation(SourceFile const& file_, usize const offset_, usize const length_)
+        : file{ &file_ },
           offset{ offset_ },
           length{ length_ } { }
 
     [[nodiscard]] std::string_view lexeme() const {
-        return source.substr(offset, length);
+        return file->text(offset, length);
     }
 
-    [[nodiscard]] std::pair<usize, usize> line_and_column() const {
-        auto line = usize{ 1 };
-        auto column = usize{ 1 };
-        for (usize i = 0; i < offset; ++i) {
-            if (source.at(i) == '\n') {
-                ++line;
-                column = 1;
-            } else {
-                ++column;
-            }
+    // the whole line containing the start of this location, without the line break
+    [[nodiscard]] std::string_view line() const {
+        auto const source = file->source();
+        auto const previous_line_break = offset == 0 ? std::string_view::npos : source.rfind('\n', offset - 1);
+        auto const start = previous_line_break == std::string_view::npos ? usize{ 0 } : previous_line_break + 1;
+        auto result = source.substr(start, source.find('\n', start) - start);
+        if (result.ends_with('\r')) {
+            result.remove_suffix(1);
         }
-        return { line, column };
+        return result;
+    }
+
+    [[nodiscard]] std::pair<usize, usize> line_and_column() const {
+        return file->line_and_column(offset);
+    }
+
+    [[nodiscard]] chissembler::Diagnostic diagnostic(std::string message) const {
+        auto const [line, column] = line_and_column();
+        return chissembler::Diagnostic{ std::string{ file->filename() }, line, column, std::move(message) };
     }
 
     friend std::ostream& operator<<(std::ostream& os, SourceLocation const& source_location) {
         auto const [line, column] = source_location.line_and_column();
-        return os << source_location.filename << ':' << line << ':' << column;
+        return os << source_location.file->filename() << ':' << line << ':' << column;
     }
 };
 
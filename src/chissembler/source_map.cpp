@@ -0,0 +1,204 @@
+#include "source_map.hpp"
+#include <algorithm>
+#include <common/little_endian.hpp>
+#include <format>
+#include <gsl/gsl>
+
+namespace chissembler {
+    namespace {
+        constexpr auto header_size = usize{ 28 };
+        constexpr auto file_size = usize{ 8 };
+        constexpr auto range_size = usize{ 16 };
+        constexpr auto label_size = usize{ 12 };
+
+        // Both ranges and labels start with their address and are sorted by it. Returns the index of the last entry
+        // whose address isn't greater than the given one.
+        [[nodiscard]] Optional<usize> find_last_at_or_before(
+                std::span<std::byte const> const entries,
+                usize const entry_size,
+                u16 const address
+        ) {
+            auto first = usize{ 0 };
+            auto count = entries.size() / entry_size;
+            while (count > 0) {
+                auto const step = count / 2;
+                auto const middle = first + step;
+                if (read_little_endian<u16>(entries, middle * entry_size) <= address) {
+                    first = middle + 1;
+                    count -= step + 1;
+                } else {
+                    count = step;
+                }
+            }
+            if (first == 0) {
+                return none;
+            }
+            return first - 1;
+        }
+    } // namespace
+
+    [[nodiscard]] std::vector<std::byte> write_source_map(SourceMap const& source_map) {
+        auto strings = std::string{};
+        auto const append_string = [&](std::vector<std::byte>& buffer, std::string_view const string) {
+            append_little_endian(buffer, gsl::narrow<u32>(strings.size()));
+            append_little_endian(buffer, gsl::narrow<u32>(string.size()));
+            strings += string;
+        };
+
+        auto result = std::vector<std::byte>{};
+        result.reserve(
+                header_size + source_map.files.size() * file_size + source_map.ranges.size() * range_size
+                + source_map.labels.size() * label_size
+        );
+        for (auto const c : source_map_magic) {
+            result.push_back(static_cast<std::byte>(c));
+        }
+        append_little_endian(result, source_map_version);
+        append_little_endian(result, gsl::narrow<u32>(source_map.files.size()));
+        append_little_endian(result, gsl::narrow<u32>(source_map.ranges.size()));
+        append_little_endian(result, gsl::narrow<u32>(source_map.labels.size()));
+        auto const string_table_size_offset = result.size();
+        append_little_endian(result, u32{ 0 }); // patched below, once all names have been collected
+
+        for (auto const& file : source_map.files) {
+            append_string(result, file);
+        }
+        for (auto const& range : source_map.ranges) {
+            append_little_endian(result, range.address);
+            append_little_endian(result, range.size);
+            append_little_endian(result, range.file);
+            append_little_endian(result, range.line);
+            append_little_endian(result, range.column);
+        }
+        for (auto const& label : source_map.labels) {
+            append_little_endian(result, label.address);
+            append_little_endian(result, label.size);
+            append_string(result, label.name);
+        }
+
+        auto const string_table_size = gsl::narrow<u32>(strings.size());
+        for (usize i = 0; i < sizeof(u32); ++i) {
+            result.at(string_table_size_offset + i) = static_cast<std::byte>((string_table_size >> (8 * i)) & 0xFF);
+        }
+        auto const string_bytes = std::as_bytes(std::span{ strings });
+        result.insert(result.end(), string_bytes.begin(), string_bytes.end());
+        return result;
+    }
+
+    SourceMapView::SourceMapView(std::span<std::byte const> const data) {
+        if (data.size() < header_size) {
+            throw SourceMapError{ "truncated source map" };
+        }
+        auto const has_magic = std::ranges::equal(
+                data.first(source_map_magic.size()),
+                source_map_magic,
+                {},
+                {},
+                [](char const c) { return static_cast<std::byte>(c); }
+        );
+        if (not has_magic) {
+            throw SourceMapError{ "not a source map" };
+        }
+        if (auto const version = read_little_endian<u32>(data, 8); version != source_map_version) {
+            throw SourceMapError{ std::format("source map has unsupported version {}", version) };
+        }
+
+        auto const files_size = u64{ read_little_endian<u32>(data, 12) } * file_size;
+        auto const ranges_size = u64{ read_little_endian<u32>(data, 16) } * range_size;
+        auto const labels_size = u64{ read_little_endian<u32>(data, 20) } * label_size;
+        auto const strings_size = u64{ read_little_endian<u32>(data, 24) };
+        auto const expected_size = header_size + files_size + ranges_size + labels_size + strings_size;
+        if (data.size() < expected_size) {
+            throw SourceMapError{ "truncated source map" };
+        }
+        if (data.size() > expected_size) {
+            throw SourceMapError{ "source map has trailing data" };
+        }
+
+        auto tables = data.subspan(header_size);
+        m_files = tables.first(static_cast<usize>(files_size));
+        tables = tables.subspan(static_cast<usize>(files_size));
+        m_ranges = tables.first(static_cast<usize>(ranges_size));
+        tables = tables.subspan(static_cast<usize>(ranges_size));
+        m_labels = tables.first(static_cast<usize>(labels_size));
+        m_strings = tables.subspan(static_cast<usize>(labels_size));
+
+        // a single pass without any allocations, afterwards no lookup can fail
+        for (usize offset = 0; offset < m_files.size(); offset += file_size) {
+            check_string(read_little_endian<u32>(m_files, offset), read_little_endian<u32>(m_files, offset + 4));
+        }
+        auto end_of_previous_range = u32{ 0 };
+        for (usize offset = 0; offset < m_ranges.size(); offset += range_size) {
+            auto const address = read_little_endian<u16>(m_ranges, offset);
+            if (address < end_of_previous_range) {
+                throw SourceMapError{ "ranges of source map are not sorted" };
+            }
+            end_of_previous_range = u32{ address } + read_little_endian<u16>(m_ranges, offset + 2);
+            if (read_little_endian<u32>(m_ranges, offset + 4) >= m_files.size() / file_size) {
+                throw SourceMapError{ "file index of source map is out of range" };
+            }
+        }
+        auto previous_label_address = u16{ 0 };
+        for (usize offset = 0; offset < m_labels.size(); offset += label_size) {
+            auto const address = read_little_endian<u16>(m_labels, offset);
+            if (address < previous_label_address) {
+                throw SourceMapError{ "labels of source map are not sorted" };
+            }
+            previous_label_address = address;
+            check_string(read_little_endian<u32>(m_labels, offset + 4), read_little_endian<u32>(m_labels, offset + 8));
+        }
+    }
+
+    [[nodiscard]] Optional<SourceMapView::Location> SourceMapView::find(u16 const address) const {
+        auto const index = find_last_at_or_before(m_ranges, range_size, address);
+        if (not index.has_value()) {
+            return none;
+        }
+        auto const offset = index.value() * range_size;
+        auto const start = read_little_endian<u16>(m_ranges, offset);
+        auto const size = read_little_endian<u16>(m_ranges, offset + 2);
+        if (address >= u32{ start } + size) {
+            return none;
+        }
+        auto const file_offset = usize{ read_little_endian<u32>(m_ranges, offset + 4) } * file_size;
+        return Location{
+            string(read_little_endian<u32>(m_files, file_offset), read_little_endian<u32>(m_files, file_offset + 4)),
+            read_little_endian<u32>(m_ranges, offset + 8),
+            read_little_endian<u32>(m_ranges, offset + 12),
+        };
+    }
+
+    [[nodiscard]] Optional<SourceMapView::Label> SourceMapView::find_label(u16 const address) const {
+        auto const index = find_last_at_or_before(m_labels, label_size, address);
+        if (not index.has_value()) {
+            return none;
+        }
+        auto const offset = index.value() * label_size;
+        auto const start = read_little_endian<u16>(m_labels, offset);
+        auto const size = read_little_endian<u16>(m_labels, offset + 2);
+        if (address >= u32{ start } + size) {
+            return none;
+        }
+        auto const name_offset = read_little_endian<u32>(m_labels, offset + 4);
+        auto const name_length = read_little_endian<u32>(m_labels, offset + 8);
+        return Label{ string(name_offset, name_length), start, size };
+    }
+
+    [[nodiscard]] usize SourceMapView::num_ranges() const {
+        return m_ranges.size() / range_size;
+    }
+
+    [[nodiscard]] usize SourceMapView::num_labels() const {
+        return m_labels.size() / label_size;
+    }
+
+    void SourceMapView::check_string(u32 const offset, u32 const length) const {
+        if (u64{ offset } + length > m_strings.size()) {
+            throw SourceMapError{ "name in source map is out of range" };
+        }
+    }
+
+    [[nodiscard]] std::string_view SourceMapView::string(u32 const offset, u32 const length) const {
+        return { reinterpret_cast<char const*>(m_strings.data()) + offset, length };
+    }
+} // namespace chissembler
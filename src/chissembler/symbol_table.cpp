@@ -0,0 +1,80 @@
+#include "symbol_table.hpp"
+#include <bit>
+#include <gsl/gsl>
+
+[[nodiscard]] static u64 hash(std::string_view const name) {
+    // FNV-1a
+    auto result = u64{ 0xCBF2'9CE4'8422'2325 };
+    for (auto const c : name) {
+        result ^= static_cast<u64>(static_cast<unsigned char>(c));
+        result *= u64{ 0x0100'0000'01B3 };
+    }
+    return result;
+}
+
+SymbolTable::SymbolTable(usize const expected_num_symbols, NameStorage const name_storage)
+    : m_name_storage{ name_storage } {
+    m_names.reserve(expected_num_symbols);
+    // keep the load factor at or below one half
+    m_slots.assign(std::bit_ceil(std::max(expected_num_symbols * 2, usize{ 16 })), empty_slot);
+}
+
+[[nodiscard]] Symbol SymbolTable::intern(std::string_view const name) {
+    return intern(name, m_name_storage);
+}
+
+[[nodiscard]] Symbol SymbolTable::intern_generated(std::string_view const name) {
+    return intern(name, NameStorage::Copied);
+}
+
+void SymbolTable::define_constant(Symbol const symbol, i64 const value) {
+    if (symbol >= m_constants.size()) {
+        m_constants.resize(usize{ symbol } + 1);
+    }
+    m_constants[symbol] = value;
+}
+
+[[nodiscard]] Optional<Symbol> SymbolTable::find(std::string_view const name) const {
+    auto const symbol = m_slots.at(find_slot(name));
+    if (symbol == empty_slot) {
+        return none;
+    }
+    return symbol;
+}
+
+// returns the slot containing the name or the empty slot where it would have to be inserted
+[[nodiscard]] usize SymbolTable::find_slot(std::string_view const name) const {
+    auto const mask = m_slots.size() - 1;
+    for (auto slot = gsl::narrow_cast<usize>(hash(name)) & mask;; slot = (slot + 1) & mask) {
+        auto const symbol = m_slots[slot];
+        if (symbol == empty_slot or m_names[symbol] == name) {
+            return slot;
+        }
+    }
+}
+
+[[nodiscard]] Symbol SymbolTable::intern(std::string_view const name, NameStorage const name_storage) {
+    auto slot = find_slot(name);
+    if (m_slots.at(slot) != empty_slot) {
+        return m_slots.at(slot);
+    }
+    if ((m_names.size() + 1) * 2 > m_slots.size()) {
+        grow();
+        slot = find_slot(name);
+    }
+    auto const symbol = static_cast<Symbol>(m_names.size());
+    if (name_storage == NameStorage::Copied) {
+        m_names.push_back(m_copied_names.emplace_back(name));
+    } else {
+        m_names.push_back(name);
+    }
+    m_slots.at(slot) = symbol;
+    return symbol;
+}
+
+void SymbolTable::grow() {
+    m_slots.assign(m_slots.size() * 2, empty_slot);
+    for (usize symbol = 0; symbol < m_names.size(); ++symbol) {
+        m_slots.at(find_slot(m_names[symbol])) = static_cast<Symbol>(symbol);
+    }
+}
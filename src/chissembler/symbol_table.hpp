@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ir.hpp"
+#include <common/types.hpp>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Interns identifiers into dense `Symbol`s. By default, the names are views into the source, the hash table uses
+// open addressing, so interning doesn't allocate unless the table has to grow.
+// The table also holds the values of named constants, since it's the only state that is shared by all chunks of a
+// streamed source.
+class SymbolTable final {
+public:
+    enum class NameStorage {
+        Borrowed, // the source outlives the table
+        Copied,   // the source is discarded while the table is still in use (when assembling from a stream)
+    };
+
+private:
+    static constexpr auto empty_slot = Symbol{ 0xFFFF'FFFF };
+
+    std::vector<std::string_view> m_names; // indexed by symbol
+    std::vector<Symbol> m_slots;
+    NameStorage m_name_storage;
+    std::deque<std::string> m_copied_names; // elements never move, so the views in `m_names` stay valid
+    std::vector<Optional<i64>> m_constants; // indexed by symbol, only as large as the greatest constant's symbol
+
+public:
+    explicit SymbolTable(usize expected_num_symbols = 0, NameStorage name_storage = NameStorage::Borrowed);
+
+    [[nodiscard]] Symbol intern(std::string_view name);
+    // for names that don't appear in the source (like the local labels of macro expansions), which are always copied
+    [[nodiscard]] Symbol intern_generated(std::string_view name);
+    [[nodiscard]] Optional<Symbol> find(std::string_view name) const;
+
+    [[nodiscard]] std::string_view name(Symbol const symbol) const {
+        return m_names.at(symbol);
+    }
+
+    [[nodiscard]] usize size() const {
+        return m_names.size();
+    }
+
+    void define_constant(Symbol symbol, i64 value);
+
+    // none if the symbol isn't a constant (or hasn't been defined as one yet)
+    [[nodiscard]] Optional<i64> constant(Symbol const symbol) const {
+        if (symbol >= m_constants.size()) {
+            return none;
+        }
+        return m_constants[symbol];
+    }
+
+private:
+    [[nodiscard]] Symbol intern(std::string_view name, NameStorage name_storage);
+    [[nodiscard]] usize find_slot(std::string_view name) const;
+    void grow();
+};
@@ -1,29 +1,46 @@
 #pragma once
+
 #include "source_location.hpp"
 #include "token_type.hpp"
+#include <common/types.hpp>
+#include <limits>
 
-
-#include <string_view>
-
+// Tokens only store their position within the `SourceFile` they have been read from, which keeps them at 8 bytes.
 class Token final {
+public:
+    static constexpr auto max_offset = usize{ std::numeric_limits<u32>::max() };
+    static constexpr auto max_length = usize{ std::numeric_limits<u16>::max() };
+
 private:
     TokenType m_type;
-    SourceLocation m_source_location;
+    u16 m_length;
+    u32 m_offset;
 
 public:
-    Token(TokenType const type, SourceLocation const& source_location)
+    Token(TokenType const type, u32 const offset, u16 const length)
         : m_type{ type },
-          m_source_location{ source_location } { }
-
-    [[nodiscard]] std::string_view lexeme() const {
-        return m_source_location.lexeme();
-    }
+          m_length{ length },
+          m_offset{ offset } { }
 
     [[nodiscard]] TokenType type() const {
         return m_type;
     }
 
-    [[nodiscard]] SourceLocation source_location() const {
-        return m_source_location;
+    [[nodiscard]] usize offset() const {
+        return m_offset;
+    }
+
+    [[nodiscard]] usize length() const {
+        return m_length;
+    }
+
+    [[nodiscard]] std::string_view lexeme(SourceFile const& file) const {
+        return file.text(m_offset, m_length);
+    }
+
+    [[nodiscard]] SourceLocation source_location(SourceFile const& file) const {
+        return SourceLocation{ file, m_offset, m_length };
     }
 };
+
+static_assert(sizeof(Token) == 8);
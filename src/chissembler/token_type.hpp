@@ -1,8 +1,13 @@
 #pragma once
 
-enum class TokenType {
+#include <common/types.hpp>
+
+enum class TokenType : u8 {
     IntegerLiteral,
+    StringLiteral,
     Register,
+    VirtualRegister,
+    AddressRegister,
     Identifier,
     Copy,
     Add,
@@ -12,7 +17,24 @@ enum class TokenType {
     Xor,
     Colon,
     Jump,
+    Const,
+    Macro,
+    Endmacro,
+    Db,
+    Dw,
+    Incbin,
     Plus,
+    Minus,
+    Asterisk,
+    Slash,
+    ShiftLeft,
+    ShiftRight,
+    Ampersand,
+    Pipe,
+    LeftParenthesis,
+    RightParenthesis,
+    Equals,
+    Comma,
     Newline,
     EndOfInput,
 };
@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <array>
+#include <common/utils.hpp>
+#include <concepts>
+#include <string_view>
 
 [[nodiscard]] inline bool is_valid_register_char(char const c) {
     static constexpr auto valid = std::array{
@@ -9,3 +12,21 @@
     };
     return std::find(valid.cbegin(), valid.cend(), c) != valid.cend();
 }
+
+// decimal, hexadecimal ("0x2A") or binary ("0b101010")
+template<std::integral T>
+[[nodiscard]] Optional<T> parse_integer_literal(std::string_view const literal) {
+    if (literal.length() > 2 and literal.front() == '0') {
+        switch (literal[1]) {
+            case 'x':
+            case 'X':
+                return to_int<T>(literal.substr(2), 16);
+            case 'b':
+            case 'B':
+                return to_int<T>(literal.substr(2), 2);
+            default:
+                break;
+        }
+    }
+    return to_int<T>(literal);
+}
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <atomic>
+#include <chissembler/cache.hpp>
+#include <chissembler/chissembler.hpp>
+#include <chrono>
+#include <common/atomic_file.hpp>
+#include <common/mapped_file.hpp>
+#include <common/utils.hpp>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr auto default_cache_size_in_mib = u64{ 256 };
+
+    struct Options {
+        std::vector<std::filesystem::path> inputs;
+        Optional<std::filesystem::path> output_directory;
+        Optional<std::filesystem::path> cache_directory;
+        u64 cache_size_in_mib = default_cache_size_in_mib;
+        usize num_jobs = std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 });
+        bool print_statistics = false;
+        bool assemble_objects = false; // relocatable .cso files instead of ROMs
+        bool optimize = false;
+        bool print_optimization_report = false;
+        bool write_source_maps = false; // .ch8.map next to every ROM
+    };
+
+    struct Timings {
+        Clock::duration map{};
+        Clock::duration cache{}; // hashing the source, looking up and storing the machine code
+        Clock::duration parse{};
+        Clock::duration optimize{};
+        Clock::duration encode{};
+        Clock::duration write{};
+
+        Timings& operator+=(Timings const& other) {
+            map += other.map;
+            cache += other.cache;
+            parse += other.parse;
+            optimize += other.optimize;
+            encode += other.encode;
+            write += other.write;
+            return *this;
+        }
+    };
+
+    struct FileResult {
+        std::vector<chissembler::Diagnostic> diagnostics;
+        std::vector<chissembler::Diagnostic> optimizations;
+        std::string error;   // failure to read or write a file
+        std::string warning; // failure to use the cache, which doesn't affect the result
+        Timings timings;
+        usize num_instructions = 0;
+        bool is_cache_hit = false;
+
+        [[nodiscard]] bool succeeded() const {
+            return diagnostics.empty() and error.empty();
+        }
+    };
+
+    void print_usage() {
+        std::cerr << "usage: chissembler [options] <input.csm>...\n"
+                     "options:\n"
+                     "  -c, --object                        write relocatable .cso objects for chissemble-link\n"
+                     "  -o, --output-directory <directory>  write the outputs there instead of next to the inputs\n"
+                     "  -j, --jobs <count>                  number of files to assemble in parallel\n"
+                     "  -O, --optimize                      rewrite ROMs into fewer and cheaper instructions\n"
+                     "  --optimization-report               print every change of the optimizer\n"
+                     "                                      (bypasses looking up the cache)\n"
+                     "  -g, --source-map                    write the debug info of every ROM into a .ch8.map file\n"
+                     "                                      (bypasses looking up the cache)\n"
+                     "  --cache <directory>                 reuse the machine code of unchanged sources\n"
+                     "  --cache-size <MiB>                  least recently used entries are evicted beyond this size\n"
+                     "                                      (default: 256)\n"
+                     "  --stats                             print the time spent in each phase\n";
+    }
+
+    [[nodiscard]] Optional<Options> parse_arguments(std::span<char const* const> const arguments) {
+        auto result = Options{};
+        for (usize i = 0; i < arguments.size(); ++i) {
+            auto const argument = std::string_view{ arguments[i] };
+            auto const has_value = i + 1 < arguments.size();
+            if (argument == "--stats") {
+                result.print_statistics = true;
+            } else if (argument == "-c" or argument == "--object") {
+                result.assemble_objects = true;
+            } else if (argument == "-O" or argument == "--optimize") {
+                result.optimize = true;
+            } else if (argument == "--optimization-report") {
+                result.print_optimization_report = true;
+            } else if (argument == "-g" or argument == "--source-map") {
+                result.write_source_maps = true;
+            } else if ((argument == "-o" or argument == "--output-directory") and has_value) {
+                result.output_directory = std::filesystem::path{ arguments[++i] };
+            } else if (argument == "--cache" and has_value) {
+                result.cache_directory = std::filesystem::path{ arguments[++i] };
+            } else if (argument == "--cache-size" and has_value) {
+                auto const size = to_int<u64>(arguments[++i]);
+                if (not size.has_value()) {
+                    return none;
+                }
+                result.cache_size_in_mib = size.value();
+            } else if ((argument == "-j" or argument == "--jobs") and has_value) {
+                auto const num_jobs = to_int<usize>(arguments[++i]);
+                if (not num_jobs.has_value() or num_jobs.value() == 0) {
+                    return none;
+                }
+                result.num_jobs = num_jobs.value();
+            } else if (argument.starts_with('-')) {
+                return none;
+            } else {
+                result.inputs.emplace_back(argument);
+            }
+        }
+        if (result.inputs.empty() or (result.write_source_maps and result.assemble_objects)) {
+            return none;
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::filesystem::path output_path(std::filesystem::path const& input, Options const& options) {
+        auto result = input;
+        result.replace_extension(options.assemble_objects ? ".cso" : ".ch8");
+        if (options.output_directory.has_value()) {
+            return options.output_directory.value() / result.filename();
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::filesystem::path source_map_path(std::filesystem::path const& input, Options const& options) {
+        auto result = output_path(input, options);
+        result += ".map";
+        return result;
+    }
+
+    // Inputs with the same name (from different directories when writing to an output directory, or with different
+    // extensions) would overwrite each other's outputs. Returns a description of the first such collision.
+    [[nodiscard]] Optional<std::string> find_colliding_outputs(Options const& options) {
+        auto inputs_by_output = std::map<std::filesystem::path, std::filesystem::path const*>{};
+        for (auto const& input : options.inputs) {
+            auto const output = output_path(input, options);
+            auto const [previous, inserted] = inputs_by_output.try_emplace(output, &input);
+            if (not inserted) {
+                return std::format(
+                        "inputs '{}' and '{}' would both be written to '{}'",
+                        previous->second->string(),
+                        input.string(),
+                        output.string()
+                );
+            }
+        }
+        return none;
+    }
+
+    struct Assembled {
+        std::vector<std::byte> output; // machine code or serialized object
+        std::vector<chissembler::Diagnostic> diagnostics;
+    };
+
+    [[nodiscard]] Assembled assemble(
+            std::string_view const filename,
+            std::string_view const source,
+            chissembler::AssembleOptions const& assemble_options,
+            Options const& options
+    ) {
+        if (options.assemble_objects) {
+            auto assembled = chissembler::try_assemble_object(filename, source, assemble_options);
+            return Assembled{ chissembler::write_object(assembled.object), std::move(assembled.diagnostics) };
+        }
+        auto assembled = chissembler::try_assemble(filename, source, assemble_options);
+        return Assembled{ std::move(assembled.machine_code), std::move(assembled.diagnostics) };
+    }
+
+    void write_output(std::filesystem::path const& path, std::span<std::byte const> const data) {
+        if (not write_file_atomically(path, data)) {
+            throw std::runtime_error{ std::format("unable to write file '{}'", path.string()) };
+        }
+    }
+
+    [[nodiscard]] FileResult assemble_file(
+            std::filesystem::path const& input,
+            Options const& options,
+            chissembler::Cache const* const cache
+    ) {
+        auto result = FileResult{};
+        try {
+            auto const start = Clock::now();
+            auto const source = MappedFile{ input };
+            result.timings.map = Clock::now() - start;
+
+            auto statistics = chissembler::AssembleStatistics{};
+            auto source_map = std::vector<std::byte>{};
+            auto const assemble_options = chissembler::AssembleOptions{
+                .statistics = &statistics,
+                .optimize = options.optimize,
+                .optimization_report = options.print_optimization_report ? &result.optimizations : nullptr,
+                .source_map = options.write_source_maps ? &source_map : nullptr,
+            };
+            auto key = chissembler::CacheKey{};
+            auto output = Optional<std::vector<std::byte>>{};
+            auto const uses_cache = (cache != nullptr and chissembler::Cache::is_cacheable(source.text()));
+            if (uses_cache) {
+                auto const cache_start = Clock::now();
+                auto const cached_output = options.assemble_objects ? chissembler::CachedOutput::Object
+                                                                    : chissembler::CachedOutput::MachineCode;
+                key = chissembler::Cache::key(source.text(), assemble_options, cached_output);
+                // the report and the source map have to be created by assembling
+                if (not options.print_optimization_report and not options.write_source_maps) {
+                    output = cache->load(key);
+                }
+                result.timings.cache = Clock::now() - cache_start;
+                result.is_cache_hit = output.has_value();
+            }
+
+            if (not output.has_value()) {
+                auto const filename = input.string();
+                auto assembled = assemble(filename, source.text(), assemble_options, options);
+                result.timings.parse = statistics.parse;
+                result.timings.optimize = statistics.optimize;
+                result.timings.encode = statistics.encode;
+                result.num_instructions = statistics.num_instructions;
+                result.diagnostics = std::move(assembled.diagnostics);
+                if (not result.diagnostics.empty()) {
+                    return result;
+                }
+                output = std::move(assembled.output);
+
+                if (uses_cache) {
+                    auto const store_start = Clock::now();
+                    try {
+                        cache->store(key, output.value());
+                    } catch (std::exception const& e) {
+                        result.warning = std::format("warning: {}", e.what());
+                    }
+                    result.timings.cache += Clock::now() - store_start;
+                }
+            }
+
+            auto const write_start = Clock::now();
+            write_output(output_path(input, options), output.value());
+            if (options.write_source_maps) {
+                write_output(source_map_path(input, options), source_map);
+            }
+            result.timings.write = Clock::now() - write_start;
+        } catch (std::exception const& e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    // The inputs are independent of each other, so a fixed pool of workers (including the calling thread) just
+    // takes the next unassembled file until there are none left.
+    [[nodiscard]] std::vector<FileResult> assemble_all(Options const& options, chissembler::Cache const* const cache) {
+        auto results = std::vector<FileResult>(options.inputs.size());
+        auto next_input = std::atomic<usize>{ 0 };
+        auto const work = [&] {
+            for (auto i = next_input++; i < options.inputs.size(); i = next_input++) {
+                results[i] = assemble_file(options.inputs[i], options, cache);
+            }
+        };
+
+        auto const num_workers = std::min(options.num_jobs, options.inputs.size());
+        auto workers = std::vector<std::jthread>{};
+        workers.reserve(num_workers - 1);
+        for (usize i = 1; i < num_workers; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        workers.clear(); // joins
+        return results;
+    }
+
+    void print_statistics(
+            std::span<FileResult const> const results,
+            usize const num_workers,
+            Clock::duration const wall_time
+    ) {
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+
+        auto total = Timings{};
+        auto num_failed = usize{ 0 };
+        auto num_cache_hits = usize{ 0 };
+        auto num_instructions = usize{ 0 };
+        for (auto const& result : results) {
+            total += result.timings;
+            num_instructions += result.num_instructions;
+            if (not result.succeeded()) {
+                ++num_failed;
+            }
+            if (result.is_cache_hit) {
+                ++num_cache_hits;
+            }
+        }
+        std::cout << std::format(
+                "{} files ({} failed, {} cached), {} instructions assembled, {} threads\n",
+                results.size(),
+                num_failed,
+                num_cache_hits,
+                num_instructions,
+                num_workers
+        );
+        std::cout << "phase     time (summed over all files)\n";
+        for (auto const& [phase, duration] : {
+                     std::pair{ "map", total.map },
+                     std::pair{ "cache", total.cache },
+                     std::pair{ "parse", total.parse },
+                     std::pair{ "optimize", total.optimize },
+                     std::pair{ "encode", total.encode },
+                     std::pair{ "write", total.write },
+             }) {
+            std::cout << std::format("{:<8}  {:>10.3f} ms\n", phase, Milliseconds{ duration }.count());
+        }
+        std::cout << std::format("{:<8}  {:>10.3f} ms\n", "wall", Milliseconds{ wall_time }.count());
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    auto const arguments = std::span<char const* const>{ argv, static_cast<usize>(argc) };
+    auto const options = parse_arguments(arguments.subspan(1));
+    if (not options.has_value()) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (auto const collision = find_colliding_outputs(options.value()); collision.has_value()) {
+        std::cerr << std::format("error: {}\n", collision.value());
+        return EXIT_FAILURE;
+    }
+
+    auto cache = Optional<chissembler::Cache>{};
+    if (options->cache_directory.has_value()) {
+        try {
+            cache.emplace(options->cache_directory.value(), options->cache_size_in_mib * 1024 * 1024);
+        } catch (std::exception const& e) {
+            std::cerr << std::format("warning: unable to use the cache: {}\n", e.what());
+        }
+    }
+
+    auto const start = Clock::now();
+    auto const results = assemble_all(options.value(), cache.has_value() ? &cache.value() : nullptr);
+    auto const wall_time = Clock::now() - start;
+
+    if (cache.has_value()) {
+        try {
+            cache->trim();
+        } catch (std::exception const& e) {
+            std::cerr << std::format("warning: unable to trim the cache: {}\n", e.what());
+        }
+    }
+
+    // reported in the order of the inputs, independent of which thread finished first
+    auto succeeded = true;
+    for (auto const& result : results) {
+        for (auto const& optimization : result.optimizations) {
+            std::cerr << optimization.to_string() << '\n';
+        }
+        for (auto const& diagnostic : result.diagnostics) {
+            std::cerr << diagnostic.to_string() << '\n';
+        }
+        if (not result.error.empty()) {
+            std::cerr << result.error << '\n';
+        }
+        if (not result.warning.empty()) {
+            std::cerr << result.warning << '\n';
+        }
+        succeeded = succeeded and result.succeeded();
+    }
+
+    if (options->print_statistics) {
+        print_statistics(results, std::min(options->num_jobs, results.size()), wall_time);
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <span>
+#include <string_view>
+#include <system_error>
+
+// the extension of the files that `write_file_atomically()` writes to before they replace their destination
+inline constexpr auto temporary_file_extension = std::string_view{ ".tmp" };
+
+// The data is written to a temporary file next to the destination, which then replaces the destination. Readers never
+// see a partially written file, not even if the process gets killed. Returns false if the file couldn't be written,
+// in which case the temporary file has been removed again.
+[[nodiscard]] inline bool write_file_atomically(
+        std::filesystem::path const& path,
+        std::span<std::byte const> const data
+) {
+    // random, since other threads or processes may be writing the same file at the same time
+    thread_local auto random = std::mt19937_64{ std::random_device{}() };
+    auto temporary = path;
+    temporary += std::format(".{:016x}{}", random(), temporary_file_extension);
+    auto file = std::ofstream{ temporary, std::ios::binary | std::ios::trunc };
+    file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+    file.close();
+    auto error = std::error_code{};
+    if (file) {
+        std::filesystem::rename(temporary, path, error);
+        if (not error) {
+            return true;
+        }
+    }
+    std::filesystem::remove(temporary, error);
+    return false;
+}
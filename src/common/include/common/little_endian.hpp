@@ -0,0 +1,26 @@
+#pragma once
+
+#include "types.hpp"
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// the binary file formats (object files, source maps and instruction traces) store all integers as little endian
+
+template<std::unsigned_integral T>
+void append_little_endian(std::vector<std::byte>& buffer, T const value) {
+    for (usize i = 0; i < sizeof(T); ++i) {
+        buffer.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+// the caller has to make sure that the value lies within the data
+template<std::unsigned_integral T>
+[[nodiscard]] T read_little_endian(std::span<std::byte const> const bytes, usize const offset) {
+    auto result = T{ 0 };
+    for (usize i = 0; i < sizeof(T); ++i) {
+        result = static_cast<T>(result | static_cast<T>(static_cast<T>(bytes[offset + i]) << (8 * i)));
+    }
+    return result;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "types.hpp"
+#include <filesystem>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFileError final : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Read-only memory mapping of a whole file. Empty files are represented by an empty span.
+class MappedFile final {
+private:
+    std::byte const* m_data = nullptr;
+    usize m_size = 0;
+
+public:
+    explicit MappedFile(std::filesystem::path const& path) {
+#ifdef _WIN32
+        auto const file = CreateFileW(
+                path.c_str(),
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                nullptr,
+                OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL,
+                nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE) {
+            throw MappedFileError{ std::format("unable to open file '{}'", path.string()) };
+        }
+        auto size = LARGE_INTEGER{};
+        if (not GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw MappedFileError{ std::format("unable to determine size of file '{}'", path.string()) };
+        }
+        m_size = static_cast<usize>(size.QuadPart);
+        if (m_size > 0) {
+            auto const mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                m_data = static_cast<std::byte const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping); // the view keeps the mapping alive
+            }
+        }
+        CloseHandle(file);
+#else
+        auto const file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw MappedFileError{ std::format("unable to open file '{}'", path.string()) };
+        }
+        struct stat status {};
+        if (::fstat(file, &status) != 0) {
+            ::close(file);
+            throw MappedFileError{ std::format("unable to determine size of file '{}'", path.string()) };
+        }
+        m_size = static_cast<usize>(status.st_size);
+        if (m_size > 0) {
+            auto const address = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (address != MAP_FAILED) {
+                m_data = static_cast<std::byte const*>(address);
+                ::madvise(address, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(file); // the mapping stays valid after closing the file descriptor
+#endif
+        if (m_size > 0 and m_data == nullptr) {
+            throw MappedFileError{ std::format("unable to map file '{}' into memory", path.string()) };
+        }
+    }
+
+    MappedFile(MappedFile const& other) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : m_data{ std::exchange(other.m_data, nullptr) },
+          m_size{ std::exchange(other.m_size, 0) } { }
+
+    MappedFile& operator=(MappedFile const& other) = delete;
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        unmap();
+    }
+
+    [[nodiscard]] std::span<std::byte const> bytes() const {
+        return { m_data, m_size };
+    }
+
+    [[nodiscard]] std::string_view text() const {
+        return { reinterpret_cast<char const*>(m_data), m_size };
+    }
+
+    [[nodiscard]] usize size() const {
+        return m_size;
+    }
+
+private:
+    void unmap() {
+        if (m_data == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        ::munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+// Lightweight scoped tracing that produces Chrome Trace Event JSON (viewable in chrome://tracing or Perfetto).
+// All macros compile to nothing unless ENABLE_TRACING is defined (CMake option ENABLE_TRACING).
+//
+//     TRACE_SCOPE("Lexer::tokenize");  // records a complete event spanning the enclosing scope
+//     TRACE_DUMP("trace.json");        // writes all events recorded so far by all threads
+
+#include "types.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace trace {
+
+    struct Event {
+        char const* name; // must have static storage duration (e.g. a string literal)
+        u64 start_nanoseconds;
+        u64 duration_nanoseconds;
+    };
+
+    // Every thread writes into its own fixed-size buffer. Only the owning thread writes, readers only ever see
+    // the prefix that has been published via `m_size`, so recording needs neither locks nor allocations.
+    // Events that don't fit anymore are dropped (and counted).
+    class ThreadBuffer final {
+    public:
+        static constexpr auto capacity = usize{ 1 } << 18;
+
+    private:
+        std::unique_ptr<Event[]> m_events;
+        std::atomic<usize> m_size = 0;
+        std::atomic<usize> m_num_dropped = 0;
+        u32 m_thread_id;
+
+    public:
+        explicit ThreadBuffer(u32 const thread_id)
+            : m_events{ std::make_unique_for_overwrite<Event[]>(capacity) },
+              m_thread_id{ thread_id } { }
+
+        void push(Event const& event) {
+            auto const size = m_size.load(std::memory_order_relaxed);
+            if (size == capacity) {
+                m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_events[size] = event;
+            m_size.store(size + 1, std::memory_order_release);
+        }
+
+        [[nodiscard]] std::span<Event const> events() const {
+            return { m_events.get(), m_size.load(std::memory_order_acquire) };
+        }
+
+        [[nodiscard]] usize num_dropped() const {
+            return m_num_dropped.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] u32 thread_id() const {
+            return m_thread_id;
+        }
+    };
+
+    class Registry final {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point m_epoch = Clock::now();
+        std::mutex m_mutex; // only taken when a thread records its first event and when writing the trace
+        std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+
+    public:
+        [[nodiscard]] static Registry& instance() {
+            static auto registry = Registry{};
+            return registry;
+        }
+
+        [[nodiscard]] ThreadBuffer& register_thread() {
+            auto const lock = std::scoped_lock{ m_mutex };
+            auto const thread_id = static_cast<u32>(m_buffers.size() + 1);
+            return *m_buffers.emplace_back(std::make_unique<ThreadBuffer>(thread_id));
+        }
+
+        [[nodiscard]] u64 now() const {
+            auto const elapsed = Clock::now() - m_epoch;
+            return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+        void write_chrome_trace(std::ostream& stream) {
+            auto const lock = std::scoped_lock{ m_mutex };
+            stream << R"({"displayTimeUnit":"ms","traceEvents":[)";
+            auto is_first = true;
+            for (auto const& buffer : m_buffers) {
+                for (auto const& event : buffer->events()) {
+                    stream << std::format(
+                            R"({}{{"name":"{}","cat":"chip_chap","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":1,"tid":{}}})",
+                            (is_first ? "" : ",\n"),
+                            event.name,
+                            static_cast<double>(event.start_nanoseconds) / 1000.0,
+                            static_cast<double>(event.duration_nanoseconds) / 1000.0,
+                            buffer->thread_id()
+                    );
+                    is_first = false;
+                }
+                if (buffer->num_dropped() > 0) {
+                    stream << std::format(
+                            R"({}{{"name":"dropped {} events","ph":"i","s":"t","ts":0,"pid":1,"tid":{}}})",
+                            (is_first ? "" : ",\n"),
+                            buffer->num_dropped(),
+                            buffer->thread_id()
+                    );
+                    is_first = false;
+                }
+            }
+            stream << "]}\n";
+        }
+
+        bool write_chrome_trace(std::filesystem::path const& path) {
+            auto file = std::ofstream{ path };
+            if (not file) {
+                return false;
+            }
+            write_chrome_trace(file);
+            return static_cast<bool>(file);
+        }
+
+    private:
+        Registry() = default;
+    };
+
+    [[nodiscard]] inline ThreadBuffer& this_thread_buffer() {
+        thread_local auto& buffer = Registry::instance().register_thread();
+        return buffer;
+    }
+
+    class Scope final {
+    private:
+        char const* m_name;
+        u64 m_start;
+
+    public:
+        explicit Scope(char const* const name) : m_name{ name }, m_start{ Registry::instance().now() } { }
+
+        Scope(Scope const& other) = delete;
+        Scope(Scope&& other) noexcept = delete;
+        Scope& operator=(Scope const& other) = delete;
+        Scope& operator=(Scope&& other) noexcept = delete;
+
+        ~Scope() {
+            auto const end = Registry::instance().now();
+            this_thread_buffer().push(Event{ m_name, m_start, end - m_start });
+        }
+    };
+
+} // namespace trace
+
+#ifdef ENABLE_TRACING
+#define TRACE_CONCATENATE_IMPLEMENTATION(lhs, rhs) lhs##rhs
+#define TRACE_CONCATENATE(lhs, rhs) TRACE_CONCATENATE_IMPLEMENTATION(lhs, rhs)
+#define TRACE_SCOPE(name) ::trace::Scope const TRACE_CONCATENATE(trace_scope_, __LINE__){ name }
+#define TRACE_DUMP(path) static_cast<void>(::trace::Registry::instance().write_chrome_trace(path))
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_DUMP(path) static_cast<void>(path)
+#endif
@@ -1,15 +1,19 @@
 #pragma once
 
 #include "types.hpp"
-#include <sstream>
+#include <charconv>
+#include <concepts>
+#include <string_view>
+#include <system_error>
+#include <variant>
 
+// the whole text has to be a number, neither signs for unsigned types nor whitespace are accepted
 template<std::integral T>
-[[nodiscard]] Optional<T> to_int(std::string_view const text) {
-    auto stream = std::stringstream{};
-    stream << text;
+[[nodiscard]] Optional<T> to_int(std::string_view const text, int const base = 10) {
     auto result = T{};
-    stream >> result;
-    if (not stream or not stream.eof()) {
+    auto const end = text.data() + text.size();
+    auto const [last, error] = std::from_chars(text.data(), end, result, base);
+    if (error != std::errc{} or last != end) {
         return none;
     }
     return result;
@@ -0,0 +1,119 @@
+#include "call_graph.hpp"
+#include <algorithm>
+#include <format>
+#include <ostream>
+#include <string>
+
+namespace emulator {
+    CallGraph::CallGraph() {
+        reset();
+    }
+
+    void CallGraph::record_call(Address const target) {
+        if (m_untracked_depth > 0) {
+            ++m_untracked_depth;
+            return;
+        }
+        for (auto const child : m_nodes[m_current].children) {
+            if (m_nodes[child].address == target) {
+                m_current = child;
+                ++m_nodes[m_current].num_calls;
+                return;
+            }
+        }
+        if (m_nodes.size() == max_num_nodes) {
+            ++m_untracked_depth;
+            return;
+        }
+        auto const new_node = static_cast<NodeIndex>(m_nodes.size());
+        m_nodes.push_back(Node{ .address = target, .parent = m_current, .num_calls = 1 });
+        m_nodes[m_current].children.push_back(new_node);
+        m_current = new_node;
+    }
+
+    void CallGraph::record_return() {
+        if (m_untracked_depth > 0) {
+            --m_untracked_depth;
+            return;
+        }
+        if (m_current != root) {
+            m_current = m_nodes[m_current].parent;
+        }
+    }
+
+    void CallGraph::reset() {
+        m_nodes.clear();
+        m_nodes.push_back(Node{ .address = 0, .parent = root });
+        m_current = root;
+        m_untracked_depth = 0;
+    }
+
+    [[nodiscard]] std::vector<u64> CallGraph::inclusive_counts() const {
+        auto result = std::vector<u64>{};
+        result.reserve(m_nodes.size());
+        for (auto const& node : m_nodes) {
+            result.push_back(node.exclusive_count);
+        }
+        // children are always created after their parents, so a reverse pass accumulates whole subtrees
+        for (auto i = m_nodes.size() - 1; i > 0; --i) {
+            result.at(m_nodes.at(i).parent) += result.at(i);
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::vector<CallGraph::RoutineStatistics> CallGraph::routines() const {
+        static constexpr auto address_space_size = usize{ 0x1000 };
+
+        auto const inclusive = inclusive_counts();
+        auto statistics = std::vector<RoutineStatistics>(address_space_size, RoutineStatistics{ 0, 0, 0, 0 });
+        auto is_used = std::vector<bool>(address_space_size, false);
+        for (usize i = 1; i < m_nodes.size(); ++i) {
+            auto const& node = m_nodes.at(i);
+            auto& entry = statistics.at(node.address);
+            entry.address = node.address;
+            entry.num_calls += node.num_calls;
+            entry.exclusive_count += node.exclusive_count;
+            is_used.at(node.address) = true;
+
+            auto is_recursive = false;
+            for (auto ancestor = node.parent; ancestor != root; ancestor = m_nodes.at(ancestor).parent) {
+                if (m_nodes.at(ancestor).address == node.address) {
+                    is_recursive = true;
+                    break;
+                }
+            }
+            if (not is_recursive) {
+                entry.inclusive_count += inclusive.at(i);
+            }
+        }
+
+        auto result = std::vector<RoutineStatistics>{};
+        for (usize address = 0; address < address_space_size; ++address) {
+            if (is_used.at(address)) {
+                result.push_back(statistics.at(address));
+            }
+        }
+        std::sort(result.begin(), result.end(), [](RoutineStatistics const& lhs, RoutineStatistics const& rhs) {
+            return lhs.inclusive_count > rhs.inclusive_count;
+        });
+        return result;
+    }
+
+    void CallGraph::write_folded_stacks(std::ostream& stream) const {
+        auto path = std::vector<NodeIndex>{};
+        for (usize i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes.at(i).exclusive_count == 0) {
+                continue;
+            }
+            path.clear();
+            for (auto node = static_cast<NodeIndex>(i); node != root; node = m_nodes.at(node).parent) {
+                path.push_back(node);
+            }
+            auto line = std::string{ "root" };
+            for (auto it = path.crbegin(); it != path.crend(); ++it) {
+                line += std::format(";0x{:03X}", m_nodes.at(*it).address);
+            }
+            stream << std::format("{} {}\n", line, m_nodes.at(i).exclusive_count);
+        }
+    }
+} // namespace emulator
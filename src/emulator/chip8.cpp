@@ -16,6 +16,9 @@ namespace emulator {
           m_time_source{ &time_source },
           m_start_time{ time_source.elapsed_seconds() } {
         m_memory.resize(memory_size, u8{ 0 });
+#ifdef ENABLE_EMULATOR_PROFILING
+        m_profile = ExecutionProfile{ memory_size };
+#endif
 
         // store default font glyphs
         static constexpr auto font_glyphs = std::array<u8, 16 * 5>{
@@ -54,6 +57,22 @@ namespace emulator {
                 | m_memory.at(instruction_pointer() + 1)
             );
         // clang-format on
+#ifdef ENABLE_EMULATOR_PROFILING
+        m_profile.record(instruction_pointer(), opcode);
+#endif
+        if (m_trace_sink == nullptr) {
+            execute(opcode);
+            return;
+        }
+
+        auto const instruction_pointer_before = instruction_pointer();
+        auto const registers_before = m_registers;
+        auto const address_register_before = m_address_register;
+        execute(opcode);
+        record_trace(instruction_pointer_before, opcode, registers_before, address_register_before);
+    }
+
+    void Chip8::execute(u16 const opcode) {
         auto const opcode_id = static_cast<u8>(opcode >> 12);
         auto const nn = static_cast<u8>(opcode & 0xFF);
         auto const nnn = static_cast<Address>(opcode & 0xFFF);
@@ -74,6 +93,9 @@ namespace emulator {
                     }
                     auto const return_address = m_callstack.back();
                     m_callstack.pop_back();
+#ifdef ENABLE_EMULATOR_PROFILING
+                    m_profile.record_return();
+#endif
                     m_instruction_pointer = return_address;
                     break;
                 }
@@ -88,6 +110,9 @@ namespace emulator {
                 // 2NNN: Execute subroutine starting at address NNN
                 m_callstack.push_back(m_instruction_pointer + 2);
                 m_instruction_pointer = nnn;
+#ifdef ENABLE_EMULATOR_PROFILING
+                m_profile.record_call(nnn);
+#endif
                 break;
             case 3:
                 // 3XNN: Skip the following instruction if the value of register VX equals NN
@@ -355,6 +380,49 @@ namespace emulator {
         }
     }
 
+    void Chip8::record_trace(
+            Address const instruction_pointer_before,
+            u16 const opcode,
+            std::array<u8, 16> const& registers_before,
+            Address const address_register_before
+    ) {
+        auto register_deltas = std::array<RegisterDelta, 17>{};
+        auto num_register_deltas = usize{ 0 };
+        for (u8 i = 0; i < m_registers.size(); ++i) {
+            if (m_registers.at(i) != registers_before.at(i)) {
+                register_deltas.at(num_register_deltas++) = RegisterDelta{ i, m_registers.at(i) };
+            }
+        }
+        if (m_address_register != address_register_before) {
+            register_deltas.at(num_register_deltas++) =
+                    RegisterDelta{ RegisterDelta::address_register, m_address_register };
+        }
+
+        // only FX33 and FX55 write into memory, both of them start at the previous value of I
+        auto num_bytes_written = usize{ 0 };
+        if ((opcode & 0xF0FF) == 0xF033) {
+            num_bytes_written = 3;
+        } else if ((opcode & 0xF0FF) == 0xF055) {
+            num_bytes_written = static_cast<usize>(((opcode & 0xF00) >> 8) + 1);
+        }
+        auto memory_deltas = std::array<MemoryDelta, 16>{};
+        auto num_memory_deltas = usize{ 0 };
+        for (usize i = 0; i < num_bytes_written; ++i) {
+            auto const address = static_cast<usize>(address_register_before) + i;
+            if (address < m_memory.size()) {
+                memory_deltas.at(num_memory_deltas++) =
+                        MemoryDelta{ static_cast<Address>(address), m_memory.at(address) };
+            }
+        }
+
+        m_trace_sink->record(ExecutedInstruction{
+                instruction_pointer_before,
+                opcode,
+                std::span{ register_deltas.data(), num_register_deltas },
+                std::span{ memory_deltas.data(), num_memory_deltas },
+        });
+    }
+
     void Chip8::advance() {
         m_instruction_pointer += 2;
     }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <common/types.hpp>
+#include <span>
+
+namespace emulator {
+
+    struct RegisterDelta {
+        static constexpr auto address_register = u8{ 0x10 };
+
+        u8 register_index; // 0x0-0xF for the data registers, `address_register` for I
+        u16 value;
+    };
+
+    struct MemoryDelta {
+        u16 address;
+        u8 value;
+    };
+
+    // state changes caused by a single executed instruction
+    struct ExecutedInstruction {
+        u16 instruction_pointer;
+        u16 opcode;
+        std::span<RegisterDelta const> register_deltas;
+        std::span<MemoryDelta const> memory_deltas;
+    };
+
+    class BasicTraceSink {
+    public:
+        virtual ~BasicTraceSink() = default;
+
+        virtual void record(ExecutedInstruction const& instruction) = 0;
+    };
+
+} // namespace emulator
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <common/types.hpp>
+#include <iosfwd>
+#include <vector>
+
+namespace emulator {
+
+    // Calling context tree built from the executed 2NNN (call) and 00EE (return) instructions. Every executed
+    // instruction is attributed to the node of the subroutine that is currently running. Since every instruction
+    // takes the same amount of emulated time, instruction counts are cycle counts.
+    class CallGraph final {
+    public:
+        using Address = u16;
+        using NodeIndex = u32;
+
+        static constexpr auto root = NodeIndex{ 0 };
+        static constexpr auto max_num_nodes = usize{ 1 } << 16;
+
+        struct Node {
+            Address address; // call target (0 for the root)
+            NodeIndex parent;
+            u64 num_calls = 0;
+            u64 exclusive_count = 0;
+            std::vector<NodeIndex> children = {};
+        };
+
+        struct RoutineStatistics {
+            Address address;
+            u64 num_calls;
+            u64 inclusive_count;
+            u64 exclusive_count;
+        };
+
+    private:
+        std::vector<Node> m_nodes;
+        NodeIndex m_current = root;
+        usize m_untracked_depth = 0; // calls that didn't get their own node because the tree is full
+
+    public:
+        CallGraph();
+
+        void record_instruction() {
+            ++m_nodes[m_current].exclusive_count;
+        }
+
+        void record_call(Address target);
+        void record_return();
+        void reset();
+
+        [[nodiscard]] std::vector<Node> const& nodes() const {
+            return m_nodes;
+        }
+
+        [[nodiscard]] std::vector<u64> inclusive_counts() const;
+
+        // per call target, recursive calls are only counted once towards the inclusive count
+        [[nodiscard]] std::vector<RoutineStatistics> routines() const;
+
+        // one line per calling context in the format of Brendan Gregg's flamegraph.pl ("root;0x2A0;0x2F0 42")
+        void write_folded_stacks(std::ostream& stream) const;
+    };
+
+} // namespace emulator
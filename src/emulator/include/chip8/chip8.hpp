@@ -3,6 +3,8 @@
 #include "basic_input_source.hpp"
 #include "basic_screen.hpp"
 #include "basic_time_source.hpp"
+#include "basic_trace_sink.hpp"
+#include "profile.hpp"
 #include <array>
 #include <common/types.hpp>
 #include <random>
@@ -33,7 +35,11 @@ namespace emulator {
         BasicScreen* m_screen;
         BasicInputSource* m_input_source;
         BasicTimeSource* m_time_source;
+        BasicTraceSink* m_trace_sink = nullptr;
         double m_start_time;
+#ifdef ENABLE_EMULATOR_PROFILING
+        ExecutionProfile m_profile;
+#endif
 
         static constexpr auto display_width = 64;
         static constexpr auto display_height = 32;
@@ -46,6 +52,11 @@ namespace emulator {
 
         void execute_next_instruction();
 
+        // every instruction executed while a sink is set is reported to it (pass nullptr to stop tracing)
+        void set_trace_sink(BasicTraceSink* const trace_sink) {
+            m_trace_sink = trace_sink;
+        }
+
         [[nodiscard]] u8 read(Address const address) const {
             return m_memory.at(address);
         }
@@ -92,7 +103,24 @@ namespace emulator {
             return m_halted;
         }
 
+#ifdef ENABLE_EMULATOR_PROFILING
+        [[nodiscard]] ExecutionProfile const& profile() const {
+            return m_profile;
+        }
+
+        void reset_profile() {
+            m_profile.reset();
+        }
+#endif
+
     private:
+        void execute(u16 opcode);
+        void record_trace(
+                Address instruction_pointer_before,
+                u16 opcode,
+                std::array<u8, 16> const& registers_before,
+                Address address_register_before
+        );
         void advance();
     };
 
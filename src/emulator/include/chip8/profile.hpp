@@ -0,0 +1,105 @@
+#pragma once
+
+#include "call_graph.hpp"
+#include <array>
+#include <common/types.hpp>
+#include <string_view>
+#include <vector>
+
+namespace emulator {
+
+    enum class OpcodeClass : u8 {
+        ClearScreen,             // 00E0
+        Return,                  // 00EE
+        Jump,                    // 1NNN
+        Call,                    // 2NNN
+        SkipIfEqual,             // 3XNN
+        SkipIfNotEqual,          // 4XNN
+        SkipIfRegistersEqual,    // 5XY0
+        StoreImmediate,          // 6XNN
+        AddImmediate,            // 7XNN
+        Copy,                    // 8XY0
+        Or,                      // 8XY1
+        And,                     // 8XY2
+        Xor,                     // 8XY3
+        Add,                     // 8XY4
+        Subtract,                // 8XY5
+        ShiftRight,              // 8XY6
+        ReverseSubtract,         // 8XY7
+        ShiftLeft,               // 8XYE
+        SkipIfRegistersNotEqual, // 9XY0
+        SetAddressRegister,      // ANNN
+        JumpWithOffset,          // BNNN
+        Random,                  // CXNN
+        Draw,                    // DXYN
+        SkipIfKeyPressed,        // EX9E
+        SkipIfKeyNotPressed,     // EXA1
+        ReadDelayTimer,          // FX07
+        AwaitKeypress,           // FX0A
+        SetDelayTimer,           // FX15
+        SetSoundTimer,           // FX18
+        AddToAddressRegister,    // FX1E
+        LoadGlyphAddress,        // FX29
+        StoreBcd,                // FX33
+        StoreRegisters,          // FX55
+        LoadRegisters,           // FX65
+        Invalid,
+    };
+
+    inline constexpr auto num_opcode_classes = static_cast<usize>(OpcodeClass::Invalid) + 1;
+
+    [[nodiscard]] OpcodeClass classify_opcode(u16 opcode);
+    [[nodiscard]] std::string_view opcode_pattern(OpcodeClass opcode_class);
+
+    // Flat execution counters plus a call graph. Recording an instruction costs a classification and three
+    // array increments.
+    class ExecutionProfile final {
+    private:
+        std::array<u64, num_opcode_classes> m_opcode_counts = {};
+        std::vector<u64> m_address_counts;
+        u64 m_num_instructions = 0;
+        CallGraph m_call_graph;
+
+    public:
+        ExecutionProfile() = default;
+        explicit ExecutionProfile(usize const memory_size) : m_address_counts(memory_size, u64{ 0 }) { }
+
+        void record(u16 const address, u16 const opcode) {
+            ++m_opcode_counts[static_cast<usize>(classify_opcode(opcode))];
+            ++m_address_counts[address];
+            ++m_num_instructions;
+            m_call_graph.record_instruction();
+        }
+
+        void record_call(u16 const target) {
+            m_call_graph.record_call(target);
+        }
+
+        void record_return() {
+            m_call_graph.record_return();
+        }
+
+        void reset();
+
+        [[nodiscard]] std::array<u64, num_opcode_classes> const& opcode_counts() const {
+            return m_opcode_counts;
+        }
+
+        [[nodiscard]] u64 opcode_count(OpcodeClass const opcode_class) const {
+            return m_opcode_counts.at(static_cast<usize>(opcode_class));
+        }
+
+        [[nodiscard]] std::vector<u64> const& address_counts() const {
+            return m_address_counts;
+        }
+
+        [[nodiscard]] u64 num_instructions() const {
+            return m_num_instructions;
+        }
+
+        [[nodiscard]] CallGraph const& call_graph() const {
+            return m_call_graph;
+        }
+    };
+
+} // namespace emulator
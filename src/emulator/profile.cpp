@@ -0,0 +1,114 @@
+#include "profile.hpp"
+#include <algorithm>
+
+namespace emulator {
+    [[nodiscard]] OpcodeClass classify_opcode(u16 const opcode) {
+        switch (opcode >> 12) {
+            case 0x0:
+                if (opcode == 0x00E0) {
+                    return OpcodeClass::ClearScreen;
+                }
+                if (opcode == 0x00EE) {
+                    return OpcodeClass::Return;
+                }
+                return OpcodeClass::Invalid;
+            case 0x1:
+                return OpcodeClass::Jump;
+            case 0x2:
+                return OpcodeClass::Call;
+            case 0x3:
+                return OpcodeClass::SkipIfEqual;
+            case 0x4:
+                return OpcodeClass::SkipIfNotEqual;
+            case 0x5:
+                return (opcode & 0xF) == 0 ? OpcodeClass::SkipIfRegistersEqual : OpcodeClass::Invalid;
+            case 0x6:
+                return OpcodeClass::StoreImmediate;
+            case 0x7:
+                return OpcodeClass::AddImmediate;
+            case 0x8:
+                switch (opcode & 0xF) {
+                    case 0x0:
+                        return OpcodeClass::Copy;
+                    case 0x1:
+                        return OpcodeClass::Or;
+                    case 0x2:
+                        return OpcodeClass::And;
+                    case 0x3:
+                        return OpcodeClass::Xor;
+                    case 0x4:
+                        return OpcodeClass::Add;
+                    case 0x5:
+                        return OpcodeClass::Subtract;
+                    case 0x6:
+                        return OpcodeClass::ShiftRight;
+                    case 0x7:
+                        return OpcodeClass::ReverseSubtract;
+                    case 0xE:
+                        return OpcodeClass::ShiftLeft;
+                    default:
+                        return OpcodeClass::Invalid;
+                }
+            case 0x9:
+                return OpcodeClass::SkipIfRegistersNotEqual;
+            case 0xA:
+                return OpcodeClass::SetAddressRegister;
+            case 0xB:
+                return OpcodeClass::JumpWithOffset;
+            case 0xC:
+                return OpcodeClass::Random;
+            case 0xD:
+                return OpcodeClass::Draw;
+            case 0xE:
+                switch (opcode & 0xFF) {
+                    case 0x9E:
+                        return OpcodeClass::SkipIfKeyPressed;
+                    case 0xA1:
+                        return OpcodeClass::SkipIfKeyNotPressed;
+                    default:
+                        return OpcodeClass::Invalid;
+                }
+            case 0xF:
+                switch (opcode & 0xFF) {
+                    case 0x07:
+                        return OpcodeClass::ReadDelayTimer;
+                    case 0x0A:
+                        return OpcodeClass::AwaitKeypress;
+                    case 0x15:
+                        return OpcodeClass::SetDelayTimer;
+                    case 0x18:
+                        return OpcodeClass::SetSoundTimer;
+                    case 0x1E:
+                        return OpcodeClass::AddToAddressRegister;
+                    case 0x29:
+                        return OpcodeClass::LoadGlyphAddress;
+                    case 0x33:
+                        return OpcodeClass::StoreBcd;
+                    case 0x55:
+                        return OpcodeClass::StoreRegisters;
+                    case 0x65:
+                        return OpcodeClass::LoadRegisters;
+                    default:
+                        return OpcodeClass::Invalid;
+                }
+            default:
+                return OpcodeClass::Invalid;
+        }
+    }
+
+    [[nodiscard]] std::string_view opcode_pattern(OpcodeClass const opcode_class) {
+        static constexpr auto patterns = std::array<std::string_view, num_opcode_classes>{
+            "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN", "8XY0", "8XY1", "8XY2",
+            "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E",
+            "EXA1", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65", "????",
+        };
+        return patterns.at(static_cast<usize>(opcode_class));
+    }
+
+    void ExecutionProfile::reset() {
+        m_opcode_counts = {};
+        std::fill(m_address_counts.begin(), m_address_counts.end(), u64{ 0 });
+        m_num_instructions = 0;
+        m_call_graph.reset();
+    }
+} // namespace emulator
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <common/little_endian.hpp>
+#include <common/types.hpp>
+#include <stdexcept>
+
+// Binary layout of an instruction trace file (all integers are little endian):
+//
+//   header:  "CH8TRACE", u32 version, u32 index interval
+//   records: u16 instruction pointer, u16 opcode, u8 #register deltas, u8 #memory deltas,
+//            register deltas (u8 register index, u16 value), memory deltas (u16 address, u8 value)
+//   index:   u64 file offset of every record whose cycle is a multiple of the index interval
+//   footer:  u64 #records, u64 index offset, u64 #index entries, "CH8INDEX"
+//
+// The cycle of a record is its position within the file, since every executed instruction produces one record.
+
+namespace instruction_trace {
+
+    class TraceError final : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    inline constexpr auto header_magic = std::array{ 'C', 'H', '8', 'T', 'R', 'A', 'C', 'E' };
+    inline constexpr auto footer_magic = std::array{ 'C', 'H', '8', 'I', 'N', 'D', 'E', 'X' };
+    inline constexpr auto format_version = u32{ 1 };
+    inline constexpr auto index_interval = u32{ 4096 };
+
+    inline constexpr auto header_size = usize{ 16 };
+    inline constexpr auto footer_size = usize{ 32 };
+    inline constexpr auto record_header_size = usize{ 6 };
+    inline constexpr auto register_delta_size = usize{ 3 };
+    inline constexpr auto memory_delta_size = usize{ 3 };
+
+} // namespace instruction_trace
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "format.hpp"
+#include <chip8/basic_trace_sink.hpp>
+#include <common/mapped_file.hpp>
+#include <filesystem>
+
+namespace instruction_trace {
+
+    struct Record {
+        u16 instruction_pointer = 0;
+        u16 opcode = 0;
+        u8 num_register_deltas = 0;
+        u8 num_memory_deltas = 0;
+        std::array<emulator::RegisterDelta, 17> register_deltas = {};
+        std::array<emulator::MemoryDelta, 16> memory_deltas = {};
+
+        [[nodiscard]] std::span<emulator::RegisterDelta const> changed_registers() const {
+            return { register_deltas.data(), num_register_deltas };
+        }
+
+        [[nodiscard]] std::span<emulator::MemoryDelta const> changed_memory() const {
+            return { memory_deltas.data(), num_memory_deltas };
+        }
+    };
+
+    // Reads trace files written by `TraceWriter` directly from a memory mapping. Seeking to a cycle uses the
+    // index and decodes at most `index_interval - 1` records.
+    class TraceReader final {
+    private:
+        MappedFile m_file;
+        u64 m_num_records = 0;
+        u64 m_index_offset = 0;
+        u64 m_num_index_entries = 0;
+
+    public:
+        explicit TraceReader(std::filesystem::path const& path);
+
+        [[nodiscard]] u64 num_records() const {
+            return m_num_records;
+        }
+
+        [[nodiscard]] Record read(u64 cycle) const;
+
+        // decodes up to `count` records starting at `first_cycle`
+        [[nodiscard]] std::vector<Record> read(u64 first_cycle, u64 count) const;
+
+        // cycle of the first record that differs between both traces (including one trace ending early)
+        friend Optional<u64> find_first_divergence(TraceReader const& lhs, TraceReader const& rhs);
+
+    private:
+        [[nodiscard]] u64 index_entry(u64 entry) const;
+        [[nodiscard]] u64 block_end(u64 entry) const;
+        [[nodiscard]] u64 seek(u64 cycle) const;
+        [[nodiscard]] u64 record_size(u64 offset) const;
+        [[nodiscard]] Record decode(u64 offset) const;
+    };
+
+    [[nodiscard]] Optional<u64> find_first_divergence(TraceReader const& lhs, TraceReader const& rhs);
+
+} // namespace instruction_trace
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "format.hpp"
+#include <atomic>
+#include <chip8/basic_trace_sink.hpp>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace instruction_trace {
+
+    // Encodes executed instructions into a memory buffer. Full buffers are handed over to a background thread
+    // that writes them to disk, so the emulator only waits for the disk if it outpaces it by a whole buffer.
+    class TraceWriter final : public emulator::BasicTraceSink {
+    public:
+        static constexpr auto buffer_capacity = usize{ 4 } * 1024 * 1024;
+
+    private:
+        std::ofstream m_file;
+        std::vector<std::byte> m_buffer;  // filled by the emulator thread
+        std::vector<std::byte> m_pending; // owned by the writer thread while `m_has_pending` is set
+        std::vector<u64> m_index;
+        u64 m_num_records = 0;
+        u64 m_offset = header_size; // file offset of the next record
+        bool m_finished = false;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_has_pending = false;
+        bool m_stopping = false;
+        std::atomic<bool> m_write_failed = false;
+        std::jthread m_writer_thread;
+
+    public:
+        explicit TraceWriter(std::filesystem::path const& path);
+        TraceWriter(TraceWriter const& other) = delete;
+        TraceWriter(TraceWriter&& other) = delete;
+        TraceWriter& operator=(TraceWriter const& other) = delete;
+        TraceWriter& operator=(TraceWriter&& other) = delete;
+        ~TraceWriter() override;
+
+        void record(emulator::ExecutedInstruction const& instruction) override;
+
+        // writes the remaining records, the index and the footer; the writer must not be used afterwards
+        void finish();
+
+        [[nodiscard]] u64 num_records() const {
+            return m_num_records;
+        }
+
+    private:
+        void hand_off();
+        void write_pending_buffers();
+    };
+
+} // namespace instruction_trace
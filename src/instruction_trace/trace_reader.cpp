@@ -0,0 +1,156 @@
+#include "trace_reader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <gsl/gsl>
+
+namespace instruction_trace {
+    TraceReader::TraceReader(std::filesystem::path const& path) : m_file{ path } {
+        auto const bytes = m_file.bytes();
+        if (bytes.size() < header_size + footer_size
+            or std::memcmp(bytes.data(), header_magic.data(), header_magic.size()) != 0
+            or std::memcmp(bytes.data() + bytes.size() - footer_magic.size(), footer_magic.data(), footer_magic.size())
+                       != 0) {
+            throw TraceError{ std::format("'{}' is not a complete instruction trace", path.string()) };
+        }
+        if (read_little_endian<u32>(bytes, 8) != format_version or read_little_endian<u32>(bytes, 12) != index_interval
+        ) {
+            throw TraceError{ std::format("unsupported format version or index interval in '{}'", path.string()) };
+        }
+
+        auto const footer_offset = bytes.size() - footer_size;
+        m_num_records = read_little_endian<u64>(bytes, footer_offset);
+        m_index_offset = read_little_endian<u64>(bytes, footer_offset + 8);
+        m_num_index_entries = read_little_endian<u64>(bytes, footer_offset + 16);
+        auto const expected_index_entries = (m_num_records + index_interval - 1) / index_interval;
+        if (m_num_index_entries != expected_index_entries or m_index_offset < header_size
+            or m_index_offset + m_num_index_entries * sizeof(u64) != footer_offset) {
+            throw TraceError{ std::format("corrupt index in trace file '{}'", path.string()) };
+        }
+    }
+
+    [[nodiscard]] Record TraceReader::read(u64 const cycle) const {
+        if (cycle >= m_num_records) {
+            throw TraceError{ std::format("cycle {} is out of range (trace contains {} records)", cycle, m_num_records) };
+        }
+        return decode(seek(cycle));
+    }
+
+    [[nodiscard]] std::vector<Record> TraceReader::read(u64 const first_cycle, u64 const count) const {
+        auto result = std::vector<Record>{};
+        if (first_cycle >= m_num_records) {
+            return result;
+        }
+        auto const end_cycle = first_cycle + std::min(count, m_num_records - first_cycle);
+        result.reserve(gsl::narrow<usize>(end_cycle - first_cycle));
+        auto offset = seek(first_cycle);
+        for (auto cycle = first_cycle; cycle < end_cycle; ++cycle) {
+            result.push_back(decode(offset));
+            offset += record_size(offset);
+        }
+        return result;
+    }
+
+    [[nodiscard]] Optional<u64> find_first_divergence(TraceReader const& lhs, TraceReader const& rhs) {
+        auto const lhs_bytes = lhs.m_file.bytes();
+        auto const rhs_bytes = rhs.m_file.bytes();
+        auto const num_common_records = std::min(lhs.m_num_records, rhs.m_num_records);
+        auto const num_common_blocks = std::min(lhs.m_num_index_entries, rhs.m_num_index_entries);
+
+        for (u64 block = 0; block < num_common_blocks; ++block) {
+            auto const lhs_begin = lhs.index_entry(block);
+            auto const rhs_begin = rhs.index_entry(block);
+            auto const lhs_size = lhs.block_end(block) - lhs_begin;
+            auto const rhs_size = rhs.block_end(block) - rhs_begin;
+            // the encoding is canonical, so identical blocks are identical byte sequences
+            if (lhs_size == rhs_size
+                and std::memcmp(lhs_bytes.data() + lhs_begin, rhs_bytes.data() + rhs_begin, lhs_size) == 0) {
+                continue;
+            }
+
+            auto lhs_offset = lhs_begin;
+            auto rhs_offset = rhs_begin;
+            auto const end_cycle = std::min((block + 1) * index_interval, num_common_records);
+            for (auto cycle = block * index_interval; cycle < end_cycle; ++cycle) {
+                auto const size = lhs.record_size(lhs_offset);
+                if (size != rhs.record_size(rhs_offset)
+                    or std::memcmp(lhs_bytes.data() + lhs_offset, rhs_bytes.data() + rhs_offset, size) != 0) {
+                    return cycle;
+                }
+                lhs_offset += size;
+                rhs_offset += size;
+            }
+            // all common records of this block are equal, so one of the traces ends within it
+            break;
+        }
+
+        if (lhs.m_num_records != rhs.m_num_records) {
+            return num_common_records;
+        }
+        return none;
+    }
+
+    [[nodiscard]] u64 TraceReader::index_entry(u64 const entry) const {
+        return read_little_endian<u64>(m_file.bytes(), gsl::narrow<usize>(m_index_offset + entry * sizeof(u64)));
+    }
+
+    [[nodiscard]] u64 TraceReader::block_end(u64 const entry) const {
+        return entry + 1 < m_num_index_entries ? index_entry(entry + 1) : m_index_offset;
+    }
+
+    [[nodiscard]] u64 TraceReader::seek(u64 const cycle) const {
+        auto offset = index_entry(cycle / index_interval);
+        for (auto i = cycle % index_interval; i > 0; --i) {
+            offset += record_size(offset);
+        }
+        return offset;
+    }
+
+    [[nodiscard]] u64 TraceReader::record_size(u64 const offset) const {
+        if (offset + record_header_size > m_index_offset) {
+            throw TraceError{ "trace record exceeds the record section" };
+        }
+        auto const bytes = m_file.bytes();
+        auto const position = gsl::narrow<usize>(offset);
+        auto const num_register_deltas = static_cast<u64>(bytes[position + 4]);
+        auto const num_memory_deltas = static_cast<u64>(bytes[position + 5]);
+        auto const size =
+                record_header_size + num_register_deltas * register_delta_size + num_memory_deltas * memory_delta_size;
+        if (offset + size > m_index_offset) {
+            throw TraceError{ "trace record exceeds the record section" };
+        }
+        return size;
+    }
+
+    [[nodiscard]] Record TraceReader::decode(u64 const offset) const {
+        auto const bytes = m_file.bytes();
+        static_cast<void>(record_size(offset)); // bounds check
+
+        auto position = gsl::narrow<usize>(offset);
+        auto result = Record{};
+        result.instruction_pointer = read_little_endian<u16>(bytes, position);
+        result.opcode = read_little_endian<u16>(bytes, position + 2);
+        result.num_register_deltas = static_cast<u8>(bytes[position + 4]);
+        result.num_memory_deltas = static_cast<u8>(bytes[position + 5]);
+        if (result.num_register_deltas > result.register_deltas.size()
+            or result.num_memory_deltas > result.memory_deltas.size()) {
+            throw TraceError{ std::format("corrupt trace record at offset {}", offset) };
+        }
+        position += record_header_size;
+        for (usize i = 0; i < result.num_register_deltas; ++i) {
+            result.register_deltas.at(i) = emulator::RegisterDelta{
+                static_cast<u8>(bytes[position]),
+                read_little_endian<u16>(bytes, position + 1),
+            };
+            position += register_delta_size;
+        }
+        for (usize i = 0; i < result.num_memory_deltas; ++i) {
+            result.memory_deltas.at(i) = emulator::MemoryDelta{
+                read_little_endian<u16>(bytes, position),
+                static_cast<u8>(bytes[position + 2]),
+            };
+            position += memory_delta_size;
+        }
+        return result;
+    }
+} // namespace instruction_trace
@@ -0,0 +1,127 @@
+#include "trace_writer.hpp"
+#include <format>
+
+namespace instruction_trace {
+    TraceWriter::TraceWriter(std::filesystem::path const& path) : m_file{ path, std::ios::binary } {
+        if (not m_file) {
+            throw TraceError{ std::format("unable to open trace file '{}' for writing", path.string()) };
+        }
+        m_buffer.reserve(buffer_capacity);
+        m_pending.reserve(buffer_capacity);
+
+        for (auto const c : header_magic) {
+            m_buffer.push_back(static_cast<std::byte>(c));
+        }
+        append_little_endian(m_buffer, format_version);
+        append_little_endian(m_buffer, index_interval);
+
+        m_writer_thread = std::jthread{ [this] { write_pending_buffers(); } };
+    }
+
+    TraceWriter::~TraceWriter() {
+        if (m_finished) {
+            return;
+        }
+        try {
+            finish();
+        } catch (...) {
+            // a destructor must not throw, call finish() explicitly to observe write errors
+        }
+    }
+
+    void TraceWriter::record(emulator::ExecutedInstruction const& instruction) {
+        if (m_num_records % index_interval == 0) {
+            m_index.push_back(m_offset);
+        }
+
+        auto const size_before = m_buffer.size();
+        append_little_endian(m_buffer, instruction.instruction_pointer);
+        append_little_endian(m_buffer, instruction.opcode);
+        m_buffer.push_back(static_cast<std::byte>(instruction.register_deltas.size()));
+        m_buffer.push_back(static_cast<std::byte>(instruction.memory_deltas.size()));
+        for (auto const& delta : instruction.register_deltas) {
+            m_buffer.push_back(static_cast<std::byte>(delta.register_index));
+            append_little_endian(m_buffer, delta.value);
+        }
+        for (auto const& delta : instruction.memory_deltas) {
+            append_little_endian(m_buffer, delta.address);
+            m_buffer.push_back(static_cast<std::byte>(delta.value));
+        }
+        m_offset += m_buffer.size() - size_before;
+        ++m_num_records;
+
+        if (m_buffer.size() >= buffer_capacity) {
+            hand_off();
+        }
+    }
+
+    void TraceWriter::finish() {
+        if (m_finished) {
+            return;
+        }
+        m_finished = true;
+
+        auto const index_offset = m_offset;
+        for (auto const offset : m_index) {
+            append_little_endian(m_buffer, offset);
+        }
+        append_little_endian(m_buffer, m_num_records);
+        append_little_endian(m_buffer, index_offset);
+        append_little_endian(m_buffer, u64{ m_index.size() });
+        for (auto const c : footer_magic) {
+            m_buffer.push_back(static_cast<std::byte>(c));
+        }
+        hand_off();
+
+        {
+            auto const lock = std::scoped_lock{ m_mutex };
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        m_writer_thread.join();
+        m_file.close();
+
+        if (m_write_failed or not m_file) {
+            throw TraceError{ "unable to write trace file" };
+        }
+    }
+
+    void TraceWriter::hand_off() {
+        {
+            auto lock = std::unique_lock{ m_mutex };
+            m_condition.wait(lock, [this] { return not m_has_pending; });
+            std::swap(m_buffer, m_pending);
+            m_has_pending = true;
+        }
+        m_condition.notify_all();
+        m_buffer.clear();
+    }
+
+    void TraceWriter::write_pending_buffers() {
+        while (true) {
+            {
+                auto lock = std::unique_lock{ m_mutex };
+                m_condition.wait(lock, [this] { return m_has_pending or m_stopping; });
+                if (not m_has_pending) {
+                    return;
+                }
+            }
+
+            // the emulator thread doesn't touch the pending buffer until `m_has_pending` is reset
+            m_file.write(
+                    reinterpret_cast<char const*>(m_pending.data()),
+                    static_cast<std::streamsize>(m_pending.size())
+            );
+            if (not m_file) {
+                m_write_failed = true;
+            }
+            m_pending.clear();
+
+            {
+                auto const lock = std::scoped_lock{ m_mutex };
+                m_has_pending = false;
+            }
+            m_condition.notify_all();
+        }
+    }
+} // namespace instruction_trace
@@ -27,7 +27,8 @@ later:
     jump start4
 )"sv;
     try {
-        auto machine_code = chissembler::assemble("stdin", source);
+        auto machine_code =
+                chissembler::assemble("stdin", source, chissembler::AssembleOptions{ .listing = &std::cout });
     } catch (chissembler::LexerError& e) {
         std::cerr << e.what() << '\n';
     } catch (chissembler::EmitterError& e) {
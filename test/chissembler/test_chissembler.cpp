@@ -1,15 +1,27 @@
 #include <array>
 #include <chip8/chip8.hpp>
+#include <chissembler/cache.hpp>
 #include <chissembler/chissembler.hpp>
+#include <chrono>
 #include <common/random.hpp>
 #include <common/types.hpp>
+#include <cstdlib>
+#include <filesystem>
 #include <format>
+#include <fstream>
 #include <gsl/gsl>
 #include <gtest/gtest.h>
 #include <mock_input_source.hpp>
 #include <mock_screen.hpp>
 #include <mock_time_source.hpp>
+#include <new>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <vector>
 
 using namespace std::string_view_literals;
 
@@ -22,6 +34,40 @@ using namespace std::string_view_literals;
     } while (false)
 #endif
 
+// every allocation of this test executable goes through here, so tests can count them
+static auto num_allocations = usize{ 0 };
+
+void* operator new(std::size_t const size) {
+    ++num_allocations;
+    if (auto const memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t const size, std::nothrow_t const&) noexcept {
+    ++num_allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* const memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* const memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* const memory, std::nothrow_t const&) noexcept {
+    std::free(memory);
+}
+
+[[nodiscard]] static usize count_allocations(auto&& function) {
+    auto const before = num_allocations;
+    function();
+    return num_allocations - before;
+}
+
 static constexpr auto data_registers = std::array{
     std::tuple{  u8{ 0 }, "V0"sv },
     std::tuple{  u8{ 1 }, "V1"sv },
@@ -393,4 +439,994 @@ xor V5 V6
     auto const state = execute(machine_code);
     EXPECT_EQ(0b0100, state.emulator.registers().at(0x6));
     EXPECT_EQ(14, state.emulator.registers().at(0x5));
-}
\ No newline at end of file
+}
+
+TEST(ChissemblerTests, WritesListingOnlyWhenRequested) {
+    static constexpr auto source = R"(start:
+    copy 42 V0
+    jump start
+)"sv;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(chissembler::assemble("stdin"sv, source), combine_instructions(0x602A, 0x1200));
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+    auto listing = std::ostringstream{};
+    auto const machine_code =
+            chissembler::assemble("stdin"sv, source, chissembler::AssembleOptions{ .listing = &listing });
+    EXPECT_EQ(machine_code, combine_instructions(0x602A, 0x1200));
+    EXPECT_EQ(
+            listing.str(),
+            "                  start:\n"
+            "0x200  602A           copy 42 V0\n"
+            "0x202  1200           jump start\n"
+    );
+}
+
+TEST(ChissemblerTests, ErrorsReportLineAndColumn) {
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, "copy 1 V0\n  add 1 V0\ncopy 256 VA"sv);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(e.what(), "stdin:3:6: '256' is not a valid 8 bit value");
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, IdentifiersResemblingKeywordsAreLabels) {
+    static constexpr auto source = R"(cop:
+adds:
+an:
+jumps:
+xor_:
+    jump adds
+    jump jumps
+)"sv;
+    auto const machine_code = chissembler::assemble("stdin"sv, source);
+    EXPECT_EQ(machine_code, combine_instructions(0x1200, 0x1200));
+}
+
+TEST(ChissemblerTests, LongRunsOfWhitespaceDigitsAndIdentifierCharacters) {
+    // the runs cross the 16 and 32 byte boundaries of the vectorized scanner at every possible position
+    static constexpr auto whitespace_characters = " \t\r\v\f"sv;
+    auto const whitespace = [](usize const length) {
+        auto result = std::string{};
+        for (usize i = 0; i < length; ++i) {
+            result += whitespace_characters[i % whitespace_characters.length()];
+        }
+        return result;
+    };
+
+    auto source = std::string{};
+    auto instructions = std::vector<u16>{};
+    for (usize length = 1; length <= 80; ++length) {
+        auto const label = "l_" + std::string(length, 'x');
+        auto const value = gsl::narrow<u8>(length % 200);
+        auto digits = std::to_string(value);
+        digits.insert(0, length - std::min(length, digits.length()), '0');
+        auto const separator = whitespace(length);
+        source += separator + label + ":\n";
+        source += separator + "copy" + separator + digits + separator + "V1" + separator + "\n";
+        source += separator + "jump" + separator + label + "\n";
+        instructions.push_back(gsl::narrow<u16>(0x6100 | value));
+        instructions.push_back(gsl::narrow<u16>(0x1200 + 4 * (length - 1)));
+    }
+    auto const machine_code = chissembler::assemble("stdin"sv, source);
+    EXPECT_EQ(machine_code, combine_instructions(instructions));
+}
+
+TEST(ChissemblerTests, JumpsToLabelsDefinedBeforeAndAfterTheJump) {
+    static constexpr auto source = R"(jump end
+start:
+    copy 1 V0
+    jump start + V0
+end:
+loop:
+    jump start
+    jump loop
+    jump 1234
+)"sv;
+    auto const machine_code = chissembler::assemble("stdin"sv, source);
+    EXPECT_EQ(machine_code, combine_instructions(0x1206, 0x6001, 0xB202, 0x1202, 0x1206, 0x14D2));
+}
+
+TEST(ChissemblerTests, DuplicateLabelFails) {
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, "twice:\ncopy 1 V0\ntwice:\n"sv);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(e.what(), "stdin:3:1: duplicate label name 'twice' (first defined at stdin:1:1)");
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, UnknownLabelReportsAllUses) {
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code =
+                            chissembler::assemble("stdin"sv, "jump nowhere\nhere:\n  jump  nowhere + V0\njump here\n"sv);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(e.what(), "stdin:1:6: unknown label 'nowhere' (also used at stdin:3:9)");
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, StreamingProducesTheSameMachineCode) {
+    // large enough to be assembled in several chunks, with jumps across chunk boundaries in both directions
+    static constexpr auto prefix = "a_label_with_a_name_that_is_long_enough_to_fill_several_chunks_"sv;
+    auto source = std::string{ "jump end\n" };
+    for (auto i = 0; i < 800; ++i) {
+        auto const target = std::to_string(i % 7 == 0 ? i : i / 2);
+        source += std::string{ prefix } + std::to_string(i) + ":\n    copy " + std::to_string(i % 256) + " V"
+                  + std::to_string(i % 10) + "\n    jump " + std::string{ prefix } + target + "\n";
+    }
+    source += "end:\n    jump " + std::string{ prefix } + "0 + V0\n";
+    ASSERT_GT(source.size(), usize{ 100 } * 1024);
+
+    auto stream = std::istringstream{ source };
+    EXPECT_EQ(chissembler::assemble("stdin"sv, stream), chissembler::assemble("stdin"sv, source));
+}
+
+TEST(ChissemblerTests, StreamingReportsLinesOfLaterChunks) {
+    auto source = std::string{};
+    for (auto i = 0; i < 20000; ++i) {
+        source += "copy 1 V0\n";
+    }
+    source += "jump nowhere\ncopy 256 V0\n";
+
+    auto stream = std::istringstream{ source };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, stream);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(e.what(), "stdin:20002:6: '256' is not a valid 8 bit value");
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+
+    source.resize(source.size() - std::string_view{ "copy 256 V0\n" }.size());
+    auto truncated_stream = std::istringstream{ source };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, truncated_stream);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(e.what(), "stdin:20001:6: unknown label 'nowhere'");
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, HexadecimalAndBinaryLiterals) {
+    auto const machine_code =
+            chissembler::assemble("stdin"sv, "copy 0x2A V0\nadd 0XfF V1\nsub 0b101 V2\ncopy 0B0 V3\njump 0x3FE\n"sv);
+    EXPECT_EQ(machine_code, combine_instructions(0x602A, 0x71FF, 0x72FB, 0x6300, 0x13FE));
+
+    for (auto const invalid : { "copy 0x100 V0\n"sv, "copy 0xG V0\n"sv, "copy 0b102 V0\n"sv, "copy 0x V0\n"sv }) {
+        EXPECT_THROW(
+                { auto const machine_code = chissembler::assemble("stdin"sv, invalid); },
+                chissembler::EmitterError
+        );
+    }
+}
+
+TEST(ChissemblerTests, ParsingInstructionsDoesNotAllocate) {
+    auto const make_program = [](usize const num_repetitions) {
+        auto result = std::string{};
+        for (usize i = 0; i < num_repetitions; ++i) {
+            result += "copy 0x2A V0\nadd 0b11 V1\nsub V1 V2\nand V3 V4\nor V5 V6\nxor V7 V8\njump 0x300 + V0\n";
+        }
+        return result;
+    };
+    auto const small_program = make_program(100);
+    auto const large_program = make_program(10000);
+
+    // only the up front reservations depend on the size of the source, their number doesn't
+    auto const small_count = count_allocations([&] {
+        auto const machine_code = chissembler::assemble("stdin"sv, small_program);
+    });
+    auto const large_count = count_allocations([&] {
+        auto const machine_code = chissembler::assemble("stdin"sv, large_program);
+    });
+    EXPECT_GT(small_count, usize{ 0 });
+    EXPECT_EQ(small_count, large_count);
+}
+
+TEST(ChissemblerTests, TryAssembleReportsAllErrors) {
+    static constexpr auto source = R"(start:
+    copy 256 V0
+    copy 1 V0 $
+    add V1 5
+    jump nowhere
+start:
+    xor 1 V2
+    jump nowhere + V0
+    sub 1 V3
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, source);
+    EXPECT_TRUE(result.machine_code.empty());
+
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:2:10: '256' is not a valid 8 bit value",
+                    "stdin:3:15: source contains invalid characters",
+                    "stdin:4:12: '5' is not a valid target for writing",
+                    "stdin:5:10: unknown label 'nowhere' (also used at stdin:8:10)",
+                    "stdin:6:1: duplicate label name 'start' (first defined at stdin:1:1)",
+                    "stdin:7:9: '1' is not a valid target for writing",
+            })
+    );
+    ASSERT_EQ(result.diagnostics.size(), usize{ 6 });
+    EXPECT_EQ(result.diagnostics.front().line, usize{ 2 });
+    EXPECT_EQ(result.diagnostics.front().column, usize{ 10 });
+    EXPECT_EQ(result.diagnostics.front().message, "'256' is not a valid 8 bit value");
+
+    // assemble() still stops at the first error
+    EXPECT_THROW({ auto const machine_code = chissembler::assemble("stdin"sv, source); }, chissembler::EmitterError);
+}
+
+TEST(ChissemblerTests, TryAssembleWithoutErrors) {
+    auto const result = chissembler::try_assemble("stdin"sv, "loop:\njump loop\n"sv);
+    EXPECT_TRUE(result.diagnostics.empty());
+    EXPECT_EQ(result.machine_code, combine_instructions(0x1200));
+}
+
+TEST(ChissemblerTests, ConstantExpressionsAreFolded) {
+    static constexpr auto source = R"(const WIDTH = 8
+const MASK = (1 << 4) - 1
+    copy WIDTH * 2 + 1 V0
+    copy MASK & 0b1010 V1
+    add -(2 - 5) V2
+    sub 12 / 4 V3
+    copy 0x80 >> 3 | 1 V4
+start:
+    jump start + 2 * 2
+    jump end - 2
+    jump 0x200 + WIDTH
+    jump start + WIDTH + V0
+end:
+)"sv;
+    auto const expected = combine_instructions(0x6011, 0x610A, 0x7203, 0x73FD, 0x6411, 0x120E, 0x1210, 0x1208, 0xB212);
+    EXPECT_EQ(chissembler::assemble("stdin"sv, source), expected);
+    auto stream = std::istringstream{ std::string{ source } };
+    EXPECT_EQ(chissembler::assemble("stdin"sv, stream), expected);
+
+    // the linker adds the offsets to the addresses of the labels, constants aren't exported
+    auto const modules = std::array{
+        chissembler::assemble_object("main.csm"sv, "const OFFSET = 2\njump library + OFFSET\n"sv),
+        chissembler::assemble_object("library.csm"sv, "library:\ncopy 1 V0\ncopy 2 V0\n"sv),
+    };
+    EXPECT_EQ(modules[0].symbols.size(), usize{ 1 });
+    EXPECT_EQ(chissembler::link(modules), combine_instructions(0x1204, 0x6001, 0x6002));
+}
+
+TEST(ChissemblerTests, InvalidConstantExpressionsFail) {
+    static constexpr auto source = R"(copy 255 + 1 V0
+copy label V0
+jump 0xFFF + 1
+copy 1 / 0 V0
+const A = 1
+const A = 2
+A:
+jump here * 2
+here:
+jump here - V0
+copy 0x10000 * 0x10000 V0
+jump here + 0x1000
+copy 1 + label V0
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, source);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:1:6: '255 + 1' evaluates to 256, which is not a valid 8 bit value",
+                    "stdin:2:6: 'label' does not name a constant",
+                    "stdin:3:6: '0xFFF + 1' evaluates to 4096, which is not a valid address",
+                    "stdin:4:8: division by zero",
+                    "stdin:6:7: constant 'A' is already defined",
+                    "stdin:7:1: 'A' is already defined as a constant",
+                    "stdin:8:11: '*' can't be applied to labels or 'V0'",
+                    "stdin:10:11: labels and 'V0' can't be subtracted",
+                    "stdin:11:14: result of the constant expression doesn't fit into 32 bits",
+                    "stdin:12:6: offset 4096 of 'here + 0x1000' is out of range",
+                    "stdin:13:10: 'label' does not name a constant",
+            })
+    );
+}
+
+TEST(ChissemblerTests, MacrosAreExpanded) {
+    static constexpr auto source = R"(macro set(value, register)
+    copy value register
+endmacro
+macro twice(value)
+    set(value + 1, V1)
+    set(value, V2)
+endmacro
+    set(1, V0)
+    twice(2 * 3)
+    twice(2 * 3)
+    set((1), V3)
+)"sv;
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, source),
+            combine_instructions(0x6001, 0x6107, 0x6206, 0x6107, 0x6206, 0x6301)
+    );
+}
+
+TEST(ChissemblerTests, MacroLabelsAreLocalToEachExpansion) {
+    // the second expansion is copied from the cache, but still gets its own label
+    static constexpr auto source = R"(macro wait(register)
+loop:
+    sub 1 register
+    jump loop
+endmacro
+    wait(V0)
+    wait(V0)
+loop:
+    jump loop
+)"sv;
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, source),
+            combine_instructions(0x70FF, 0x1200, 0x70FF, 0x1204, 0x1208)
+    );
+}
+
+TEST(ChissemblerTests, MacrosDependingOnOtherNamesAreExpandedAgain) {
+    // the constant is defined by every expansion, no matter whether the arguments are the same
+    static constexpr auto defining = R"(macro define(value)
+const LIMIT = value
+endmacro
+    define(1)
+    define(1)
+    define(2)
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, defining);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:2:7: constant 'LIMIT' is already defined",
+                    "stdin:2:7: constant 'LIMIT' is already defined",
+            })
+    );
+
+    // `target` refers to a label in the first expansion and to a constant in the second one
+    static constexpr auto source = R"(macro go(target)
+    jump target
+endmacro
+    go(target)
+const target = 0x300
+    go(target)
+)"sv;
+    auto const labels = chissembler::try_assemble("stdin"sv, source);
+    ASSERT_EQ(labels.diagnostics.size(), usize{ 1 }); // the second jump isn't to a label
+    EXPECT_EQ(labels.diagnostics.front().to_string(), "stdin:4:8: unknown label 'target'");
+}
+
+TEST(ChissemblerTests, DiagnosticsDontQuoteAcrossMacroArguments) {
+    // the text between the body and the arguments is unrelated, so only the first token of mixed expressions is quoted
+    static constexpr auto source = R"(macro set(value)
+    copy value V0
+    copy value + 1 V1
+    copy 1 + value V2
+endmacro
+    set(250 + 6)
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, source);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:4:10: '1' evaluates to 257, which is not a valid 8 bit value",
+                    "stdin:6:9: '250 + 6' evaluates to 256, which is not a valid 8 bit value",
+                    "stdin:6:9: '250' evaluates to 257, which is not a valid 8 bit value",
+            })
+    );
+}
+
+TEST(ChissemblerTests, InvalidMacrosFail) {
+    static constexpr auto source = R"(unknown(1)
+macro set(value)
+    copy value V0
+endmacro
+set(1, 2)
+set()
+macro set(a, a)
+endmacro
+macro recursive()
+    recursive()
+endmacro
+recursive()
+set(,)
+endmacro
+macro open()
+    copy 1 V0
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, source);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:1:1: 'unknown' does not name a macro",
+                    "stdin:5:1: wrong number of arguments for macro 'set' (expected 1, got 2)",
+                    "stdin:6:1: wrong number of arguments for macro 'set' (expected 1, got 0)",
+                    "stdin:7:7: macro 'set' is already defined",
+                    "stdin:10:5: macro 'recursive' can't be expanded within its own expansion",
+                    "stdin:13:5: missing macro argument",
+                    "stdin:14:1: unexpected token",
+                    "stdin:15:1: macro 'open' is missing 'endmacro'",
+            })
+    );
+
+    auto stream = std::istringstream{ "macro empty()\nendmacro\n" };
+    EXPECT_THROW(std::ignore = chissembler::assemble("stdin"sv, stream), chissembler::EmitterError);
+}
+
+TEST(ChissemblerTests, DataDirectivesEmitBytesAndWords) {
+    static constexpr auto source = R"(    jump start
+sprite:
+    db 0xF0, 0x90, 1 + 1, 0
+table:
+    dw sprite, table + 1, 0x1234
+start:
+    copy sprite I
+    copy table + 2 I
+    copy 3 V0
+)"sv;
+    auto const expected =
+            combine_instructions(0x120C, 0xF090, 0x0200, 0x0202, 0x0207, 0x1234, 0xA202, 0xA208, 0x6003);
+    EXPECT_EQ(chissembler::assemble("stdin"sv, source), expected);
+    auto stream = std::istringstream{ std::string{ source } };
+    EXPECT_EQ(chissembler::assemble("stdin"sv, stream), expected);
+
+    auto listing = std::ostringstream{};
+    std::ignore = chissembler::assemble(
+            "stdin"sv,
+            "copy data I\ndata:\ndb 1, 2\n"sv,
+            chissembler::AssembleOptions{ .listing = &listing }
+    );
+    EXPECT_EQ(
+            listing.str(),
+            "0x200  A202       copy data I\n"
+            "                  data:\n"
+            "0x202  01         db 1, 2\n"
+            "0x203  02         db 1, 2\n"
+    );
+
+    // the linker fills in the addresses of data labels, too
+    auto const modules = std::array{
+        chissembler::assemble_object("main.csm"sv, "copy data I\n"sv),
+        chissembler::assemble_object("library.csm"sv, "data:\ndw data + 2\n"sv),
+    };
+    EXPECT_EQ(chissembler::link(modules), combine_instructions(0xA202, 0x0204));
+}
+
+TEST(ChissemblerTests, IncludesBinaryFiles) {
+    auto const path = std::filesystem::temp_directory_path()
+                      / std::format("chissembler_incbin_test_{}", std::random_device{}());
+    {
+        auto file = std::ofstream{ path, std::ios::binary };
+        file << "\x01\x02\x03\x04\x05\x06";
+    }
+    auto const name = path.string();
+    auto const source = std::format("copy data I\ndata:\nincbin \"{}\", 1, 4\nincbin \"{}\"\n", name, name);
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, source),
+            combine_instructions(0xA202, 0x0203, 0x0405, 0x0102, 0x0304, 0x0506)
+    );
+
+    auto const invalid_source =
+            std::format("incbin \"{}\", 2, 5\nincbin \"{}\", 7, 0\nincbin \"missing\"\n", name, name);
+    auto const result = chissembler::try_assemble("stdin"sv, invalid_source);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    std::format(
+                            "stdin:1:{}: length 5 exceeds the 4 bytes of \"{}\" behind offset 2",
+                            name.length() + 15,
+                            name
+                    ),
+                    std::format("stdin:2:{}: offset 7 is outside of \"{}\" (6 bytes)", name.length() + 12, name),
+                    "stdin:3:8: unable to open file 'missing'",
+            })
+    );
+    std::filesystem::remove(path);
+}
+
+TEST(ChissemblerTests, InvalidDataFails) {
+    static constexpr auto source = R"(db 256
+dw 0x10000
+db label
+dw V0
+copy label + V0 I
+db 1,
+incbin "open
+)"sv;
+    auto const result = chissembler::try_assemble("stdin"sv, source);
+    auto messages = std::vector<std::string>{};
+    for (auto const& diagnostic : result.diagnostics) {
+        messages.push_back(diagnostic.to_string());
+    }
+    EXPECT_EQ(
+            messages,
+            (std::vector<std::string>{
+                    "stdin:1:4: '256' is not a valid 8 bit value",
+                    "stdin:2:4: '0x10000' is not a valid 16 bit value",
+                    "stdin:3:4: 'label' does not name a constant",
+                    "stdin:4:4: token of type 'Register' is not a valid data value",
+                    "stdin:5:14: token of type 'Register' is not a valid operand",
+                    "stdin:6:6: token of type 'Newline' is not a valid data value",
+                    "stdin:7:8: unterminated string literal",
+                    "stdin:7:13: expected token type 'StringLiteral', got 'Newline' instead",
+            })
+    );
+}
+
+TEST(ChissemblerTests, LinkedModulesMatchTheConcatenatedSource) {
+    static constexpr auto main_module = "start:\n    copy 1 V0\n    jump subroutine\nback:\n    jump start + V0\n"sv;
+    static constexpr auto library_module = "subroutine:\n    add 2 V0\n    jump back\nlocal:\n    jump local\n"sv;
+    auto const modules = std::array{
+        chissembler::assemble_object("main.csm"sv, main_module),
+        chissembler::assemble_object("library.csm"sv, library_module),
+    };
+    EXPECT_EQ(
+            chissembler::link(modules),
+            chissembler::assemble("stdin"sv, std::format("{}{}", main_module, library_module))
+    );
+}
+
+TEST(ChissemblerTests, ObjectFilesSurviveARoundTrip) {
+    auto const object = chissembler::assemble_object("main.csm"sv, "loop:\ncopy 1 V0\njump elsewhere\njump loop\n"sv);
+    ASSERT_EQ(object.symbols.size(), 2);
+    EXPECT_EQ(object.symbols[0].name, "loop");
+    EXPECT_EQ(object.symbols[0].offset, u32{ 0 });
+    EXPECT_EQ(object.symbols[1].name, "elsewhere");
+    EXPECT_FALSE(object.symbols[1].offset.has_value());
+    EXPECT_EQ(object.relocations.size(), 2);
+
+    auto const data = chissembler::write_object(object);
+    auto const read = chissembler::read_object("main.csm", data);
+    EXPECT_EQ(read.code, object.code);
+    EXPECT_EQ(chissembler::write_object(read), data);
+    EXPECT_THROW(
+            std::ignore = chissembler::read_object("main.csm", std::span{ data }.first(data.size() - 1)),
+            chissembler::ObjectFileError
+    );
+}
+
+TEST(ChissemblerTests, SourceMapsMapAddressesToSourceLocations) {
+    static constexpr auto source = R"(start:
+    copy 1 V0
+loop:
+    db 1, 2, 3
+  add 1 V0
+    jump loop
+end:
+)"sv;
+    auto data = std::vector<std::byte>{};
+    std::ignore = chissembler::assemble("main.csm"sv, source, chissembler::AssembleOptions{ .source_map = &data });
+    auto const source_map = chissembler::SourceMapView{ data };
+    EXPECT_EQ(source_map.num_ranges(), 6); // one per byte of data
+    EXPECT_EQ(source_map.num_labels(), 3);
+
+    auto const expect_location = [&](u16 const address, u32 const line, u32 const column) {
+        auto const location = source_map.find(address);
+        ASSERT_TRUE(location.has_value()) << address;
+        EXPECT_EQ(location->file, "main.csm");
+        EXPECT_EQ(location->line, line) << address;
+        EXPECT_EQ(location->column, column) << address;
+    };
+    expect_location(0x200, 2, 5);
+    expect_location(0x201, 2, 5);
+    expect_location(0x204, 4, 5); // within the data
+    expect_location(0x205, 5, 3);
+    expect_location(0x208, 6, 5);
+    EXPECT_FALSE(source_map.find(0x1FF).has_value());
+    EXPECT_FALSE(source_map.find(0x209).has_value());
+
+    auto const loop = source_map.find_label(0x206);
+    ASSERT_TRUE(loop.has_value());
+    EXPECT_EQ(loop->name, "loop");
+    EXPECT_EQ(loop->address, 0x202);
+    EXPECT_EQ(loop->size, 7);
+    EXPECT_EQ(source_map.find_label(0x201)->name, "start");
+    EXPECT_FALSE(source_map.find_label(0x209).has_value()); // `end` doesn't span any code
+}
+
+TEST(ChissemblerTests, SourceMapsRequireTheProgramToFitIntoMemory) {
+    auto source = std::string{};
+    for (auto i = 0; i < 0x701; ++i) {
+        source += "copy 0 V0\n";
+    }
+    auto data = std::vector<std::byte>{};
+    auto const result = chissembler::try_assemble("main.csm"sv, source, { .source_map = &data });
+    EXPECT_TRUE(result.machine_code.empty());
+    EXPECT_TRUE(data.empty());
+    ASSERT_EQ(result.diagnostics.size(), usize{ 1 });
+    EXPECT_EQ(
+            result.diagnostics.front().message,
+            "no source map can be written, since the program of 3586 bytes doesn't fit into memory"
+    );
+    EXPECT_THROW(
+            std::ignore = chissembler::assemble("main.csm"sv, source, { .source_map = &data }),
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, InvalidSourceMapsFail) {
+    auto data = std::vector<std::byte>{};
+    std::ignore = chissembler::assemble("main.csm"sv, "loop:\njump loop\n"sv, { .source_map = &data });
+    EXPECT_NO_THROW(std::ignore = chissembler::SourceMapView{ data });
+    EXPECT_THROW(
+            std::ignore = chissembler::SourceMapView{ std::span{ data }.first(data.size() - 1) },
+            chissembler::SourceMapError
+    );
+    EXPECT_THROW(std::ignore = chissembler::SourceMapView{ std::span{ data }.first(8) }, chissembler::SourceMapError);
+
+    auto trailing = data;
+    trailing.push_back(std::byte{ 0 });
+    EXPECT_THROW(std::ignore = chissembler::SourceMapView{ trailing }, chissembler::SourceMapError);
+
+    auto wrong_magic = data;
+    wrong_magic.front() = std::byte{ 'X' };
+    EXPECT_THROW(std::ignore = chissembler::SourceMapView{ wrong_magic }, chissembler::SourceMapError);
+
+    // the string table is at the end and holds the 12 bytes of "main.csm" and "loop", the name of the label is cut off
+    auto truncated_names = data;
+    truncated_names.at(24) = std::byte{ 11 };
+    truncated_names.pop_back();
+    EXPECT_THROW(std::ignore = chissembler::SourceMapView{ truncated_names }, chissembler::SourceMapError);
+}
+
+TEST(ChissemblerTests, LinkingUndefinedSymbolFails) {
+    auto const modules = std::array{ chissembler::assemble_object("main.csm"sv, "jump nowhere\n"sv) };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::link(modules);
+                } catch (chissembler::LinkerError const& e) {
+                    ASSERT_STREQ(e.what(), "main.csm: undefined symbol 'nowhere'");
+                    throw;
+                }
+            },
+            chissembler::LinkerError
+    );
+}
+
+TEST(ChissemblerTests, LinkingDuplicateSymbolFails) {
+    auto const modules = std::array{
+        chissembler::assemble_object("main.csm"sv, "twice:\njump twice\n"sv),
+        chissembler::assemble_object("library.csm"sv, "twice:\n"sv),
+    };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::link(modules);
+                } catch (chissembler::LinkerError const& e) {
+                    ASSERT_STREQ(e.what(), "library.csm: duplicate symbol 'twice' (first defined in main.csm)");
+                    throw;
+                }
+            },
+            chissembler::LinkerError
+    );
+}
+
+TEST(ChissemblerTests, LinkingProgramTooLargeForMemoryFails) {
+    auto source = std::string{};
+    for (auto i = 0; i < 0x400; ++i) {
+        source += "copy 0 V0\n";
+    }
+    auto const modules = std::array{
+        chissembler::assemble_object("main.csm"sv, source),
+        chissembler::assemble_object("library.csm"sv, source),
+    };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::link(modules);
+                } catch (chissembler::LinkerError const& e) {
+                    ASSERT_STREQ(e.what(), "library.csm: program of 4096 bytes doesn't fit into memory");
+                    throw;
+                }
+            },
+            chissembler::LinkerError
+    );
+}
+
+TEST(ChissemblerTests, OptimizerRemovesAndMergesInstructions) {
+    static constexpr auto source = R"(start:
+    copy 0 V1
+    add 5 V1
+    copy V2 V2
+    add 3 V3
+    sub 1 V3
+    add 4 V4
+    sub 4 V4
+    jump middle
+    copy 1 V0
+middle:
+    jump start
+    jump next
+next:
+    add 1 V0
+)"sv;
+    auto report = std::vector<chissembler::Diagnostic>{};
+    auto const machine_code = chissembler::assemble(
+            "stdin"sv,
+            source,
+            chissembler::AssembleOptions{ .optimize = true, .optimization_report = &report }
+    );
+    EXPECT_EQ(machine_code, combine_instructions(0x6105, 0x7302, 0x1200));
+    ASSERT_EQ(report.size(), 9);
+    EXPECT_EQ(report[0].to_string(), "stdin:9:5: jump to 'middle' threaded through to 'start'");
+    EXPECT_EQ(report[1].to_string(), "stdin:3:5: folded into the copy into V1");
+    EXPECT_EQ(report[2].to_string(), "stdin:4:5: removed copy of V2 into itself");
+    EXPECT_EQ(report[3].to_string(), "stdin:6:5: merged with the addition to V3");
+    EXPECT_EQ(report[4].to_string(), "stdin:8:5: removed subtraction along with its inverse");
+    EXPECT_EQ(report[5].to_string(), "stdin:13:5: removed jump to 'next', which is the next instruction");
+    EXPECT_EQ(report[6].to_string(), "stdin:10:5: removed 3 unreachable instructions");
+    EXPECT_EQ(report[7].to_string(), "stdin:11:1: removed unused label 'middle'");
+    EXPECT_EQ(report[8].to_string(), "stdin:14:1: removed unused label 'next'");
+
+    // without optimizing, every instruction is kept
+    EXPECT_EQ(chissembler::assemble("stdin"sv, source).size(), 24);
+}
+
+TEST(ChissemblerTests, OptimizerRemovesUnreachableCode) {
+    static constexpr auto source = R"(    jump main
+unused:
+    copy 1 V0
+    jump unused
+main:
+    copy 2 V0
+loop:
+    jump loop
+    copy 3 V0
+)"sv;
+    auto report = std::vector<chissembler::Diagnostic>{};
+    auto const machine_code = chissembler::assemble(
+            "stdin"sv,
+            source,
+            chissembler::AssembleOptions{ .optimize = true, .optimization_report = &report }
+    );
+    EXPECT_EQ(machine_code, combine_instructions(0x6002, 0x1202));
+    ASSERT_EQ(report.size(), 5);
+    EXPECT_EQ(report[0].to_string(), "stdin:3:5: removed 2 unreachable instructions");
+    EXPECT_EQ(report[1].to_string(), "stdin:9:5: removed 1 unreachable instruction");
+    EXPECT_EQ(report[2].to_string(), "stdin:2:1: removed unused label 'unused'");
+    EXPECT_EQ(report[3].to_string(), "stdin:1:5: removed jump to 'main', which is the next instruction");
+    EXPECT_EQ(report[4].to_string(), "stdin:5:1: removed unused label 'main'");
+
+    // unknown labels are still reported, even if they are only used by unreachable code
+    EXPECT_THROW(
+            std::ignore = chissembler::assemble(
+                    "stdin"sv,
+                    "loop:\njump loop\njump nowhere\n"sv,
+                    chissembler::AssembleOptions{ .optimize = true }
+            ),
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, OptimizerKeepsAddressesThatMayBeReferenced) {
+    auto report = std::vector<chissembler::Diagnostic>{};
+    auto const options = chissembler::AssembleOptions{ .optimize = true, .optimization_report = &report };
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, "copy V1 V1\njump 0x200\n"sv, options),
+            combine_instructions(0x8110, 0x1200)
+    );
+    ASSERT_EQ(report.size(), 1);
+    EXPECT_EQ(report[0].to_string(), "stdin:2:1: program is not optimized because of the jump to 0x200");
+
+    // the instructions following the target of a jump with offset may form a jump table
+    static constexpr auto jump_table = "jump table + V0\ncopy V1 V1\ntable:\njump end\ncopy V1 V1\nend:\n"sv;
+    EXPECT_EQ(chissembler::assemble("stdin"sv, jump_table, options), combine_instructions(0xB202, 0x1206, 0x8110));
+}
+
+TEST(ChissemblerTests, VirtualRegistersUseFreeDataRegisters) {
+    // V0 and V2 are used directly, so the virtual register gets V1
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, "copy 1 V0\ncopy 2 %value\nadd V0 %value\ncopy %value V2\n"sv),
+            combine_instructions(0x6001, 0x6102, 0x8104, 0x8210)
+    );
+
+    // registers that are live at the same time get different data registers, the others may share one
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, "copy 1 %a\ncopy %a V5\ncopy 2 %b\ncopy %b V6\n"sv),
+            combine_instructions(0x6001, 0x8500, 0x6002, 0x8600)
+    );
+    EXPECT_EQ(
+            chissembler::assemble("stdin"sv, "copy 1 %a\ncopy 2 %b\nadd %a %b\ncopy %b V5\n"sv),
+            combine_instructions(0x6101, 0x6002, 0x8014, 0x8500)
+    );
+}
+
+TEST(ChissemblerTests, VirtualRegistersAreSpilledIntoMemory) {
+    // 16 registers are live at the same time, but only V2 to VD can hold them
+    auto source = std::string{ "copy 0 VE\ncopy VE VE\n" };
+    for (auto i = 0; i < 16; ++i) {
+        source += std::format("copy {} %value_{}\n", i + 1, i);
+    }
+    for (auto i = 0; i < 16; ++i) {
+        source += std::format("add %value_{} VE\n", i);
+    }
+    auto sizes = std::vector<usize>{};
+    for (auto const optimize : { false, true }) {
+        auto const machine_code =
+                chissembler::assemble("stdin"sv, source, chissembler::AssembleOptions{ .optimize = optimize });
+        EXPECT_GT(machine_code.size(), usize{ 33 * 2 });
+        auto const state = execute(machine_code);
+        EXPECT_EQ(state.emulator.registers().at(0xE), 16 * 17 / 2);
+        sizes.push_back(machine_code.size());
+    }
+    // setting I to the spill area doesn't keep the program from being optimized (the copy into itself is removed)
+    EXPECT_EQ(sizes.at(1), sizes.at(0) - 2);
+
+    // the spilled registers are transferred through V0 and V1
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, "copy 1 V0\n" + source);
+                } catch (chissembler::EmitterError const& e) {
+                    EXPECT_TRUE(std::string_view{ e.what() }.starts_with("stdin:"));
+                    EXPECT_TRUE(std::string_view{ e.what() }.ends_with(
+                            "(spilling requires V0 and V1, which are used directly)"
+                    ));
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+}
+
+TEST(ChissemblerTests, VirtualRegistersDontCauseFollowUpErrors) {
+    auto const to_strings = [](std::vector<chissembler::Diagnostic> const& diagnostics) {
+        auto result = std::vector<std::string>{};
+        for (auto const& diagnostic : diagnostics) {
+            result.push_back(diagnostic.to_string());
+        }
+        return result;
+    };
+
+    // the register allocation is skipped because of the syntax error
+    auto const result = chissembler::try_assemble("stdin"sv, "copy 1 %a\ncopy 256 V0\nadd %a %b\njump nowhere\n"sv);
+    EXPECT_TRUE(result.machine_code.empty());
+    EXPECT_EQ(
+            to_strings(result.diagnostics),
+            (std::vector<std::string>{
+                    "stdin:2:6: '256' is not a valid 8 bit value",
+                    "stdin:4:6: unknown label 'nowhere'",
+            })
+    );
+
+    // the register allocation fails
+    auto const failed = chissembler::try_assemble("stdin"sv, "copy 1 V0\ncopy 1 %a\njump 0x200\n"sv);
+    EXPECT_EQ(
+            to_strings(failed.diagnostics),
+            (std::vector<std::string>{
+                    "stdin:3:1: virtual registers can't be combined with jumps to absolute addresses within the "
+                    "program",
+            })
+    );
+}
+
+TEST(ChissemblerTests, VirtualRegistersRequireTheWholeProgram) {
+    static constexpr auto source = "copy 1 %value\ncopy %value V1\n"sv;
+    auto stream = std::istringstream{ std::string{ source } };
+    ASSERT_THROW(
+            {
+                try {
+                    auto const machine_code = chissembler::assemble("stdin"sv, stream);
+                } catch (chissembler::EmitterError const& e) {
+                    ASSERT_STREQ(
+                            e.what(),
+                            "stdin:1:1: virtual register '%value' can only be used when assembling a whole program "
+                            "from memory"
+                    );
+                    throw;
+                }
+            },
+            chissembler::EmitterError
+    );
+    EXPECT_THROW(std::ignore = chissembler::assemble_object("stdin"sv, source), chissembler::EmitterError);
+    EXPECT_THROW(
+            std::ignore = chissembler::assemble("stdin"sv, "copy 1 %value\njump 0x200\n"sv),
+            chissembler::EmitterError
+    );
+}
+
+class CacheTests : public ::testing::Test {
+protected:
+    std::filesystem::path m_directory;
+
+    void SetUp() override {
+        m_directory = std::filesystem::temp_directory_path()
+                      / std::format("chissembler_cache_test_{}", std::random_device{}());
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(m_directory);
+    }
+};
+
+TEST_F(CacheTests, StoresAndLoadsMachineCode) {
+    auto const cache = chissembler::Cache{ m_directory, 1024 };
+    auto const source = "copy 42 V0\n"sv;
+    auto const key = chissembler::Cache::key(source, {});
+    EXPECT_FALSE(cache.load(key).has_value());
+
+    auto const machine_code = chissembler::assemble("stdin"sv, source);
+    cache.store(key, machine_code);
+    EXPECT_EQ(cache.load(key), machine_code);
+
+    // a second store of the same entry (e.g. by another process) just replaces it
+    cache.store(key, machine_code);
+    EXPECT_EQ(cache.load(key), machine_code);
+
+    EXPECT_EQ(chissembler::Cache::key("copy 42 V0\n"sv, {}), key);
+    EXPECT_NE(chissembler::Cache::key("copy 43 V0\n"sv, {}), key);
+    EXPECT_FALSE(cache.load(chissembler::Cache::key("copy 43 V0\n"sv, {})).has_value());
+    EXPECT_NE(chissembler::Cache::key(source, {}, chissembler::CachedOutput::Object), key);
+    EXPECT_NE(chissembler::Cache::key(source, chissembler::AssembleOptions{ .optimize = true }), key);
+}
+
+TEST_F(CacheTests, TrimEvictsLeastRecentlyUsedEntries) {
+    auto const cache = chissembler::Cache{ m_directory, 150 };
+    auto const entry = std::vector<std::byte>(100, std::byte{ 0x12 });
+    auto const keys = std::array{
+        chissembler::Cache::key("first"sv, {}),
+        chissembler::Cache::key("second"sv, {}),
+        chissembler::Cache::key("third"sv, {}),
+    };
+    for (auto const& key : keys) {
+        cache.store(key, entry);
+    }
+    auto const an_hour_ago = std::filesystem::file_time_type::clock::now() - std::chrono::hours{ 1 };
+    for (auto const& file : std::filesystem::directory_iterator{ m_directory }) {
+        std::filesystem::last_write_time(file.path(), an_hour_ago);
+    }
+
+    EXPECT_TRUE(cache.load(keys[1]).has_value()); // marks the entry as recently used
+    cache.trim();
+    EXPECT_FALSE(cache.load(keys[0]).has_value());
+    EXPECT_TRUE(cache.load(keys[1]).has_value());
+    EXPECT_FALSE(cache.load(keys[2]).has_value());
+}
@@ -6,6 +6,7 @@
 #include <gsl/gsl>
 #include <gtest/gtest.h>
 #include <random>
+#include <sstream>
 #include <vector>
 
 using Address = emulator::Chip8::Address;
@@ -841,3 +842,91 @@ TEST_F(DefaultState, Load) {
         ASSERT_EQ(emulator->address_register(), 0x50 + bound + 1);
     }
 }
+
+TEST(OpcodeClassification, ClassifiesEveryInstruction) {
+    using emulator::OpcodeClass, emulator::classify_opcode;
+    EXPECT_EQ(classify_opcode(0x00E0), OpcodeClass::ClearScreen);
+    EXPECT_EQ(classify_opcode(0x00EE), OpcodeClass::Return);
+    EXPECT_EQ(classify_opcode(0x0123), OpcodeClass::Invalid);
+    EXPECT_EQ(classify_opcode(0x1234), OpcodeClass::Jump);
+    EXPECT_EQ(classify_opcode(0x2345), OpcodeClass::Call);
+    EXPECT_EQ(classify_opcode(0x5120), OpcodeClass::SkipIfRegistersEqual);
+    EXPECT_EQ(classify_opcode(0x5121), OpcodeClass::Invalid);
+    EXPECT_EQ(classify_opcode(0x8124), OpcodeClass::Add);
+    EXPECT_EQ(classify_opcode(0x812E), OpcodeClass::ShiftLeft);
+    EXPECT_EQ(classify_opcode(0x812F), OpcodeClass::Invalid);
+    EXPECT_EQ(classify_opcode(0xD125), OpcodeClass::Draw);
+    EXPECT_EQ(classify_opcode(0xE19E), OpcodeClass::SkipIfKeyPressed);
+    EXPECT_EQ(classify_opcode(0xF133), OpcodeClass::StoreBcd);
+    EXPECT_EQ(classify_opcode(0xF199), OpcodeClass::Invalid);
+    EXPECT_EQ(emulator::opcode_pattern(OpcodeClass::LoadRegisters), "FX65");
+}
+
+#ifdef ENABLE_EMULATOR_PROFILING
+TEST_F(DefaultState, ProfileCountsOpcodesAndAddresses) {
+    store_opcodes(
+            0x6000, // 0x200: V0 = 0
+            0x7001, // 0x202: V0 += 1
+            0x3005, // 0x204: skip if V0 == 5
+            0x1202  // 0x206: jump to 0x202
+    );
+    for (auto i = 0; i < 1 + 5 * 3 - 1; ++i) {
+        emulator->execute_next_instruction();
+    }
+    ASSERT_EQ(emulator->instruction_pointer(), 0x208);
+
+    auto const& profile = emulator->profile();
+    EXPECT_EQ(profile.num_instructions(), 15);
+    EXPECT_EQ(profile.opcode_count(emulator::OpcodeClass::StoreImmediate), 1);
+    EXPECT_EQ(profile.opcode_count(emulator::OpcodeClass::AddImmediate), 5);
+    EXPECT_EQ(profile.opcode_count(emulator::OpcodeClass::SkipIfEqual), 5);
+    EXPECT_EQ(profile.opcode_count(emulator::OpcodeClass::Jump), 4);
+    EXPECT_EQ(profile.address_counts().at(0x200), 1);
+    EXPECT_EQ(profile.address_counts().at(0x202), 5);
+    EXPECT_EQ(profile.address_counts().at(0x206), 4);
+
+    emulator->reset_profile();
+    EXPECT_EQ(emulator->profile().num_instructions(), 0);
+    EXPECT_EQ(emulator->profile().address_counts().at(0x202), 0);
+}
+
+TEST_F(DefaultState, CallGraphAttributesInstructionsToSubroutines) {
+    store_opcodes(
+            0x2206, // 0x200: call 0x206
+            0x2206, // 0x202: call 0x206
+            0x1204, // 0x204: jump to 0x204 (endless loop)
+            0x6001, // 0x206: V0 = 1
+            0x220C, // 0x208: call 0x20C
+            0x00EE, // 0x20A: return
+            0x00EE  // 0x20C: return
+    );
+    for (auto i = 0; i < 2 * 5 + 1; ++i) {
+        emulator->execute_next_instruction();
+    }
+    ASSERT_EQ(emulator->instruction_pointer(), 0x204);
+
+    auto const& call_graph = emulator->profile().call_graph();
+    auto const& nodes = call_graph.nodes();
+    ASSERT_EQ(nodes.size(), 3);
+    EXPECT_EQ(nodes.at(1).address, 0x206);
+    EXPECT_EQ(nodes.at(1).num_calls, 2);
+    EXPECT_EQ(nodes.at(1).exclusive_count, 6);
+    EXPECT_EQ(nodes.at(2).address, 0x20C);
+    EXPECT_EQ(nodes.at(2).parent, 1);
+    EXPECT_EQ(nodes.at(2).exclusive_count, 2);
+
+    auto const inclusive = call_graph.inclusive_counts();
+    EXPECT_EQ(inclusive.at(emulator::CallGraph::root), 11);
+    EXPECT_EQ(inclusive.at(1), 8);
+
+    auto const routines = call_graph.routines();
+    ASSERT_EQ(routines.size(), 2);
+    EXPECT_EQ(routines.at(0).address, 0x206);
+    EXPECT_EQ(routines.at(0).inclusive_count, 8);
+    EXPECT_EQ(routines.at(0).exclusive_count, 6);
+
+    auto stream = std::stringstream{};
+    call_graph.write_folded_stacks(stream);
+    EXPECT_EQ(stream.str(), "root 3\nroot;0x206 6\nroot;0x206;0x20C 2\n");
+}
+#endif
@@ -0,0 +1,145 @@
+#include "mock_input_source.hpp"
+#include "mock_screen.hpp"
+#include "mock_time_source.hpp"
+#include <array>
+#include <chip8/chip8.hpp>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <instruction_trace/trace_reader.hpp>
+#include <instruction_trace/trace_writer.hpp>
+#include <vector>
+
+using instruction_trace::TraceReader;
+using instruction_trace::TraceWriter;
+
+// 0x200: V0 = 0
+// 0x202: V0 += 1     <--+
+// 0x204: I = 0x300      |
+// 0x206: BCD(V0) -> I   |
+// 0x208: jump 0x202  ---+
+static constexpr auto program = std::array<u16, 5>{ 0x6000, 0x7001, 0xA300, 0xF033, 0x1202 };
+
+class InstructionTrace : public ::testing::Test {
+protected:
+    MockScreen screen;
+    MockInputSource input_source;
+    MockTimeSource time_source;
+    std::vector<std::filesystem::path> m_files;
+
+    void TearDown() override {
+        for (auto const& file : m_files) {
+            std::filesystem::remove(file);
+        }
+    }
+
+    [[nodiscard]] std::filesystem::path temporary_file(std::string_view const name) {
+        auto const path =
+                std::filesystem::temp_directory_path()
+                / std::format("{}_{}", ::testing::UnitTest::GetInstance()->current_test_info()->name(), name);
+        m_files.push_back(path);
+        return path;
+    }
+
+    // records `num_instructions` instructions of `program`, after `patch_after` instructions 0x202 is patched to
+    // `patched_opcode` (if given)
+    [[nodiscard]] std::filesystem::path record(
+            std::string_view const name,
+            usize const num_instructions,
+            usize const patch_after = 0,
+            Optional<u16> const patched_opcode = none
+    ) {
+        auto const path = temporary_file(name);
+        auto chip8 = emulator::Chip8{ screen, input_source, time_source };
+        auto address = u16{ 0x200 };
+        for (auto const opcode : program) {
+            chip8.write(address, static_cast<u8>(opcode >> 8));
+            chip8.write(static_cast<u16>(address + 1), static_cast<u8>(opcode & 0xFF));
+            address = static_cast<u16>(address + 2);
+        }
+
+        auto writer = TraceWriter{ path };
+        chip8.set_trace_sink(&writer);
+        for (usize i = 0; i < num_instructions; ++i) {
+            if (patched_opcode and i == patch_after) {
+                chip8.write(0x202, static_cast<u8>(patched_opcode.value() >> 8));
+                chip8.write(0x203, static_cast<u8>(patched_opcode.value() & 0xFF));
+            }
+            chip8.execute_next_instruction();
+        }
+        writer.finish();
+        return path;
+    }
+};
+
+TEST_F(InstructionTrace, RecordsRegisterAndMemoryChanges) {
+    auto const reader = TraceReader{ record("trace", 5) };
+    ASSERT_EQ(reader.num_records(), 5);
+
+    auto const first = reader.read(0);
+    EXPECT_EQ(first.instruction_pointer, 0x200);
+    EXPECT_EQ(first.opcode, 0x6000);
+    EXPECT_TRUE(first.changed_registers().empty()); // V0 already was 0
+    EXPECT_TRUE(first.changed_memory().empty());
+
+    auto const add = reader.read(1);
+    EXPECT_EQ(add.opcode, 0x7001);
+    ASSERT_EQ(add.changed_registers().size(), 1);
+    EXPECT_EQ(add.changed_registers()[0].register_index, 0);
+    EXPECT_EQ(add.changed_registers()[0].value, 1);
+
+    auto const set_address = reader.read(2);
+    ASSERT_EQ(set_address.changed_registers().size(), 1);
+    EXPECT_EQ(set_address.changed_registers()[0].register_index, emulator::RegisterDelta::address_register);
+    EXPECT_EQ(set_address.changed_registers()[0].value, 0x300);
+
+    auto const bcd = reader.read(3);
+    EXPECT_TRUE(bcd.changed_registers().empty());
+    ASSERT_EQ(bcd.changed_memory().size(), 3);
+    EXPECT_EQ(bcd.changed_memory()[0].address, 0x300);
+    EXPECT_EQ(bcd.changed_memory()[2].address, 0x302);
+    EXPECT_EQ(bcd.changed_memory()[2].value, 1);
+}
+
+TEST_F(InstructionTrace, SeeksAcrossIndexBlocks) {
+    static constexpr auto num_instructions = usize{ 3 * instruction_trace::index_interval + 123 };
+    auto const reader = TraceReader{ record("trace", num_instructions) };
+    ASSERT_EQ(reader.num_records(), num_instructions);
+
+    // the loop body starts at cycle 1 and consists of four instructions
+    for (auto const cycle : { u64{ 4095 }, u64{ 4096 }, u64{ 4097 }, u64{ 8193 }, u64{ num_instructions - 1 } }) {
+        auto const record = reader.read(cycle);
+        EXPECT_EQ(record.instruction_pointer, 0x202 + 2 * ((cycle - 1) % 4)) << "cycle " << cycle;
+    }
+
+    auto const records = reader.read(4094, 4);
+    ASSERT_EQ(records.size(), 4);
+    EXPECT_EQ(records.at(1).opcode, program.at(1 + (4095 - 1) % 4));
+
+    EXPECT_TRUE(reader.read(num_instructions - 1, 10).size() == 1);
+    EXPECT_THROW(std::ignore = reader.read(num_instructions), instruction_trace::TraceError);
+}
+
+TEST_F(InstructionTrace, FindsFirstDivergence) {
+    auto const original = TraceReader{ record("original", 10'000) };
+    auto const same = TraceReader{ record("same", 10'000) };
+    EXPECT_FALSE(find_first_divergence(original, same).has_value());
+
+    // 0x202 is executed at cycles 1, 5, 9, ... so the first affected cycle after 5000 instructions is 5001
+    auto const patched = TraceReader{ record("patched", 10'000, 5'000, 0x7002) };
+    EXPECT_EQ(find_first_divergence(original, patched), u64{ 5001 });
+    EXPECT_EQ(find_first_divergence(patched, original), u64{ 5001 });
+
+    auto const shorter = TraceReader{ record("shorter", 4'500) };
+    EXPECT_EQ(find_first_divergence(original, shorter), u64{ 4500 });
+}
+
+TEST_F(InstructionTrace, RejectsIncompleteFiles) {
+    auto const path = temporary_file("incomplete");
+    {
+        auto file = std::ofstream{ path, std::ios::binary };
+        file << "CH8TRACE";
+    }
+    EXPECT_THROW(TraceReader{ path }, instruction_trace::TraceError);
+}